@@ -4,12 +4,23 @@ layout (location = 1) in vec2 aTexCoords;
 
 out vec2 TexCoords;
 
+// Per-object data, written once per frame by ObjectBuffer and indexed by instance
+struct ObjectData
+{
+    mat4 model;
+    vec4 params;
+};
+
+layout (std140) uniform Objects
+{
+    ObjectData objects[200];
+};
+
 uniform mat4 projection;
 uniform mat4 view;
-uniform mat4 model;
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0f);
+    gl_Position = projection * view * objects[gl_InstanceID].model * vec4(aPos, 1.0f);
     TexCoords = aTexCoords;
 }
\ No newline at end of file
@@ -0,0 +1,17 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 3) in mat4 aModel; // per draw, see IndirectDrawList
+
+out vec3 FragPos;
+out vec3 Normal;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    FragPos = vec3(aModel * vec4(aPos, 1.0f));
+    Normal = mat3(transpose(inverse(aModel))) * aNormal;
+    gl_Position = projection * view * aModel * vec4(aPos, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 QuadPos;
+flat in vec3 Center;
+flat in float Radius;
+flat in vec2 FrameCell;
+flat in vec3 FrameAxis;
+flat in vec3 FrameRight;
+flat in vec3 FrameUp;
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform vec3 cameraPosition;
+uniform float impostorGridSize;
+uniform sampler2D impostorAlbedo;
+uniform sampler2D impostorNormalDepth;
+
+void main()
+{
+    // Where the view ray through this fragment crosses the plane of the frame, in the frame's [0, 1] square
+    vec3 ray = QuadPos - cameraPosition;
+    vec3 hit = cameraPosition + ray * (dot(Center - cameraPosition, FrameAxis) / dot(ray, FrameAxis)) - Center;
+    vec2 frameCoords = vec2(dot(hit, FrameRight), dot(hit, FrameUp)) / Radius * 0.5f + 0.5f;
+    vec2 clamped = clamp(frameCoords, 0.0f, 1.0f);
+
+    // The color is filtered, sampled ahead of the discard where the derivatives for the mip level are defined.
+    // Coverage and depth come from the full-resolution frame, point-sampled like a mesh is rasterized: their
+    // mipmaps average the rock with the empty space around it, which would erase distant rocks
+    vec2 uv = (FrameCell + clamped) / impostorGridSize;
+    vec3 albedo = texture(impostorAlbedo, uv).rgb;
+    float coverage = textureLod(impostorAlbedo, uv, 0.0f).a;
+    float depth = textureLod(impostorNormalDepth, uv, 0.0f).a * 2.0f - 1.0f;
+    if (coverage < 0.5f || frameCoords != clamped)
+        discard;
+
+    // The baked surface lies off the plane towards the frame's viewer; that point's depth is the fragment's
+    vec4 clip = projection * view * vec4(Center + hit + FrameAxis * (depth * Radius), 1.0f);
+    gl_FragDepth = clip.z / clip.w * 0.5f + 0.5f;
+    FragColor = vec4(albedo, 1.0f);
+}
@@ -0,0 +1,107 @@
+#version 330 core
+// An instance drawn as its impostor: a quad facing the camera, around the bounding sphere, that the
+// fragment shader maps onto the atlas frame baked from the direction closest to the camera's in model
+// space. No vertex buffer, the corner comes from gl_VertexID (a 4-vertex triangle strip).
+// The instance attributes are those of any InstanceFormat, instanceFormat says which
+layout (location = 3) in vec4 aInstance0;
+layout (location = 4) in vec4 aInstance1;
+layout (location = 5) in vec4 aInstance2;
+layout (location = 6) in vec4 aInstance3;
+
+out vec3 QuadPos;
+flat out vec3 Center;       // world, of the bounding sphere
+flat out float Radius;
+flat out vec2 FrameCell;    // column and row of the frame in the atlas
+flat out vec3 FrameAxis;    // world axes of the frame: towards its viewer, its right and up
+flat out vec3 FrameRight;
+flat out vec3 FrameUp;
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform vec3 cameraPosition;
+uniform int instanceFormat;      // InstanceFormat in enum order
+uniform vec4 instanceOffset;     // Quantized instances only
+uniform vec4 instanceExtent;
+uniform vec4 impostorBounds;     // model space, xyz center, w radius
+uniform float impostorGridSize;  // frames per side
+
+vec3 Rotate(vec4 q, vec3 v)
+{
+    return v + 2.0f * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+void DecodeInstance(out vec3 translation, out mat3 rotation, out float scale)
+{
+    if (instanceFormat == 0 || instanceFormat == 1) {
+        // Columns of a mat4, or rows of the affine part with the translation in w
+        mat3 linear = mat3(aInstance0.xyz, aInstance1.xyz, aInstance2.xyz);
+        translation = aInstance3.xyz;
+        if (instanceFormat == 1) {
+            linear = transpose(linear);
+            translation = vec3(aInstance0.w, aInstance1.w, aInstance2.w);
+        }
+        scale = length(linear[0]);
+        rotation = linear / scale;
+        return;
+    }
+    vec4 positionScale = aInstance0;
+    vec4 q = aInstance1;
+    if (instanceFormat == 3) {
+        positionScale = instanceOffset + instanceExtent * aInstance0;
+        q = normalize(q);
+    }
+    translation = positionScale.xyz;
+    scale = positionScale.w;
+    rotation = mat3(Rotate(q, vec3(1.0f, 0.0f, 0.0f)), Rotate(q, vec3(0.0f, 1.0f, 0.0f)), Rotate(q, vec3(0.0f, 0.0f, 1.0f)));
+}
+
+// Octahedral map of the unit sphere onto [-1, 1]^2, +y at the center and -y at the corners,
+// as ImpostorAtlas bakes it
+vec2 OctEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.xz;
+    if (n.y < 0.0f)
+        e = (1.0f - abs(e.yx)) * vec2(e.x >= 0.0f ? 1.0f : -1.0f, e.y >= 0.0f ? 1.0f : -1.0f);
+    return e;
+}
+
+vec3 OctDecode(vec2 e)
+{
+    vec3 n = vec3(e.x, 1.0f - abs(e.x) - abs(e.y), e.y);
+    if (n.y < 0.0f)
+        n.xz = (1.0f - abs(n.zx)) * vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.z >= 0.0f ? 1.0f : -1.0f);
+    return normalize(n);
+}
+
+void main()
+{
+    vec3 translation;
+    mat3 rotation;
+    float scale;
+    DecodeInstance(translation, rotation, scale);
+    Center = translation + scale * (rotation * impostorBounds.xyz);
+    Radius = scale * impostorBounds.w;
+
+    // The frame baked closest to where the camera is, seen from the instance
+    vec3 toCamera = cameraPosition - Center;
+    float distance = length(toCamera);
+    vec3 direction = toCamera / distance;
+    float last = impostorGridSize - 1.0f;
+    FrameCell = clamp(floor((OctEncode(transpose(rotation) * direction) * 0.5f + 0.5f) * last + 0.5f), 0.0f, last);
+    vec3 axis = OctDecode(FrameCell / last * 2.0f - 1.0f);
+    // The basis glm::lookAt gives the frame's camera
+    vec3 right = normalize(cross(-axis, abs(axis.y) > 0.999f ? vec3(0.0f, 0.0f, 1.0f) : vec3(0.0f, 1.0f, 0.0f)));
+    FrameAxis = rotation * axis;
+    FrameRight = rotation * right;
+    FrameUp = rotation * cross(right, -axis);
+
+    // Perpendicular to the direction of the camera and just big enough for the sphere's silhouette
+    vec3 cameraUp = vec3(view[0][1], view[1][1], view[2][1]);
+    vec3 quadRight = normalize(cross(cameraUp, direction));
+    vec3 quadUp = cross(direction, quadRight);
+    float extent = Radius * distance / sqrt(max(distance * distance - Radius * Radius, 1e-6f));
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0f - 1.0f;
+    QuadPos = Center + extent * (corner.x * quadRight + corner.y * quadUp);
+    gl_Position = projection * view * vec4(QuadPos, 1.0f);
+}
@@ -0,0 +1,15 @@
+#version 330 core
+layout (location = 0) out vec4 Albedo;       // alpha is coverage
+layout (location = 1) out vec4 NormalDepth;  // model-space normal and depth, both remapped to [0, 1]
+
+in vec2 TexCoords;
+in vec3 Normal;
+in float Depth;
+
+uniform sampler2D texture_diffuse1;
+
+void main()
+{
+    Albedo = vec4(texture(texture_diffuse1, TexCoords).rgb, 1.0f);
+    NormalDepth = vec4(normalize(Normal) * 0.5f + 0.5f, Depth * 0.5f + 0.5f);
+}
@@ -0,0 +1,22 @@
+#version 330 core
+// One frame of an impostor atlas: the model seen orthographically along -frameAxis
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+
+out vec2 TexCoords;
+out vec3 Normal;
+out float Depth;
+
+uniform mat4 viewProjection;
+uniform vec4 bounds;     // xyz center, w radius of the model's bounding sphere
+uniform vec3 frameAxis;  // unit, from the center towards the frame's viewer
+
+void main()
+{
+    TexCoords = aTexCoords;
+    Normal = aNormal;
+    // Towards the viewer, in radii: -1 at the back of the bounding sphere, 1 at the front
+    Depth = dot(aPos - bounds.xyz, frameAxis) / bounds.w;
+    gl_Position = viewProjection * vec4(aPos, 1.0f);
+}
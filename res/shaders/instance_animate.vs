@@ -0,0 +1,22 @@
+#version 330 core
+// Transform feedback pass: one point per rock, nothing rasterized.
+// rotation(time) = rotation(0) * spin(axis, speed * time), as InstanceTransforms integrates it.
+layout (location = 0) in vec4 aPositionScale;
+layout (location = 1) in vec4 aRotation;    // unit quaternion at time 0
+layout (location = 2) in vec4 aAxisSpeed;   // unit spin axis, radians per second
+
+// Captured interleaved: the PositionScaleRotation instance format of instancing_rock_quat.vs
+out vec4 outPositionScale;
+out vec4 outRotation;
+
+uniform float time;
+
+void main()
+{
+    float halfAngle = 0.5f * aAxisSpeed.w * time;
+    vec4 spin = vec4(aAxisSpeed.xyz * sin(halfAngle), cos(halfAngle));
+    vec4 q = aRotation;
+    vec4 rotation = vec4(q.w * spin.xyz + spin.w * q.xyz + cross(q.xyz, spin.xyz), q.w * spin.w - dot(q.xyz, spin.xyz));
+    outPositionScale = aPositionScale;
+    outRotation = normalize(rotation);
+}
@@ -0,0 +1,20 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 2) in vec2 aTexCoords;
+// Rows of the affine part: xyz of the row, then the translation
+layout (location = 3) in vec4 aInstanceRow0;
+layout (location = 4) in vec4 aInstanceRow1;
+layout (location = 5) in vec4 aInstanceRow2;
+
+out vec2 TexCoords;
+
+uniform mat4 projection;
+uniform mat4 view;
+
+void main()
+{
+    TexCoords = aTexCoords;
+    vec4 position = vec4(aPos, 1.0f);
+    vec3 worldPos = vec3(dot(aInstanceRow0, position), dot(aInstanceRow1, position), dot(aInstanceRow2, position));
+    gl_Position = projection * view * vec4(worldPos, 1.0f);
+}
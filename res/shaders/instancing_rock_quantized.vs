@@ -0,0 +1,27 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in vec4 aInstancePositionScale; // unorm16: xyz position, w scale, within the range below
+layout (location = 4) in vec4 aInstanceRotation;      // snorm16 quaternion
+
+out vec2 TexCoords;
+
+uniform mat4 projection;
+uniform mat4 view;
+// Decoded value = instanceOffset + instanceExtent * unorm
+uniform vec4 instanceOffset;
+uniform vec4 instanceExtent;
+
+vec3 Rotate(vec4 q, vec3 v)
+{
+    return v + 2.0f * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+void main()
+{
+    TexCoords = aTexCoords;
+    vec4 positionScale = instanceOffset + instanceExtent * aInstancePositionScale;
+    // Renormalize what the 16-bit rounding took off
+    vec3 worldPos = positionScale.xyz + positionScale.w * Rotate(normalize(aInstanceRotation), aPos);
+    gl_Position = projection * view * vec4(worldPos, 1.0f);
+}
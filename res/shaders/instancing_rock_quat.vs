@@ -0,0 +1,22 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in vec4 aInstancePositionScale; // xyz position, w uniform scale
+layout (location = 4) in vec4 aInstanceRotation;      // unit quaternion, xyz vector part
+
+out vec2 TexCoords;
+
+uniform mat4 projection;
+uniform mat4 view;
+
+vec3 Rotate(vec4 q, vec3 v)
+{
+    return v + 2.0f * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+void main()
+{
+    TexCoords = aTexCoords;
+    vec3 worldPos = aInstancePositionScale.xyz + aInstancePositionScale.w * Rotate(aInstanceRotation, aPos);
+    gl_Position = projection * view * vec4(worldPos, 1.0f);
+}
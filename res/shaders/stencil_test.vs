@@ -4,12 +4,23 @@ layout (location = 1) in vec2 aTexCoords;
 
 out vec2 TexCoords;
 
-uniform mat4 model;
+// Per-object data, written once per frame by ObjectBuffer and indexed by instance
+struct ObjectData
+{
+    mat4 model;
+    vec4 params;
+};
+
+layout (std140) uniform Objects
+{
+    ObjectData objects[200];
+};
+
 uniform mat4 view;
 uniform mat4 projection;
 
 void main()
 {
     TexCoords = aTexCoords;    
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = projection * view * objects[gl_InstanceID].model * vec4(aPos, 1.0);
 }
@@ -4,6 +4,7 @@
 
 #include "camera.h"
 #include "model.h"
+#include "render_queue.h"
 #include "shader.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -110,7 +111,7 @@ int main()
     unsigned int cubeVAO, cubeVBO;
     glGenVertexArrays(1, &cubeVAO);
     glGenBuffers(1, &cubeVBO);
-    glBindVertexArray(cubeVAO);
+    GLState::Get().BindVertexArray(cubeVAO);
     glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), &cubeVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
@@ -139,6 +140,16 @@ int main()
     glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(projection));
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
+    // Draws are recorded per frame and issued sorted by program, with redundant binds skipped
+    RenderQueue renderQueue;
+    Shader::Uniform redModel = shaderRed.GetUniform("model");
+    Shader::Uniform greenModel = shaderGreen.GetUniform("model");
+    Shader::Uniform yellowModel = shaderYellow.GetUniform("model");
+    Shader::Uniform blueModel = shaderBlue.GetUniform("model");
+
+    int counter = 0;
+    const int maxPrints = 50;
+
     // render loop
     while (!glfwWindowShouldClose(window)) {
         // per-frame time logic
@@ -159,35 +170,33 @@ int main()
         glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), sizeof(glm::mat4), glm::value_ptr(view));
         glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
-        // draw 4 cubes 
+        // draw 4 cubes through the render queue, which groups them by program and binds the VAO once
+        renderQueue.SetViewMatrix(view);
         // RED
-        glBindVertexArray(cubeVAO);
-        shaderRed.Bind();
         glm::mat4 model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(-0.75f, 0.75f, 0.0f)); // move top-left
-        shaderRed.SetMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        renderQueue.SubmitArrays(0, shaderRed, redModel, model, cubeVAO, {}, GL_TRIANGLES, 0, 36);
 
         // GREEN
-        shaderGreen.Bind();
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(0.75f, 0.75f, 0.0f)); // move top-right
-        shaderGreen.SetMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        renderQueue.SubmitArrays(0, shaderGreen, greenModel, model, cubeVAO, {}, GL_TRIANGLES, 0, 36);
 
         // YELLOW
-        shaderYellow.Bind();
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(-0.75f, -0.75f, 0.0f)); // move bottom-left
-        shaderYellow.SetMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        renderQueue.SubmitArrays(0, shaderYellow, yellowModel, model, cubeVAO, {}, GL_TRIANGLES, 0, 36);
 
         // BLUE
-        shaderBlue.Bind();
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(0.75f, -0.75f, 0.0f)); // move bottom-right
-        shaderBlue.SetMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        renderQueue.SubmitArrays(0, shaderBlue, blueModel, model, cubeVAO, {}, GL_TRIANGLES, 0, 36);
+
+        renderQueue.Execute();
+        if (counter < maxPrints) {
+            std::cout << "render queue: " << renderQueue.GetStats() << "\n";
+            counter++;
+        }
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         glfwSwapBuffers(window);
@@ -195,7 +204,7 @@ int main()
     }
 
     // optional: de-allocate all resources once they've outlived their purpose:
-    glDeleteVertexArrays(1, &cubeVAO);
+    GLState::Get().DeleteVertexArrays(1, &cubeVAO);
     glDeleteBuffers(1, &cubeVBO);
     glDeleteBuffers(1, &uboMatrices);
 
@@ -275,7 +284,7 @@ unsigned int LoadTexture(const std::string& path)
 		else if (nrComponents == 4)
 			format = GL_RGBA;
 
-		glBindTexture(GL_TEXTURE_2D, textureID);
+		GLState::Get().BindTexture(GL_TEXTURE_2D, textureID);
 		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
 		glGenerateMipmap(GL_TEXTURE_2D);
 
@@ -307,7 +316,7 @@ unsigned int LoadCubemap(const std::vector<std::string>& faces)
 {
 	unsigned int textureID;
 	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, textureID); // Notice we bind to texture_cube_map instead of texture_2D
+	GLState::Get().BindTexture(GL_TEXTURE_CUBE_MAP, textureID); // Notice we bind to texture_cube_map instead of texture_2D
 
 	int width, height, nrChannels;
 	for (unsigned int i = 0; i < 6; i++) {
@@ -0,0 +1,81 @@
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include "impostor_atlas.h"
+#include "model.h"
+
+// Offline impostor baker: writes the .<key>.impostor atlas next to each model given on the command line (the rock by
+// default), as ImpostorAtlas::LoadOrBake would at load. Build this file instead of a demo; it only opens a
+// hidden window to get a GL context and renders offscreen, so it runs on build machines with software GL.
+// The atlas is only picked up when the model options match the ones the demo loads it with; the instancing
+// demo's rock needs --optimize --lods 4.
+// usage: bake_impostors [--grid frames per side] [--resolution pixels per frame] [--optimize] [--lods levels]
+//                       [--packed] [model ...]
+int main(int argc, char** argv)
+{
+	ImpostorSettings settings;
+	ModelOptions options;
+	std::vector<std::string> models;
+	for (int i = 1; i < argc; i++) {
+		std::string argument = argv[i];
+		if (argument == "--grid" && i + 1 < argc)
+			settings.gridSize = static_cast<unsigned int>(std::atoi(argv[++i]));
+		else if (argument == "--resolution" && i + 1 < argc)
+			settings.frameResolution = static_cast<unsigned int>(std::atoi(argv[++i]));
+		else if (argument == "--optimize")
+			options.optimizeVertexCache = true;
+		else if (argument == "--lods" && i + 1 < argc)
+			options.lodLevels = static_cast<unsigned int>(std::atoi(argv[++i]));
+		else if (argument == "--packed")
+			options.vertexFormat = VertexFormat::Packed;
+		else
+			models.push_back(argument);
+	}
+	if (models.empty())
+		models.push_back("res/models/rock/rock.obj");
+	if (settings.gridSize < 2 || settings.frameResolution == 0) {
+		std::cerr << "the grid needs at least 2 frames per side and the frames at least a pixel\n";
+		return -1;
+	}
+
+	GLFWwindow* window = nullptr;
+	try {
+		if (!glfwInit())
+			throw std::runtime_error("failed to init glfw");
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		window = glfwCreateWindow(64, 64, "bake impostors", nullptr, nullptr);
+		if (!window)
+			throw std::runtime_error("failed to create window");
+
+		glfwMakeContextCurrent(window);
+		if (glewInit() != GLEW_OK)
+			throw std::runtime_error("failed to init glew");
+	}
+	catch (const std::runtime_error& e) {
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+	std::cout << "GL " << glGetString(GL_VERSION) << " on " << glGetString(GL_RENDERER) << "\n";
+
+	int failures = 0;
+	for (const std::string& path : models) {
+		Model model(path, options);
+		ImpostorAtlas atlas;
+		const uint64_t cacheKey = ImpostorAtlas::GetCacheKey(path, model.GetOptions());
+		const std::string cachePath = ImpostorAtlas::GetCachePath(path, cacheKey);
+		if (!atlas.Bake(model, settings) || !atlas.Save(cachePath, cacheKey)) {
+			std::cerr << path << ": failed to bake or write " << cachePath << "\n";
+			failures++;
+			continue;
+		}
+		std::cout << path << " -> " << cachePath << ": " << settings.gridSize << "^2 frames of " << settings.frameResolution
+			<< " px (" << atlas.GetSize() << " px atlas), " << 100.0f * atlas.GetCoverage() << "% covered, " << atlas.GetBakeMs() << " ms\n";
+	}
+
+	glfwTerminate();
+	return failures == 0 ? 0 : -1;
+}
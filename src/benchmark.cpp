@@ -0,0 +1,1082 @@
+#include <chrono>
+#include <functional>
+#include <random>
+#include <filesystem>
+#include <memory>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include "impostor_atlas.h"
+#include "index_buffer.h"
+#include "indirect_draw.h"
+#include "instance_animation.h"
+#include "instance_buffer.h"
+#include "instance_scatter.h"
+#include "instance_transforms.h"
+#include "lod_selector.h"
+#include "object_buffer.h"
+#include "model.h"
+#include "occlusion_buffer.h"
+
+// Headless benchmarks for the loading and per-frame systems used by the demos.
+// Build this file instead of a demo; it only opens a hidden window to get a GL context.
+
+void BenchmarkModelLoad(const std::vector<std::string>& modelPaths);
+void BenchmarkVertexFormats(const std::vector<std::string>& modelPaths);
+void BenchmarkVertexCache(const std::vector<std::string>& modelPaths);
+void BenchmarkIndexClusters(const std::vector<int>& gridSizes);
+void BenchmarkInstanceUpdate(const std::vector<size_t>& instanceCounts);
+void BenchmarkFrustumCulling(const std::vector<size_t>& instanceCounts);
+void BenchmarkStateCache();
+void BenchmarkGeometryPool(const std::vector<std::string>& modelPaths);
+void BenchmarkIndirectDraw(int gridSize);
+void BenchmarkObjectBuffer(const std::vector<size_t>& objectCounts);
+void BenchmarkStreamBuffer(const std::vector<size_t>& instanceCounts);
+void BenchmarkGpuAnimation(const std::vector<size_t>& instanceCounts);
+void BenchmarkScatter(const std::vector<size_t>& instanceCounts);
+void BenchmarkSeparatedScatter(const std::vector<size_t>& instanceCounts);
+void BenchmarkLod(const std::vector<size_t>& instanceCounts);
+void BenchmarkImpostors(const std::vector<float>& impostorDistances);
+void BenchmarkMeshlets(const std::vector<std::string>& modelPaths);
+void BenchmarkOcclusion(const std::vector<size_t>& instanceCounts);
+
+int main()
+{
+	GLFWwindow* window = nullptr;
+	try {
+		if (!glfwInit())
+			throw std::runtime_error("failed to init glfw");
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		window = glfwCreateWindow(64, 64, "benchmark", nullptr, nullptr);
+		if (!window)
+			throw std::runtime_error("failed to create window");
+
+		glfwMakeContextCurrent(window);
+		if (glewInit() != GLEW_OK)
+			throw std::runtime_error("failed to init glew");
+	}
+	catch (const std::runtime_error& e) {
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+
+	const std::vector<std::string> models = { "res/models/rock/rock.obj", "res/models/planet/planet.obj", "res/models/nanosuit.obj" };
+	BenchmarkModelLoad(models);
+	BenchmarkVertexFormats(models);
+	BenchmarkVertexCache(models);
+	BenchmarkIndexClusters({ 200, 300, 600 });
+	BenchmarkInstanceUpdate({ 5000, 100000, 1000000 });
+	BenchmarkFrustumCulling({ 5000, 100000, 1000000 });
+	BenchmarkStateCache();
+	BenchmarkGeometryPool(models);
+	BenchmarkIndirectDraw(8);
+	BenchmarkObjectBuffer({ 10, 1000, 10000, 50000 });
+	BenchmarkStreamBuffer({ 5000, 100000 });
+	BenchmarkGpuAnimation({ 5000, 100000, 1000000 });
+	BenchmarkScatter({ 5000, 1000000, 10000000 });
+	BenchmarkSeparatedScatter({ 5000, 100000, 1000000 });
+	BenchmarkLod({ 5000, 100000, 1000000 });
+	BenchmarkImpostors({ 40.0f, 60.0f, 90.0f });
+	BenchmarkMeshlets({ "res/models/nanosuit.obj", "res/models/rock/rock.obj" });
+	BenchmarkOcclusion({ 5000, 100000, 1000000 });
+
+	glfwTerminate();
+}
+
+// Cold: the mesh cache is deleted first so Assimp runs and writes it. Warm: the same model loads from the cache.
+void BenchmarkModelLoad(const std::vector<std::string>& modelPaths)
+{
+	using Clock = std::chrono::high_resolution_clock;
+	std::cout << "model load (cold = Assimp + cache write, warm = mesh cache)\n";
+
+	for (const std::string& path : modelPaths) {
+		std::error_code ec;
+		std::filesystem::remove(MeshCache::GetCachePath(path, ModelOptions().GetProcessFlags()), ec);
+
+		// The cold model is released before the warm load so its textures aren't served from the TextureCache
+		size_t meshCount = 0;
+		double coldMs = 0.0;
+		auto start = Clock::now();
+		{
+			Model cold(path);
+			coldMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+			meshCount = cold.meshes.size();
+		}
+
+		start = Clock::now();
+		Model warm(path);
+		double warmMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+		std::cout << "  " << path << ": " << meshCount << " meshes, cold " << coldMs << " ms, warm " << warmMs
+			<< " ms" << (warm.loadedFromCache ? "" : " (cache miss!)") << "\n";
+	}
+
+	const TextureCache& textures = TextureCache::Get();
+	std::cout << "texture cache: " << textures.GetHitCount() << " hits, " << textures.GetMissCount() << " misses, "
+		<< textures.GetResidentCount() << " resident\n";
+}
+
+// GPU vertex memory of the fp32 and packed layouts, and how far the packed attributes drift from the source
+void BenchmarkVertexFormats(const std::vector<std::string>& modelPaths)
+{
+	std::cout << "vertex formats (Float32 vs Packed)\n";
+
+	for (const std::string& path : modelPaths) {
+		Model packed(path, VertexFormat::Packed);
+		size_t packedBytes = packed.GetVertexBufferSize();
+		size_t floatBytes = 0;
+		for (const Mesh& mesh : packed.meshes)
+			floatBytes += mesh.vertices.size() * sizeof(Vertex);
+
+		VertexQuantizationError error = packed.GetQuantizationError();
+		std::cout << "  " << path << ": " << floatBytes / 1024 << " KiB -> " << packedBytes / 1024 << " KiB ("
+			<< (packedBytes ? (double)floatBytes / packedBytes : 0.0) << "x), position max " << error.maxPositionError
+			<< " mean " << error.meanPositionError << ", normal max " << error.maxNormalError << " deg, tangent max "
+			<< error.maxTangentError << " deg, uv max " << error.maxTexCoordError << ", handedness flips "
+			<< error.handednessFlips << "\n";
+	}
+}
+
+// ACMR/ATVR of every model in file order vs. after the import-time optimizer (FIFO cache of 16)
+void BenchmarkVertexCache(const std::vector<std::string>& modelPaths)
+{
+	std::cout << "vertex cache (file order -> optimized with overdraw pass)\n";
+
+	// Triangle-weighted ACMR and reference-weighted ATVR over all meshes
+	auto modelStats = [](const Model& _model) {
+		double misses = 0.0, triangles = 0.0, referenced = 0.0;
+		for (const Mesh& mesh : _model.meshes) {
+			VertexCacheStats stats = ComputeVertexCacheStats(mesh.indices, mesh.vertices.size());
+			double meshTriangles = mesh.indices.size() / 3.0;
+			misses += stats.acmr * meshTriangles;
+			triangles += meshTriangles;
+			referenced += stats.atvr > 0.0f ? stats.acmr * meshTriangles / stats.atvr : 0.0;
+		}
+		VertexCacheStats total;
+		total.acmr = triangles > 0.0 ? static_cast<float>(misses / triangles) : 0.0f;
+		total.atvr = referenced > 0.0 ? static_cast<float>(misses / referenced) : 0.0f;
+		return total;
+	};
+
+	ModelOptions optimized;
+	optimized.optimizeVertexCache = true;
+	optimized.optimizeOverdraw = true;
+
+	for (const std::string& path : modelPaths) {
+		Model source(path);
+		Model reordered(path, optimized);
+		VertexCacheStats before = modelStats(source);
+		VertexCacheStats after = modelStats(reordered);
+		std::cout << "  " << path << ": ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr
+			<< " -> " << after.atvr << "\n";
+	}
+}
+
+// 16-bit index clusters for grids over 65535 vertices, in row order and with the triangles shuffled so
+// every cluster touches vertices from all over the mesh. The source triangle positions are taken
+// before the split and compared with what the clusters draw over the rewritten vertices.
+void BenchmarkIndexClusters(const std::vector<int>& gridSizes)
+{
+	std::cout << "16-bit index clusters\n";
+
+	using Clock = std::chrono::high_resolution_clock;
+	std::mt19937 random(5);
+	for (int size : gridSizes) {
+		std::vector<Vertex> gridVertices(static_cast<size_t>(size) * size);
+		for (int y = 0; y < size; y++)
+			for (int x = 0; x < size; x++)
+				gridVertices[static_cast<size_t>(y) * size + x].position = glm::vec3(x, y, 0.0f);
+
+		std::vector<unsigned int> gridIndices;
+		for (int y = 0; y + 1 < size; y++)
+			for (int x = 0; x + 1 < size; x++) {
+				unsigned int corner = y * size + x;
+				gridIndices.insert(gridIndices.end(), { corner, corner + 1, corner + size, corner + 1, corner + size + 1, corner + size });
+			}
+
+		std::vector<unsigned int> shuffledIndices = gridIndices;
+		std::vector<size_t> order(shuffledIndices.size() / 3);
+		for (size_t t = 0; t < order.size(); t++)
+			order[t] = t;
+		std::shuffle(order.begin(), order.end(), random);
+		for (size_t t = 0; t < order.size(); t++)
+			for (size_t k = 0; k < 3; k++)
+				shuffledIndices[t * 3 + k] = gridIndices[order[t] * 3 + k];
+
+		std::cout << "  " << size << "x" << size << " grid (" << gridVertices.size() << " vertices)";
+		for (const std::vector<unsigned int>* source : { &gridIndices, &shuffledIndices }) {
+			std::vector<Vertex> vertices = gridVertices;
+			std::vector<unsigned int> indices = *source;
+			std::vector<glm::vec3> sourceTriangles = GatherTrianglePositions(vertices, indices);
+
+			auto start = Clock::now();
+			std::vector<IndexCluster> clusters = SplitIndexClusters(vertices, indices);
+			std::vector<uint16_t> shortIndices = BuildShortIndices(indices, clusters);
+			double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+			bool valid = VerifyShortIndices(sourceTriangles, vertices, shortIndices, clusters);
+			std::cout << (source == &gridIndices ? ", row order " : ", shuffled ") << clusters.size() << " clusters, "
+				<< vertices.size() - gridVertices.size() << " duplicated vertices, " << ms << " ms"
+				<< (valid ? "" : " MISMATCH");
+		}
+		std::cout << "\n";
+	}
+}
+
+// Per-frame rock spin: the original AoS glm::rotate loop vs. the SoA kernel of InstanceTransforms,
+// on the calling thread (mat4 and mat3x4 output) and on 2..N threads. Pure CPU, the results go to a
+// plain array standing in for the mapped instance buffer.
+void BenchmarkInstanceUpdate(const std::vector<size_t>& instanceCounts)
+{
+	using Clock = std::chrono::high_resolution_clock;
+	const int frames = 20;
+	const float deltaTime = 1.0f / 60.0f;
+	std::cout << "instance update, ms per frame (average of " << frames << " frames), "
+		<< InstanceTransforms::GetKernelName() << " kernel\n";
+
+	std::mt19937 gen(1234);
+	std::uniform_real_distribution<float> dis(0.0f, 1.0f);
+
+	for (size_t count : instanceCounts) {
+		std::vector<glm::mat4> matrices(count);
+		std::vector<glm::vec3> axes(count);
+		std::vector<float> speeds(count);
+		InstanceTransforms transforms;
+		transforms.Reserve(count);
+		for (size_t i = 0; i < count; i++) {
+			glm::vec3 position = glm::vec3(dis(gen), dis(gen), dis(gen)) * 100.0f;
+			glm::quat rotation = glm::angleAxis(6.2831853f * dis(gen), glm::normalize(glm::vec3(dis(gen), dis(gen), dis(gen)) + 0.01f));
+			float scale = 0.05f + 0.15f * dis(gen);
+			axes[i] = glm::vec3(dis(gen), dis(gen), dis(gen)) + 0.01f;
+			speeds[i] = 4.0f + 4.0f * dis(gen);
+			transforms.Add(position, rotation, scale, axes[i], speeds[i]);
+			matrices[i] = transforms.GetMatrix(i);
+		}
+		std::vector<glm::mat4> destination(count);
+
+		// The loop instancing.cpp used to run on the render thread
+		auto start = Clock::now();
+		for (int frame = 0; frame < frames; frame++) {
+			for (size_t i = 0; i < count; i++)
+				matrices[i] = glm::rotate(matrices[i], speeds[i] * deltaTime, axes[i]);
+			std::copy(matrices.begin(), matrices.end(), destination.begin());
+		}
+		double rotateMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+		std::cout << "  " << count << " instances: glm::rotate " << rotateMs << " ms";
+
+		start = Clock::now();
+		for (int frame = 0; frame < frames; frame++)
+			transforms.UpdateRange(deltaTime, destination.data(), InstanceTransforms::OutputLayout::Mat4, 0, count);
+		double kernelMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+		std::cout << ", SoA mat4 " << kernelMs << " ms (" << rotateMs / kernelMs << "x)";
+
+		// The compact encodings, each checked against GetMatrix after its timed frames
+		for (InstanceFormat format : { InstanceFormat::Mat3x4, InstanceFormat::PositionScaleRotation, InstanceFormat::Quantized }) {
+			start = Clock::now();
+			for (int frame = 0; frame < frames; frame++)
+				transforms.UpdateRange(deltaTime, destination.data(), format, 0, count);
+			double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+			InstanceTransforms::EncodingError error = transforms.MeasureEncodingError(destination.data(), format);
+			std::cout << ", " << GetInstanceFormatName(format) << " (" << GetInstanceStride(format) << " B) " << ms
+				<< " ms, max error " << error.position << "/" << error.linear
+				<< (transforms.VerifyEncoding(destination.data(), format) ? "" : " MISMATCH");
+		}
+
+		const unsigned int maxWorkers = ThreadPool::GetDefaultWorkerCount();
+		for (unsigned int workers = 1; workers <= maxWorkers; workers *= 2) {
+			ThreadPool pool(workers);
+			start = Clock::now();
+			for (int frame = 0; frame < frames; frame++)
+				transforms.Update(deltaTime, destination.data(), InstanceTransforms::OutputLayout::Mat4, pool);
+			double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+			std::cout << ", " << workers + 1 << " threads " << ms << " ms";
+		}
+		std::cout << "\n";
+	}
+}
+
+// Update + frustum cull + compaction of an asteroid ring seen from the instancing demo's camera.
+// Every result is checked against the brute-force per-instance plane test before it is timed.
+void BenchmarkFrustumCulling(const std::vector<size_t>& instanceCounts)
+{
+	using Clock = std::chrono::high_resolution_clock;
+	const int frames = 20;
+	const float deltaTime = 1.0f / 60.0f;
+	std::cout << "frustum culling (update + cull + compact), million instances per second\n";
+
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 1000.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 10.0f, 75.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	Frustum frustum = Frustum::FromMatrix(projection * view);
+	BoundingSphere rockBounds{ glm::vec3(0.0f), 1.0f };
+
+	std::mt19937 gen(1234);
+	std::uniform_real_distribution<float> dis(0.0f, 1.0f);
+
+	for (size_t count : instanceCounts) {
+		InstanceTransforms transforms;
+		transforms.Reserve(count);
+		for (size_t i = 0; i < count; i++) {
+			float angle = 6.2831853f * i / count;
+			glm::vec3 position(std::sin(angle) * 50.0f + 10.0f * dis(gen) - 5.0f, 6.0f * dis(gen) - 3.0f,
+				std::cos(angle) * 50.0f + 10.0f * dis(gen) - 5.0f);
+			glm::quat rotation = glm::angleAxis(6.2831853f * dis(gen), glm::normalize(glm::vec3(dis(gen), dis(gen), dis(gen)) + 0.01f));
+			transforms.Add(position, rotation, 0.05f + 0.15f * dis(gen), glm::vec3(dis(gen), dis(gen), dis(gen)) + 0.01f, 4.0f + 4.0f * dis(gen));
+		}
+		std::vector<glm::mat4> destination(count);
+
+		size_t visible = transforms.UpdateVisible(deltaTime, frustum, rockBounds, destination.data());
+		bool valid = transforms.VerifyVisible(frustum, rockBounds, destination.data(), InstanceTransforms::OutputLayout::Mat4, visible);
+		std::cout << "  " << count << " instances: " << visible << " visible, " << (valid ? "matches" : "DIFFERS FROM")
+			<< " brute force";
+
+		auto start = Clock::now();
+		for (int frame = 0; frame < frames; frame++)
+			transforms.UpdateRangeVisible(deltaTime, frustum, rockBounds, destination.data(), InstanceTransforms::OutputLayout::Mat4, 0, count);
+		double seconds = std::chrono::duration<double>(Clock::now() - start).count() / frames;
+		std::cout << ", 1 thread " << count / seconds / 1e6;
+
+		const unsigned int maxWorkers = ThreadPool::GetDefaultWorkerCount();
+		for (unsigned int workers = 1; workers <= maxWorkers; workers *= 2) {
+			ThreadPool pool(workers);
+			start = Clock::now();
+			for (int frame = 0; frame < frames; frame++)
+				transforms.UpdateVisible(deltaTime, frustum, rockBounds, destination.data(), InstanceTransforms::OutputLayout::Mat4, pool);
+			seconds = std::chrono::duration<double>(Clock::now() - start).count() / frames;
+			std::cout << ", " << workers + 1 << " threads " << count / seconds / 1e6;
+		}
+		std::cout << "\n";
+	}
+}
+
+// Bind calls per frame of the nanosuit (cube_map.cpp) and asteroid (instancing.cpp) scenes through GLState.
+// "uncached" is what reached the driver before the shadow state: every bind, issued or skipped.
+void BenchmarkStateCache()
+{
+	std::cout << "GL state cache, binds per frame\n";
+
+	Model nanosuit("res/models/nanosuit.obj");
+	Shader cubemapShader("res/shaders/cubemap.vs", "res/shaders/cubemap.fs");
+	Model mars("res/models/planet/planet.obj");
+	Model rock("res/models/rock/rock.obj");
+	Shader marsShader("res/shaders/instancing_mars.vs", "res/shaders/instancing_mars.fs");
+	Shader rockShader("res/shaders/instancing_rock.vs", "res/shaders/instancing_rock.fs");
+
+	auto drawNanosuit = [&] {
+		cubemapShader.Bind();
+		GLState::Get().ActiveTexture(GL_TEXTURE0);
+		nanosuit.Draw(cubemapShader);
+		GLState::Get().EndDraw();
+	};
+	auto drawAsteroids = [&] {
+		marsShader.Bind();
+		mars.Draw(marsShader);
+		rockShader.Bind();
+		GLState::Get().ActiveTexture(GL_TEXTURE0);
+		GLState::Get().BindTexture(GL_TEXTURE_2D, rock.textures_loaded[0].id);
+		rock.meshes[0].DrawInstanced(5000);
+	};
+
+	const std::pair<const char*, std::function<void()>> scenes[] = { { "nanosuit", drawNanosuit }, { "asteroids", drawAsteroids } };
+	for (const auto& [name, drawFrame] : scenes) {
+		std::cout << "  " << name;
+		for (bool unbind : { true, false }) {
+			GLState::Get().SetUnbindAfterDraw(unbind);
+			GLState::Get().Invalidate();
+			drawFrame();
+			GLState::Get().ResetCounters();
+			drawFrame();
+			glFinish();
+
+			const GLState::Counters& counters = GLState::Get().GetCounters();
+			size_t uncached = counters.GetIssued() + counters.GetSkipped();
+			std::cout << (unbind ? ": " : ", ") << (unbind ? "unbind after draw " : "keep bound ") << counters.GetIssued()
+				<< " issued / " << uncached << " uncached";
+		}
+		std::cout << "\n";
+	}
+	GLState::Get().SetUnbindAfterDraw(true);
+}
+
+// Allocator stress: random allocations and frees (sizes from single triangles to large meshes) with the free
+// lists validated as it goes, then the shared geometry pools with the demo models loaded (validating the pool after
+// every allocation), half unloaded and compacted
+void BenchmarkGeometryPool(const std::vector<std::string>& modelPaths)
+{
+	using Clock = std::chrono::high_resolution_clock;
+	std::cout << "geometry pool\n";
+
+	const int operations = 1000000;
+	OffsetAllocator allocator(1 << 24);
+	std::mt19937 generator(7);
+	std::uniform_int_distribution<uint32_t> sizeBits(0, 14);
+	std::vector<uint32_t> live;
+	size_t failures = 0;
+	bool valid = true;
+	float worstFragmentation = 0.0f;
+
+	auto start = Clock::now();
+	for (int i = 0; i < operations; i++) {
+		// Keep the space about 7/8 full so large allocations start failing on fragmentation
+		bool fillUp = allocator.GetUsed() < allocator.GetCapacity() / 8 * 7;
+		if (live.empty() || generator() % 4 < (fillUp ? 3u : 2u)) {
+			uint32_t size = 1 + generator() % (1u << sizeBits(generator));
+			uint32_t offset = allocator.Allocate(size);
+			if (offset == OffsetAllocator::invalid)
+				failures++;
+			else
+				live.push_back(offset);
+		}
+		else {
+			size_t victim = generator() % live.size();
+			allocator.Free(live[victim]);
+			live[victim] = live.back();
+			live.pop_back();
+		}
+		if (i % 50000 == 0) {
+			valid &= allocator.Validate();
+			worstFragmentation = std::max(worstFragmentation, allocator.GetStats().GetFragmentation());
+		}
+	}
+	double stressMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	valid &= allocator.Validate();
+	std::cout << "  allocator: " << operations << " operations in " << stressMs << " ms (" << stressMs * 1e6 / operations
+		<< " ns each), " << failures << " failed, worst fragmentation " << worstFragmentation << ", "
+		<< (valid ? "valid" : "INVALID") << "\n    before compaction: " << allocator.GetStats() << "\n";
+	allocator.Compact(allocator.GetCapacity());
+	std::cout << "    after compaction:  " << allocator.GetStats() << (allocator.Validate() ? "" : " INVALID") << "\n";
+
+	// Every mesh draws from the pool of its format: one VAO, one vertex and one index buffer
+	GeometryPool& pool = GeometryPool::Get(VertexFormat::Float32);
+	pool.SetValidateOnAllocate(true);
+	std::vector<std::unique_ptr<Model>> models;
+	size_t meshCount = 0;
+	for (int copy = 0; copy < 4; copy++)
+		for (const std::string& path : modelPaths) {
+			models.push_back(std::make_unique<Model>(path));
+			meshCount += models.back()->meshes.size();
+		}
+	std::cout << "  " << meshCount << " meshes loaded: " << pool.GetStats() << (pool.Validate() ? "" : " INVALID") << "\n";
+
+	for (size_t i = 0; i < models.size(); i += 2)
+		models[i].reset();
+	std::cout << "  every other model unloaded: " << pool.GetStats() << "\n";
+
+	start = Clock::now();
+	pool.Compact();
+	glFinish();
+	double compactMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	std::cout << "  compacted in " << compactMs << " ms: " << pool.GetStats() << (pool.Validate() ? "" : " INVALID") << "\n";
+	pool.SetValidateOnAllocate(false);
+}
+
+// A gridSize x gridSize field of nanosuits drawn mesh by mesh (one glDrawElements and model upload each) and
+// through IndirectDrawList on every path the context supports, rendered offscreen and compared pixel by pixel
+void BenchmarkIndirectDraw(int gridSize)
+{
+	using Clock = std::chrono::high_resolution_clock;
+	std::cout << "indirect draw, " << gridSize * gridSize << " nanosuits\n";
+
+	const int width = 256, height = 256;
+	unsigned int framebuffer, colorBuffer, depthBuffer;
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glGenRenderbuffers(1, &colorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+	glGenRenderbuffers(1, &depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+	glViewport(0, 0, width, height);
+	glEnable(GL_DEPTH_TEST);
+
+	Model nanosuit("res/models/nanosuit.obj");
+	Shader meshShader("res/shaders/instancing_mars.vs", "res/shaders/instancing_mars.fs");    // model uniform
+	Shader indirectShader("res/shaders/instancing_rock.vs", "res/shaders/instancing_rock.fs"); // per-draw matrix
+
+	std::vector<glm::mat4> transforms;
+	for (int x = 0; x < gridSize; x++)
+		for (int z = 0; z < gridSize; z++)
+			transforms.push_back(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3((x - gridSize / 2) * 10.0f, -8.0f, -z * 10.0f - 5.0f)), glm::vec3(0.5f)));
+	glm::mat4 projection = glm::perspective(glm::radians(60.0f), 1.0f, 0.1f, 500.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 10.0f, 20.0f), glm::vec3(0.0f, 0.0f, -gridSize * 5.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	// Render once to warm up, then time the second submission and read it back
+	auto render = [&](const std::function<void()>& _draw, double& _ms) {
+		std::vector<unsigned char> pixels(width * height * 4);
+		for (int pass = 0; pass < 2; pass++) {
+			glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			glFinish();
+			auto start = Clock::now();
+			_draw();
+			_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		}
+		glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+		return pixels;
+	};
+
+	double meshMs = 0.0;
+	Shader::Uniform model = meshShader.GetUniform("model");
+	std::vector<unsigned char> reference = render([&] {
+		meshShader.Bind();
+		meshShader.SetMat4("projection", projection);
+		meshShader.SetMat4("view", view);
+		for (const glm::mat4& transform : transforms) {
+			meshShader.SetMat4(model, transform);
+			nanosuit.Draw(meshShader);
+		}
+	}, meshMs);
+	std::cout << "  per mesh: " << transforms.size() * nanosuit.meshes.size() << " draw calls, submit " << meshMs << " ms\n";
+
+	IndirectDrawList draws;
+	for (const glm::mat4& transform : transforms)
+		draws.AddModel(nanosuit, transform);
+	const IndirectDrawList::Path best = draws.GetPath();
+	for (IndirectDrawList::Path path : { IndirectDrawList::Path::MultiDrawIndirect, IndirectDrawList::Path::BaseInstance, IndirectDrawList::Path::AttributeOffset }) {
+		if (path < best)
+			continue;
+		draws.SetPath(path);
+		double ms = 0.0;
+		std::vector<unsigned char> pixels = render([&] {
+			indirectShader.Bind();
+			indirectShader.SetMat4("projection", projection);
+			indirectShader.SetMat4("view", view);
+			draws.Execute(indirectShader);
+		}, ms);
+
+		size_t differing = 0;
+		int maxDifference = 0;
+		for (size_t i = 0; i < pixels.size(); i++) {
+			int difference = std::abs(pixels[i] - reference[i]);
+			differing += difference != 0;
+			maxDifference = std::max(maxDifference, difference);
+		}
+		std::cout << "  " << IndirectDrawList::GetPathName(path) << ": " << draws.GetStats() << ", submit " << ms << " ms, "
+			<< differing << " channels differ (max " << maxDifference << ")\n";
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteRenderbuffers(1, &colorBuffer);
+	glDeleteRenderbuffers(1, &depthBuffer);
+	glDeleteFramebuffers(1, &framebuffer);
+}
+
+// Frame time of N quads drawn the old way (a model uniform per glDrawArrays, through the mars shader)
+// against the object buffer with the blending shader (one upload, one instanced draw per 200 quads)
+void BenchmarkObjectBuffer(const std::vector<size_t>& objectCounts)
+{
+	using Clock = std::chrono::high_resolution_clock;
+	std::cout << "per-draw data, ms per frame (CPU submit + glFinish)\n";
+
+	const float quad[] = {
+		-0.5f, -0.5f, -0.5f, 0.0f, 0.0f,  0.5f, -0.5f, -0.5f, 1.0f, 0.0f,  0.5f,  0.5f, -0.5f, 1.0f, 1.0f,
+		 0.5f,  0.5f, -0.5f, 1.0f, 1.0f, -0.5f,  0.5f, -0.5f, 0.0f, 1.0f, -0.5f, -0.5f, -0.5f, 0.0f, 0.0f,
+	};
+	unsigned int VAO, VBO;
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &VBO);
+	GLState::Get().BindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+
+	Shader uniformShader("res/shaders/instancing_mars.vs", "res/shaders/instancing_mars.fs");
+	Shader objectShader("res/shaders/blending.vs", "res/shaders/blending.fs");
+	Shader::Uniform model = uniformShader.GetUniform("model");
+	ObjectBuffer objects;
+	objects.BindShader(objectShader);
+	glm::mat4 viewProjection = glm::perspective(glm::radians(60.0f), 1.0f, 0.1f, 500.0f);
+
+	for (size_t count : objectCounts) {
+		std::vector<glm::mat4> transforms(count);
+		for (size_t i = 0; i < count; i++)
+			transforms[i] = glm::translate(glm::mat4(1.0f), glm::vec3(float(i % 100) - 50.0f, float(i / 100 % 100) - 50.0f, -100.0f - float(i / 10000)));
+
+		const int frames = 20;
+		auto timeFrames = [&](const std::function<void()>& _frame) {
+			_frame();
+			glFinish();
+			auto start = Clock::now();
+			for (int frame = 0; frame < frames; frame++)
+				_frame();
+			glFinish();
+			return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+		};
+
+		double uniformMs = timeFrames([&] {
+			uniformShader.Bind();
+			uniformShader.SetMat4("projection", viewProjection);
+			uniformShader.SetMat4("view", glm::mat4(1.0f));
+			for (const glm::mat4& transform : transforms) {
+				uniformShader.SetMat4(model, transform);
+				glDrawArrays(GL_TRIANGLES, 0, 6);
+			}
+		});
+		double objectMs = timeFrames([&] {
+			objectShader.Bind();
+			objectShader.SetMat4("projection", viewProjection);
+			objectShader.SetMat4("view", glm::mat4(1.0f));
+			objects.Begin();
+			std::vector<ObjectData> data(transforms.size());
+			for (size_t i = 0; i < transforms.size(); i++)
+				data[i].model = transforms[i];
+			ObjectBuffer::Batch batch = objects.Push(data);
+			objects.Upload();
+			objects.DrawArrays(batch, GL_TRIANGLES, 0, 6);
+		});
+		std::cout << "  " << count << " objects: uniform per draw " << uniformMs << " ms, object buffer " << objectMs
+			<< " ms (" << objects.GetStats().draws << " draws, " << uniformMs / objectMs << "x)\n";
+	}
+
+	GLState::Get().DeleteVertexArrays(1, &VAO);
+	glDeleteBuffers(1, &VBO);
+}
+
+// Rock instance matrices rewritten and drawn every frame through instance buffers of 1-3 frame segments,
+// submitted back to back without glFinish. With one segment every write waits for the previous frame's draw;
+// with three the GPU should be done long before a segment comes around again.
+void BenchmarkStreamBuffer(const std::vector<size_t>& instanceCounts)
+{
+	using Clock = std::chrono::high_resolution_clock;
+	Model rock("res/models/rock/rock.obj");
+	Shader rockShader("res/shaders/instancing_rock.vs", "res/shaders/instancing_rock.fs");
+	rockShader.Bind();
+	rockShader.SetMat4("projection", glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 1000.0f));
+	rockShader.SetMat4("view", glm::lookAt(glm::vec3(0.0f, 20.0f, 120.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+
+	for (size_t count : instanceCounts) {
+		std::vector<glm::mat4> transforms(count);
+		for (size_t i = 0; i < count; i++)
+			transforms[i] = glm::translate(glm::mat4(1.0f), glm::vec3(float(i % 100) - 50.0f, float(i / 100 % 100) - 50.0f, -float(i / 10000)));
+
+		for (unsigned int frameCount = 1; frameCount <= 3; frameCount++) {
+			InstanceBuffer buffer(count * sizeof(glm::mat4), frameCount);
+			const int frames = 100;
+			glFinish();
+			auto start = Clock::now();
+			for (int frame = 0; frame < frames; frame++) {
+				std::memcpy(buffer.BeginWrite(count * sizeof(glm::mat4)), transforms.data(), count * sizeof(glm::mat4));
+				buffer.EndWrite();
+				rock.DrawInstanced(rockShader, buffer, static_cast<unsigned int>(count));
+				glFlush();
+			}
+			double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+			glFinish();
+			std::cout << "  " << count << " instances, " << (buffer.IsPersistent() ? "persistent" : "orphaned") << " x"
+				<< buffer.GetFrameCount() << ": " << ms << " ms per frame submitted, " << buffer.GetStats() << "\n";
+			if (!buffer.IsPersistent())
+				break;
+		}
+	}
+}
+
+// The rock spin evaluated by the transform feedback pass against the CPU kernel writing the same
+// position+scale+quaternion instances, and the GPU result read back and compared with the CPU's
+void BenchmarkGpuAnimation(const std::vector<size_t>& instanceCounts)
+{
+	using Clock = std::chrono::high_resolution_clock;
+	const int frames = 20;
+	const float deltaTime = 1.0f / 60.0f;
+	std::cout << "rock animation, ms per frame: CPU kernel vs transform feedback (submit + glFinish)\n";
+
+	std::mt19937 gen(1234);
+	std::uniform_real_distribution<float> dis(0.0f, 1.0f);
+	for (size_t count : instanceCounts) {
+		InstanceTransforms transforms;
+		transforms.Reserve(count);
+		for (size_t i = 0; i < count; i++) {
+			float angle = 6.2831853f * i / count;
+			glm::vec3 position(std::sin(angle) * 150.0f, 10.0f * dis(gen) - 5.0f, std::cos(angle) * 150.0f);
+			glm::quat rotation = glm::angleAxis(6.2831853f * dis(gen), glm::normalize(glm::vec3(dis(gen), dis(gen), dis(gen)) + 0.01f));
+			transforms.Add(position, rotation, 0.05f + 0.15f * dis(gen), glm::vec3(dis(gen), dis(gen), dis(gen)) + 0.01f, 4.0f + 4.0f * dis(gen));
+		}
+		InstanceAnimation animation(transforms);
+
+		std::vector<unsigned char> destination(count * GetInstanceStride(InstanceAnimation::outputFormat));
+		auto start = Clock::now();
+		for (int frame = 0; frame < frames; frame++)
+			transforms.Update(deltaTime, destination.data(), InstanceAnimation::outputFormat);
+		double cpuMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+
+		animation.Update(0.0f);
+		glFinish();
+		start = Clock::now();
+		for (int frame = 1; frame <= frames; frame++)
+			animation.Update(frame * deltaTime);
+		glFinish();
+		double gpuMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+
+		InstanceTransforms::EncodingError error = animation.Compare(frames * deltaTime);
+		std::cout << "  " << count << " instances: CPU " << cpuMs << " ms, GPU " << gpuMs << " ms, max error "
+			<< error.position << "/" << error.linear << (animation.Verify(frames * deltaTime) ? "" : " MISMATCH") << "\n";
+	}
+}
+
+// Asteroid placement the way instancing.cpp used to do it (one mt19937, serial) against the counter-based
+// RingScatter on one thread and on the global pool; the two scatters must agree bit for bit
+void BenchmarkScatter(const std::vector<size_t>& instanceCounts)
+{
+	using Clock = std::chrono::high_resolution_clock;
+	std::cout << "instance scatter, ms (" << ThreadPool::Global().GetThreadCount() + 1 << " threads in the pool)\n";
+	auto elapsed = [](Clock::time_point _start) { return std::chrono::duration<double, std::milli>(Clock::now() - _start).count(); };
+
+	for (size_t count : instanceCounts) {
+		double serialMs = 0.0;
+		{
+			auto start = Clock::now();
+			InstanceTransforms transforms;
+			transforms.Reserve(count);
+			std::mt19937 gen(1);
+			std::uniform_real_distribution<float> dis(-1.0f, 1.0f), unit(0.0f, 1.0f);
+			for (size_t i = 0; i < count; i++) {
+				float angle = 6.2831853f * i / count;
+				glm::vec3 axis(unit(gen), unit(gen), unit(gen));
+				glm::vec3 position(std::sin(angle) * 50.0f + dis(gen) * 5.0f, 3.0f * dis(gen), std::cos(angle) * 50.0f + dis(gen) * 5.0f);
+				transforms.Add(position, glm::angleAxis(6.2831853f * unit(gen), glm::normalize(axis + 1e-3f)), 0.05f + 0.15f * unit(gen),
+					axis + 1e-3f, 4.0f + 4.0f * unit(gen));
+			}
+			serialMs = elapsed(start);
+		}
+
+		RingScatter scatter(1);
+		InstanceTransforms single, parallel;
+		ThreadPool oneWorker(1);
+		auto start = Clock::now();
+		scatter.Scatter(single, count, oneWorker);
+		double singleMs = elapsed(start);
+		start = Clock::now();
+		scatter.Scatter(parallel, count);
+		double parallelMs = elapsed(start);
+
+		size_t differing = 0;
+		for (size_t i = 0; i < count; i++) {
+			glm::mat4 a = single.GetMatrix(i), b = parallel.GetMatrix(i);
+			differing += std::memcmp(&a, &b, sizeof(a)) != 0 || single.GetSpeed(i) != parallel.GetSpeed(i)
+				|| single.GetAxis(i) != parallel.GetAxis(i);
+		}
+		std::cout << "  " << count << " instances: mt19937 serial " << serialMs << " ms, scatter 2 threads " << singleMs
+			<< " ms, pool " << parallelMs << " ms (" << count / parallelMs / 1000.0 << " M/s), "
+			<< (differing ? std::to_string(differing) + " instances DIFFER" : "bit-identical") << "\n";
+	}
+}
+
+// Overlap-free placement of the rock: the demo's ring at 1x to 4x its rock count (rejections climb as it
+// fills up), then wider rings at the demo's density. Every result is checked pair by pair in one global
+// SpatialHash, independent of the sectors, and on one worker against the pool for determinism.
+void BenchmarkSeparatedScatter(const std::vector<size_t>& instanceCounts)
+{
+	std::cout << "separated scatter (" << ThreadPool::Global().GetThreadCount() + 1 << " threads in the pool)\n";
+	const BoundingSphere rockBounds = Model("res/models/rock/rock.obj").GetBoundingSphere();
+	const float unitRadius = glm::length(rockBounds.center) + rockBounds.radius;
+
+	auto run = [&](size_t _count, const RingScatter::Settings& _settings) {
+		RingScatter scatter(1, _settings);
+		InstanceTransforms transforms, single;
+		ScatterReport report = scatter.ScatterSeparated(transforms, _count, rockBounds);
+
+		SpatialHash check(2.0f * _settings.separation * unitRadius * _settings.maxScale, transforms.GetCount());
+		size_t overlapping = 0;
+		for (size_t i = 0; i < transforms.GetCount(); i++) {
+			// A little slack for the rounding of the distance
+			const float radius = unitRadius * transforms.GetScale(i);
+			overlapping += check.Overlaps(transforms.GetPosition(i), radius, _settings.separation * 0.9999f);
+			check.Insert(transforms.GetPosition(i), radius);
+		}
+
+		ThreadPool oneWorker(1);
+		scatter.ScatterSeparated(single, _count, rockBounds, oneWorker);
+		bool identical = single.GetCount() == transforms.GetCount();
+		for (size_t i = 0; identical && i < transforms.GetCount(); i++) {
+			glm::mat4 a = single.GetMatrix(i), b = transforms.GetMatrix(i);
+			identical = std::memcmp(&a, &b, sizeof(a)) == 0;
+		}
+
+		std::cout << "  ring radius " << _settings.radius << ", " << _count << " rocks: " << report
+			<< (overlapping ? ", " + std::to_string(overlapping) + " OVERLAPPING" : "") << (identical ? "" : ", threads DIFFER") << "\n";
+	};
+
+	for (size_t factor = 1; factor <= 4; factor *= 2)
+		run(5000 * factor, RingScatter::Settings());
+	for (size_t count : instanceCounts) {
+		RingScatter::Settings wide;
+		wide.radius *= static_cast<float>(count) / 5000.0f;
+		run(count, wide);
+	}
+}
+
+// LOD chains of the demo models (cold, so the simplifier runs) and the rock ring from the demo's camera:
+// triangles submitted with per-instance levels vs. everything at full detail, and the cost of selecting
+// the levels on top of the culled update.
+void BenchmarkLod(const std::vector<size_t>& instanceCounts)
+{
+	using Clock = std::chrono::high_resolution_clock;
+	const int frames = 20;
+	const float deltaTime = 1.0f / 60.0f;
+	std::cout << "level of detail (" << ThreadPool::Global().GetThreadCount() + 1 << " threads)\n";
+
+	ModelOptions options;
+	options.lodLevels = 4;
+	options.optimizeVertexCache = true;
+	for (const std::string& path : { std::string("res/models/rock/rock.obj"), std::string("res/models/planet/planet.obj") }) {
+		std::error_code ec;
+		std::filesystem::remove(MeshCache::GetCachePath(path, options.GetProcessFlags()), ec);
+		auto start = Clock::now();
+		Model model(path, options);
+		double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		const float radius = model.GetBoundingSphere().radius;
+		std::vector<float> errors = model.GetLevelErrors();
+		std::cout << "  " << path << " (" << ms << " ms cold):";
+		for (unsigned int level = 0; level < model.GetLevelCount(); level++)
+			std::cout << " L" << level << " " << model.GetTriangleCount(level) << " tris " << 100.0f * errors[level] / radius << "%";
+		std::cout << "\n";
+	}
+
+	Model rock("res/models/rock/rock.obj", options);
+	const BoundingSphere rockBounds = rock.GetBoundingSphere();
+	LodSelector lod(rock.GetLevelErrors(), glm::radians(45.0f), 1200.0f);
+	glm::vec3 cameraPosition(0.0f, 10.0f, 75.0f);
+	lod.SetCamera(cameraPosition);
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1600.0f / 1200.0f, 0.1f, 1000.0f);
+	glm::mat4 view = glm::lookAt(cameraPosition, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	Frustum frustum = Frustum::FromMatrix(projection * view);
+
+	for (size_t count : instanceCounts) {
+		InstanceTransforms transforms;
+		RingScatter(1).Scatter(transforms, count);
+		std::vector<glm::mat4> destination(count);
+		std::vector<size_t> levelCounts;
+
+		size_t visible = transforms.UpdateVisibleLod(deltaTime, frustum, rockBounds, lod, destination.data(), levelCounts);
+		size_t triangles = 0;
+		for (unsigned int level = 0; level < levelCounts.size(); level++)
+			triangles += levelCounts[level] * rock.GetTriangleCount(level);
+		size_t fullTriangles = visible * rock.GetTriangleCount();
+
+		auto start = Clock::now();
+		for (int frame = 0; frame < frames; frame++)
+			transforms.UpdateVisible(deltaTime, frustum, rockBounds, destination.data());
+		double cullMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+		start = Clock::now();
+		for (int frame = 0; frame < frames; frame++)
+			transforms.UpdateVisibleLod(deltaTime, frustum, rockBounds, lod, destination.data(), levelCounts);
+		double lodMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+
+		std::cout << "  " << count << " rocks, " << visible << " visible, per level";
+		for (size_t levelCount : levelCounts)
+			std::cout << " " << levelCount;
+		std::cout << ": " << triangles << " tris vs " << fullTriangles << " at full detail ("
+			<< (triangles ? (double)fullTriangles / triangles : 0.0) << "x), update " << cullMs << " -> " << lodMs << " ms\n";
+	}
+}
+
+// Baking the rock's impostor at a few atlas layouts, then the demo's ring from its camera with impostors from
+// each distance on: how many rocks become quads and the triangles left, against LOD alone
+void BenchmarkImpostors(const std::vector<float>& impostorDistances)
+{
+	std::cout << "impostors\n";
+	ModelOptions options;
+	options.lodLevels = 4;
+	options.optimizeVertexCache = true;
+	Model rock("res/models/rock/rock.obj", options);
+
+	for (ImpostorSettings settings : { ImpostorSettings{ 8, 128 }, ImpostorSettings{ 16, 64 }, ImpostorSettings{ 32, 32 } }) {
+		ImpostorAtlas atlas;
+		if (!atlas.Bake(rock, settings)) {
+			std::cout << "  " << settings.gridSize << "^2 frames: bake FAILED\n";
+			continue;
+		}
+		std::cout << "  " << settings.gridSize << "^2 frames of " << settings.frameResolution << " px: " << atlas.GetBakeMs() << " ms, "
+			<< 100.0f * atlas.GetCoverage() << "% covered\n";
+	}
+
+	const BoundingSphere rockBounds = rock.GetBoundingSphere();
+	LodSelector lod(rock.GetLevelErrors(), glm::radians(45.0f), 1200.0f);
+	glm::vec3 cameraPosition(0.0f, 10.0f, 75.0f);
+	lod.SetCamera(cameraPosition);
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1600.0f / 1200.0f, 0.1f, 1000.0f);
+	glm::mat4 view = glm::lookAt(cameraPosition, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	Frustum frustum = Frustum::FromMatrix(projection * view);
+
+	InstanceTransforms transforms;
+	RingScatter(1).Scatter(transforms, 5000);
+	std::vector<glm::mat4> destination(transforms.GetCount());
+	std::vector<size_t> levelCounts;
+	auto triangles = [&]() {
+		size_t total = 0;
+		for (unsigned int level = 0; level < lod.GetLevelCount(); level++)
+			total += levelCounts[level] * rock.GetTriangleCount(level);
+		return lod.HasImpostors() ? total + 2 * levelCounts[lod.GetImpostorBucket()] : total;
+	};
+
+	size_t visible = transforms.UpdateVisibleLod(0.0f, frustum, rockBounds, lod, destination.data(), levelCounts);
+	std::cout << "  5000 rocks, " << visible << " visible, LOD only: " << triangles() << " tris\n";
+	for (float distance : impostorDistances) {
+		lod.SetImpostorDistance(distance);
+		transforms.UpdateVisibleLod(0.0f, frustum, rockBounds, lod, destination.data(), levelCounts);
+		std::cout << "  impostors from " << distance << ": " << levelCounts[lod.GetImpostorBucket()] << " impostors, " << triangles() << " tris\n";
+	}
+}
+
+// Meshlet partition of each model, then a scripted camera path (an orbit that zooms from four radii out to
+// inside the bounding sphere) culling every meshlet against it: how many go to the frustum and to the normal
+// cones, and the triangles left. Every cone-culled meshlet is checked triangle by triangle to really face away.
+void BenchmarkMeshlets(const std::vector<std::string>& modelPaths)
+{
+	using Clock = std::chrono::high_resolution_clock;
+	const int steps = 240;
+	std::cout << "meshlets (" << meshletMaxVertices << " vertices / " << meshletMaxTriangles << " triangles)\n";
+
+	ModelOptions options;
+	options.optimizeVertexCache = true;
+	options.buildMeshlets = true;
+	for (const std::string& path : modelPaths) {
+		std::error_code ec;
+		std::filesystem::remove(MeshCache::GetCachePath(path, options.GetProcessFlags()), ec);
+		Model model(path, options);
+
+		size_t meshlets = 0, vertices = 0, triangles = 0, cones = 0;
+		double buildMs = 0.0;
+		bool valid = true;
+		for (const Mesh& mesh : model.meshes) {
+			// Rebuilt on a copy for the timing; the partition of already partitioned triangles is the same work
+			std::vector<unsigned int> indices = mesh.indices;
+			auto start = Clock::now();
+			BuildMeshlets(mesh.vertices, indices);
+			buildMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+			valid = valid && VerifyMeshlets(mesh.vertices, mesh.indices, mesh.meshlets);
+			for (const Meshlet& meshlet : mesh.meshlets) {
+				vertices += meshlet.vertexCount;
+				triangles += meshlet.triangleCount;
+				cones += meshlet.HasCone();
+			}
+			meshlets += mesh.meshlets.size();
+		}
+		if (meshlets == 0) {
+			std::cout << "  " << path << ": no meshlets\n";
+			continue;
+		}
+		std::cout << "  " << path << ": " << meshlets << " meshlets, " << (double)vertices / meshlets << " vertices and "
+			<< (double)triangles / meshlets << " triangles each, " << 100.0 * cones / meshlets << "% with a cone, built in "
+			<< buildMs << " ms" << (valid ? "" : " (INVALID)") << "\n";
+
+		const BoundingSphere bounds = model.GetBoundingSphere();
+		const glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1600.0f / 1200.0f, 0.01f * bounds.radius, 100.0f * bounds.radius);
+		const glm::mat4 transform(1.0f);
+		MeshletCullStats total;
+		std::vector<IndexRange> ranges;
+		size_t violations = 0;
+		double cullMs = 0.0;
+		for (int step = 0; step < steps; step++) {
+			const float t = static_cast<float>(step) / steps;
+			const float angle = 2.0f * glm::two_pi<float>() * t;
+			const float distance = bounds.radius * glm::mix(4.0f, 0.6f, t);
+			const glm::vec3 eye = bounds.center + distance * glm::vec3(std::cos(angle), 0.4f * std::sin(3.0f * angle), std::sin(angle));
+			const Frustum frustum = Frustum::FromMatrix(projection * glm::lookAt(eye, bounds.center, glm::vec3(0.0f, 1.0f, 0.0f)));
+
+			for (const Mesh& mesh : model.meshes) {
+				ranges.clear();
+				auto start = Clock::now();
+				CullMeshlets(mesh.meshlets, transform, frustum, eye, ranges, total);
+				cullMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+				for (const Meshlet& meshlet : mesh.meshlets) {
+					if (!meshlet.IsBackfacing(eye))
+						continue;
+					for (uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + 3 * meshlet.triangleCount; i += 3) {
+						const glm::vec3& a = mesh.vertices[mesh.indices[i]].position;
+						glm::vec3 normal = glm::cross(mesh.vertices[mesh.indices[i + 1]].position - a, mesh.vertices[mesh.indices[i + 2]].position - a);
+						if (glm::dot(normal, eye - a) > 1e-4f * glm::length(normal) * bounds.radius)
+							violations++;
+					}
+				}
+			}
+		}
+		std::cout << "  " << steps << " camera steps: " << 100.0 * total.frustumCulled / total.meshlets << "% outside the frustum, "
+			<< 100.0 * total.backfaceCulled / total.meshlets << "% facing away, " << 100.0 * total.trianglesDrawn / total.triangles
+			<< "% of the triangles drawn in " << (double)total.ranges / steps << " ranges a frame, culling "
+			<< cullMs / steps << " ms a frame, " << violations << " front-facing triangles culled\n";
+	}
+}
+
+// The demo's planet as the occluder of the rock ring, from a camera at the ring's edge looking past the planet:
+// the software rasterizer against its scalar reference, then the rock update with frustum culling alone and
+// with the occlusion test, and the hierarchical box test against the one reading every pixel
+void BenchmarkOcclusion(const std::vector<size_t>& instanceCounts)
+{
+	using Clock = std::chrono::high_resolution_clock;
+	const int frames = 20;
+	std::cout << "occlusion culling (" << InstanceTransforms::GetKernelName() << ")\n";
+
+	Model planet("res/models/planet/planet.obj");
+	const glm::mat4 planetModel = glm::scale(glm::mat4(1.0f), glm::vec3(4.0f));
+	Model rock("res/models/rock/rock.obj");
+	const BoundingSphere rockBounds = rock.GetBoundingSphere();
+	LodSelector lod(rock.GetLevelErrors(), glm::radians(45.0f), 1200.0f);
+
+	for (glm::vec3 cameraPosition : { glm::vec3(0.0f, 10.0f, 75.0f), glm::vec3(0.0f, 2.0f, 35.0f), glm::vec3(0.0f, 1.0f, 12.0f) }) {
+		glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1600.0f / 1200.0f, 0.1f, 1000.0f);
+		glm::mat4 view = glm::lookAt(cameraPosition, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		Frustum frustum = Frustum::FromMatrix(projection * view);
+		lod.SetCamera(cameraPosition);
+
+		OcclusionBuffer occlusion(400, 300);
+		double rasterizeMs = 0.0;
+		for (int frame = 0; frame < frames; frame++) {
+			occlusion.Clear(projection * view);
+			for (const Mesh& mesh : planet.meshes)
+				occlusion.RasterizeTriangles(mesh.vertices, mesh.indices, planetModel);
+			occlusion.BuildHierarchy();
+			rasterizeMs += occlusion.GetStats().rasterizeMs;
+		}
+		size_t covered = 0;
+		for (float depth : occlusion.GetDepth())
+			covered += depth != FLT_MAX ? 1 : 0;
+		auto start = Clock::now();
+		std::vector<float> strict(occlusion.GetDepth().size(), FLT_MAX), loose(strict);
+		for (const Mesh& mesh : planet.meshes)
+			occlusion.RasterizeReference(mesh.vertices, mesh.indices, planetModel, strict, loose);
+		size_t mismatches = occlusion.CountReferenceMismatches(strict, loose);
+		double referenceMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		std::cout << "  camera at " << glm::length(cameraPosition) << ": " << occlusion.GetStats().rasterizedTriangles << "/"
+			<< occlusion.GetStats().occluderTriangles << " occluder triangles, " << 100.0 * covered / occlusion.GetDepth().size()
+			<< "% of " << occlusion.GetWidth() << "x" << occlusion.GetHeight() << " covered, " << rasterizeMs / frames
+			<< " ms (reference " << referenceMs << " ms, " << mismatches << " pixels differ)\n";
+
+		for (size_t count : instanceCounts) {
+			InstanceTransforms transforms;
+			RingScatter(1).Scatter(transforms, count);
+			std::vector<glm::mat4> destination(count);
+			std::vector<size_t> levelCounts;
+
+			start = Clock::now();
+			size_t frustumVisible = 0;
+			for (int frame = 0; frame < frames; frame++)
+				frustumVisible = transforms.UpdateVisibleLod(0.0f, frustum, rockBounds, lod, destination.data(), levelCounts);
+			double frustumMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+			start = Clock::now();
+			size_t visible = 0;
+			for (int frame = 0; frame < frames; frame++)
+				visible = transforms.UpdateVisibleLod(0.0f, frustum, rockBounds, lod, destination.data(), levelCounts,
+					InstanceTransforms::OutputLayout::Mat4, ThreadPool::Global(), &occlusion);
+			double occlusionMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+			bool valid = transforms.VerifyVisible(frustum, rockBounds, destination.data(), InstanceTransforms::OutputLayout::Mat4,
+				visible, &occlusion);
+
+			size_t disagreements = 0;
+			for (size_t i = 0; i < count; i++) {
+				glm::vec3 boxMin, boxMax;
+				transforms.GetOcclusionBox(i, rockBounds, boxMin, boxMax);
+				disagreements += occlusion.IsBoxVisible(boxMin, boxMax) != occlusion.IsBoxVisibleReference(boxMin, boxMax) ? 1 : 0;
+			}
+			std::cout << "    " << count << " rocks: " << frustumVisible << " in the frustum, " << transforms.GetOccludedCount()
+				<< " of them occluded, update " << frustumMs << " -> " << occlusionMs << " ms" << (valid ? "" : " (INVALID)")
+				<< ", " << disagreements << " box tests differ from the per-pixel reference\n";
+		}
+	}
+}
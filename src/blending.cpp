@@ -20,6 +20,7 @@
 
 #include "camera.h"
 #include "model.h"
+#include "object_buffer.h"
 #include "shader.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -151,7 +152,7 @@ int main()
     unsigned int cubeVAO, cubeVBO;
     glGenVertexArrays(1, &cubeVAO);
     glGenBuffers(1, &cubeVBO);
-    glBindVertexArray(cubeVAO);
+    GLState::Get().BindVertexArray(cubeVAO);
     glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), &cubeVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
@@ -163,7 +164,7 @@ int main()
     unsigned int planeVAO, planeVBO;
     glGenVertexArrays(1, &planeVAO);
     glGenBuffers(1, &planeVBO);
-    glBindVertexArray(planeVAO);
+    GLState::Get().BindVertexArray(planeVAO);
     glBindBuffer(GL_ARRAY_BUFFER, planeVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(planeVertices), &planeVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
@@ -175,14 +176,14 @@ int main()
     unsigned int transparentVAO, transparentVBO;
     glGenVertexArrays(1, &transparentVAO);
     glGenBuffers(1, &transparentVBO);
-    glBindVertexArray(transparentVAO);
+    GLState::Get().BindVertexArray(transparentVAO);
     glBindBuffer(GL_ARRAY_BUFFER, transparentVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(transparentVertices), &transparentVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-    glBindVertexArray(0);
+    GLState::Get().BindVertexArray(0);
 
     // texture configs
     unsigned int cubeTexture = loadTexture("res/textures/marble.jpg");
@@ -201,8 +202,27 @@ int main()
     shader.Bind();
     shader.SetInt("texture1", 0);
 
+    // Uniform locations for the per-frame setters, resolved once
+    Shader::Uniform projectionUniform = shader.GetUniform("projection");
+    Shader::Uniform viewUniform = shader.GetUniform("view");
+
+    // Model matrices of every object, uploaded once per frame and read by gl_InstanceID
+    ObjectBuffer objects;
+    objects.BindShader(shader);
+
+    int counter = 0;
+    const int maxPrints = 50;
+
     // Rendering loop
     while (!glfwWindowShouldClose(window)) {
+        // Calls made through Shader last frame; every set used to add its own glGetUniformLocation
+        if (counter < maxPrints) {
+            const Shader::CallCounters& calls = Shader::GetCallCounters();
+            std::cout << "uniform calls: " << calls.uniformUploads << " uploads + " << calls.locationQueries << " location queries, "
+                << calls.namedSets << " by name from the location table, " << objects.GetStats() << "\n";
+            counter++;
+        }
+        Shader::ResetCallCounters();
 
         float currentFrame = static_cast<float>(glfwGetTime());
         deltaTime = currentFrame - lastFrame;
@@ -225,39 +245,36 @@ int main()
         shader.Bind();
         glm::mat4 projection = glm::perspective(glm::radians(camera.fov), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
         glm::mat4 view = camera.GetViewMatrix();
-        glm::mat4 model = glm::mat4(1.0f);
-        shader.SetMat4("projection", projection);
-        shader.SetMat4("view", view);
+        shader.SetMat4(projectionUniform, projection);
+        shader.SetMat4(viewUniform, view);
+
+        // Write the model matrices of all objects, one batch per draw; instances are drawn in
+        // order, so the windows keep their back-to-front order within their batch
+        objects.Begin();
+        ObjectBuffer::Batch cubeBatch = objects.Push({ glm::translate(glm::mat4(1.0f), glm::vec3(-1.0f, 0.0f, -1.0f)),
+            glm::translate(glm::mat4(1.0f), glm::vec3(2.0f, 0.0f, 0.0f)) });
+        ObjectBuffer::Batch floorBatch = objects.Push({ glm::mat4(1.0f) });
+        std::vector<ObjectData> windowObjects;
+        for (auto it = sorted.cbegin(); it != sorted.cend(); ++it)
+            windowObjects.push_back({ glm::translate(glm::mat4(1.0f), it->second) });
+        ObjectBuffer::Batch windowBatch = objects.Push(windowObjects);
+        objects.Upload();
 
         // cubes
-        glBindVertexArray(cubeVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, cubeTexture);
-        model = glm::translate(model, glm::vec3(-1.0f, 0.0f, -1.0f));
-        shader.SetMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(2.0f, 0.0f, 0.0f));
-        shader.SetMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        GLState::Get().BindVertexArray(cubeVAO);
+        GLState::Get().ActiveTexture(GL_TEXTURE0);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, cubeTexture);
+        objects.DrawArrays(cubeBatch, GL_TRIANGLES, 0, 36);
 
         // floor
-        glBindVertexArray(planeVAO);
-        glBindTexture(GL_TEXTURE_2D, floorTexture);
-        model = glm::mat4(1.0f);
-        shader.SetMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        GLState::Get().BindVertexArray(planeVAO);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, floorTexture);
+        objects.DrawArrays(floorBatch, GL_TRIANGLES, 0, 6);
 
         // windows
-        glBindVertexArray(transparentVAO);
-        glBindTexture(GL_TEXTURE_2D, transparentTexture);
-        for (auto it = sorted.cbegin(); it != sorted.cend(); ++it) {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, it->second);
-            shader.SetMat4("model", model);
-            glDrawArrays(GL_TRIANGLES, 0, 6);
-        }
+        GLState::Get().BindVertexArray(transparentVAO);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, transparentTexture);
+        objects.DrawArrays(windowBatch, GL_TRIANGLES, 0, 6);
 
         glfwSwapBuffers(window);
         glfwPollEvents();
@@ -265,8 +282,8 @@ int main()
 
     // optional: de-allocate all resources once they've outlived their purpose:
     // ------------------------------------------------------------------------
-    glDeleteVertexArrays(1, &cubeVAO);
-    glDeleteVertexArrays(1, &planeVAO);
+    GLState::Get().DeleteVertexArrays(1, &cubeVAO);
+    GLState::Get().DeleteVertexArrays(1, &planeVAO);
     glDeleteBuffers(1, &cubeVBO);
     glDeleteBuffers(1, &planeVBO);
 
@@ -333,7 +350,7 @@ void RenderSphere()
             oddRow = !oddRow;
         }
 
-        glBindVertexArray(sphereVAO);
+        GLState::Get().BindVertexArray(sphereVAO);
         glBindBuffer(GL_ARRAY_BUFFER, sphereVBO);
         glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereEBO);
@@ -344,14 +361,14 @@ void RenderSphere()
         glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
         glEnableVertexAttribArray(2);
         glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-        glBindVertexArray(0);
+        GLState::Get().BindVertexArray(0);
     }
 
-    glBindVertexArray(sphereVAO);
+    GLState::Get().BindVertexArray(sphereVAO);
     glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
     glDrawElements(GL_TRIANGLE_STRIP, (64 + 1) * 64 * 2, GL_UNSIGNED_INT, 0);
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-    glBindVertexArray(0);
+    GLState::Get().BindVertexArray(0);
 }
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
@@ -428,7 +445,7 @@ unsigned int loadTexture(const std::string& path)
         else if (nrComponents == 4)
             format = GL_RGBA;
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
@@ -2,6 +2,7 @@
 #include <GLFW/glfw3.h>
 
 #include "camera.h"
+#include "indirect_draw.h"
 #include "model.h"
 #include "shader.h"
 
@@ -55,7 +56,8 @@ int main()
     }
 
     // build and compile shaders
-    Shader shader("res/shaders/cubemap.vs", "res/shaders/cubemap.fs");
+    // The model matrix comes from the indirect draw list's per-draw data instead of a uniform
+    Shader shader("res/shaders/cubemap_indirect.vs", "res/shaders/cubemap.fs");
     Shader skyboxShader("res/shaders/skybox.vs", "res/shaders/skybox.fs");
 
     // set up vertex data (and buffer(s)) and configure vertex attributes
@@ -153,7 +155,7 @@ int main()
     unsigned int cubeVAO, cubeVBO;
     glGenVertexArrays(1, &cubeVAO);
     glGenBuffers(1, &cubeVBO);
-    glBindVertexArray(cubeVAO);
+    GLState::Get().BindVertexArray(cubeVAO);
     glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), &vertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
@@ -165,7 +167,7 @@ int main()
     unsigned int skyboxVAO, skyboxVBO;
     glGenVertexArrays(1, &skyboxVAO);
     glGenBuffers(1, &skyboxVBO);
-    glBindVertexArray(skyboxVAO);
+    GLState::Get().BindVertexArray(skyboxVAO);
     glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
@@ -173,6 +175,17 @@ int main()
 
     // load model
     Model ourModel("res/models/nanosuit.obj");
+
+    // The whole nanosuit as one indirect draw list, built once. The refraction shader samples only
+    // the skybox, so the meshes' own textures are not needed and every mesh lands in one group.
+    glm::mat4 nanosuitModel = glm::mat4(1.0f);
+    nanosuitModel = glm::scale(nanosuitModel, glm::vec3(0.1f));
+    nanosuitModel = glm::translate(nanosuitModel, glm::vec3(0.0f));
+    nanosuitModel = glm::rotate(nanosuitModel, glm::radians(45.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    IndirectDrawList nanosuitDraws;
+    nanosuitDraws.AddModel(ourModel, nanosuitModel);
+    std::cout << "nanosuit: " << ourModel.meshes.size() << " meshes, indirect path: "
+        << IndirectDrawList::GetPathName(nanosuitDraws.GetPath()) << "\n";
     
     // load textures
     unsigned int cubeTexture = LoadTexture("res/textures/container.jpg");
@@ -194,9 +207,20 @@ int main()
     skyboxShader.Bind();
     skyboxShader.SetInt("skybox", 0);
 
+    // Binds go through the GL shadow state; meshes stay bound after drawing instead of restoring 0
+    GLState::Get().SetUnbindAfterDraw(false);
+    int counter = 0;
+    const int maxPrints = 50;
+
     // render loop
     while (!glfwWindowShouldClose(window))
     {
+        if (counter < maxPrints) {
+            std::cout << "GL state: " << GLState::Get().GetCounters() << ", nanosuit: " << nanosuitDraws.GetStats() << "\n";
+            counter++;
+        }
+        GLState::Get().ResetCounters();
+
         // per-frame time logic
         float currentFrame = (float)glfwGetTime();
         deltaTime = currentFrame - lastFrame;
@@ -211,39 +235,32 @@ int main()
 
         // 1. shader configs
         shader.Bind();
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::scale(model, glm::vec3(0.1f));
-        model = glm::translate(model, glm::vec3(0.0f));
-        model = glm::rotate(model, glm::radians(45.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-
         glm::mat4 view = camera.GetViewMatrix();
         glm::mat4 projection = glm::perspective(glm::radians(camera.fov), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        shader.SetMat4("model", model);
         shader.SetMat4("view", view);
         shader.SetMat4("projection", projection);
         shader.SetVec3("cameraPos", camera.position);
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, cubemapTexture);
+        GLState::Get().ActiveTexture(GL_TEXTURE0);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, cubemapTexture);
 
-        // 2. draw model (meshes)
-        ourModel.Draw(shader);
-        glBindVertexArray(0);
+        // 2. draw model (all meshes in one go)
+        nanosuitDraws.Execute(shader, false);
 
         // 3. draw skybox as last
         glDepthFunc(GL_LEQUAL);  // since we manually set depth value to 1.0f here
         skyboxShader.Bind();
         view = glm::mat4(glm::mat3(camera.GetViewMatrix())); // Important: remove translation from the view matrix
-        model = glm::mat4(1.0f);
+        glm::mat4 model = glm::mat4(1.0f);
         skyboxShader.SetMat4("view", view);
         skyboxShader.SetMat4("projection", projection);
         skyboxShader.SetMat4("model", model);
 
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+        GLState::Get().BindVertexArray(skyboxVAO);
+        GLState::Get().ActiveTexture(GL_TEXTURE0);
+        GLState::Get().BindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
         glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
+        GLState::Get().EndDraw();
         glDepthFunc(GL_LESS); // don't forget to return default
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
@@ -252,8 +269,8 @@ int main()
     }
 
     // optional: de-allocate all resources once they've outlived their purpose:
-    glDeleteVertexArrays(1, &cubeVAO);
-    glDeleteVertexArrays(1, &skyboxVAO);
+    GLState::Get().DeleteVertexArrays(1, &cubeVAO);
+    GLState::Get().DeleteVertexArrays(1, &skyboxVAO);
     glDeleteBuffers(1, &cubeVBO);
     glDeleteBuffers(1, &skyboxVBO);
 
@@ -333,7 +350,7 @@ unsigned int LoadTexture(const std::string& path)
         else if (nrComponents == 4)
             format = GL_RGBA;
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
@@ -365,7 +382,7 @@ unsigned int LoadCubemap(const std::vector<std::string>& faces)
 {
     unsigned int textureID;
     glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID); // Notice we bind to texture_cube_map instead of texture_2D
+    GLState::Get().BindTexture(GL_TEXTURE_CUBE_MAP, textureID); // Notice we bind to texture_cube_map instead of texture_2D
 
     int width, height, nrChannels;
     for (unsigned int i = 0; i < 6; i++) {
@@ -7,6 +7,7 @@
 
 #include "camera.h"
 #include "model.h"
+#include "object_buffer.h"
 #include "shader.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -112,7 +113,7 @@ int main()
     glGenVertexArrays(1, &cubeVAO);
     glGenBuffers(1, &cubeVBO);
 
-    glBindVertexArray(cubeVAO);
+    GLState::Get().BindVertexArray(cubeVAO);
     glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), &cubeVertices, GL_STATIC_DRAW);
 
@@ -127,7 +128,7 @@ int main()
     glGenVertexArrays(1, &planeVAO);
     glGenBuffers(1, &planeVBO);
 
-    glBindVertexArray(planeVAO);
+    GLState::Get().BindVertexArray(planeVAO);
     glBindBuffer(GL_ARRAY_BUFFER, planeVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(planeVertices), &planeVertices, GL_STATIC_DRAW);
 
@@ -145,6 +146,10 @@ int main()
     shader.Bind();
 	shader.SetInt("texture1", 0); // Tell OpenGL which texture unit belongs to
 
+    // Model matrices of the scene, uploaded once per frame and read by gl_InstanceID
+    ObjectBuffer objects;
+    objects.BindShader(shader);
+
     // render loop
     while (!glfwWindowShouldClose(window))
     {
@@ -158,39 +163,35 @@ int main()
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         shader.Bind();
-        glm::mat4 model = glm::mat4(1.0f);
         glm::mat4 view = camera.GetViewMatrix();
         glm::mat4 projection = glm::perspective(glm::radians(camera.fov), (float)width / (float)height, 0.1f, 100.0f);
         shader.SetMat4("view", view);
         shader.SetMat4("projection", projection);
 
+        // all object data first, then pure draw calls
+        objects.Begin();
+        ObjectBuffer::Batch cubeBatch = objects.Push({ glm::translate(glm::mat4(1.0f), glm::vec3(-1.0f, 0.0f, -1.0f)),
+            glm::translate(glm::mat4(1.0f), glm::vec3(2.0f, 0.0f, 0.0f)) });
+        ObjectBuffer::Batch floorBatch = objects.Push({ glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -0.05f, 0.0f)) });
+        objects.Upload();
+
         // cubes
-        glBindVertexArray(cubeVAO);
-        glActiveTexture(GL_TEXTURE0); // GL_TEXTURE0 is activited by default
-        glBindTexture(GL_TEXTURE_2D, cubeTexture);
-        model = glm::translate(model, glm::vec3(-1.0f, 0.0f, -1.0f));
-        shader.SetMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(2.0f, 0.0f, 0.0f));
-        shader.SetMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        GLState::Get().BindVertexArray(cubeVAO);
+        GLState::Get().ActiveTexture(GL_TEXTURE0); // GL_TEXTURE0 is activited by default
+        GLState::Get().BindTexture(GL_TEXTURE_2D, cubeTexture);
+        objects.DrawArrays(cubeBatch, GL_TRIANGLES, 0, 36);
 
         // floor
-        glBindVertexArray(planeVAO);
-        glBindTexture(GL_TEXTURE_2D, floorTexture);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, -0.05f, 0.0f));
-        shader.SetMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        GLState::Get().BindVertexArray(planeVAO);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, floorTexture);
+        objects.DrawArrays(floorBatch, GL_TRIANGLES, 0, 6);
 
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
-    glDeleteVertexArrays(1, &cubeVAO);
-    glDeleteVertexArrays(1, &planeVAO);
+    GLState::Get().DeleteVertexArrays(1, &cubeVAO);
+    GLState::Get().DeleteVertexArrays(1, &planeVAO);
     glDeleteBuffers(1, &cubeVBO);
     glDeleteBuffers(1, &planeVBO);
 
@@ -265,7 +266,7 @@ unsigned int LoadTexture(const std::string& path)
 		else if (nrComponents == 3) format = GL_RGB;
 		else if (nrComponents == 4) format = GL_RGBA;
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
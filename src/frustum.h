@@ -0,0 +1,74 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "simd_lanes.h"
+
+struct BoundingSphere
+{
+	glm::vec3 center = glm::vec3(0.0f);
+	float radius = 0.0f;
+};
+
+// The six clip planes of a view-projection matrix, each normalized so plane.xyz is the inward unit
+// normal and dot(plane.xyz, p) + plane.w is the signed distance of p in world units
+struct Frustum
+{
+	glm::vec4 planes[6]{};
+
+	// Gribb/Hartmann extraction for OpenGL clip space (-w <= x, y, z <= w)
+	static Frustum FromMatrix(const glm::mat4& _viewProjection)
+	{
+		glm::vec4 row[4];
+		for (int i = 0; i < 4; i++)
+			row[i] = glm::vec4(_viewProjection[0][i], _viewProjection[1][i], _viewProjection[2][i], _viewProjection[3][i]);
+
+		Frustum frustum;
+		frustum.planes[0] = row[3] + row[0]; // left
+		frustum.planes[1] = row[3] - row[0]; // right
+		frustum.planes[2] = row[3] + row[1]; // bottom
+		frustum.planes[3] = row[3] - row[1]; // top
+		frustum.planes[4] = row[3] + row[2]; // near
+		frustum.planes[5] = row[3] - row[2]; // far
+		for (glm::vec4& plane : frustum.planes)
+			plane /= glm::length(glm::vec3(plane));
+		return frustum;
+	}
+
+	// Conservative: true unless the sphere lies entirely outside one plane
+	bool IntersectsSphere(const glm::vec3& _center, float _radius) const
+	{
+		for (const glm::vec4& plane : planes)
+			if (glm::dot(glm::vec3(plane), _center) + plane.w < -_radius)
+				return false;
+		return true;
+	}
+};
+
+// Lane-wise Frustum::IntersectsSphere; bit i of the result is set when sphere i is culled
+template<class Lanes>
+struct FrustumLanes
+{
+	using Float = typename Lanes::Float;
+	Float planes[6][4];
+
+	explicit FrustumLanes(const Frustum& _frustum)
+	{
+		for (int p = 0; p < 6; p++)
+			for (int k = 0; k < 4; k++)
+				planes[p][k] = Lanes::Splat(_frustum.planes[p][k]);
+	}
+
+	int CullMask(Float _x, Float _y, Float _z, Float _radius) const
+	{
+		using L = Lanes;
+		// The smallest distance + radius over all planes is negative only for culled spheres
+		Float nearest;
+		for (int p = 0; p < 6; p++) {
+			Float distance = L::Add(L::Add(L::Mul(planes[p][0], _x), L::Mul(planes[p][1], _y)),
+				L::Add(L::Mul(planes[p][2], _z), L::Add(planes[p][3], _radius)));
+			nearest = p == 0 ? distance : L::Min(nearest, distance);
+		}
+		return L::SignMask(nearest);
+	}
+};
@@ -0,0 +1,327 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <GL/glew.h>
+
+#include "gl_state.h"
+#include "instance_format.h"
+#include "offset_allocator.h"
+#include "vertex_format.h"
+
+// One large vertex buffer and one 16-bit index buffer per VertexFormat, shared by every mesh of that
+// format, with a single VAO over them. A mesh owns a Handle to a vertex range and an index range and
+// draws with glDrawElementsBaseVertex, so switching between meshes needs no bind at all.
+// When an allocation does not fit, the pool copies its live ranges, packed, into new buffers (larger
+// if the free space is not enough); handles stay valid across that, only their offsets change.
+class GeometryPool
+{
+public:
+	using Handle = uint32_t;
+	static constexpr Handle invalidHandle = ~0u;
+
+	struct Stats
+	{
+		OffsetAllocator::Stats vertices, indices;
+		size_t meshes = 0;
+		size_t grows = 0, compactions = 0;  // buffer rebuilds, by reason
+		size_t copiedBytes = 0;             // by rebuilds
+	};
+
+	// The pool of _format; buffers are created on the first allocation, so this is safe before GL is up.
+	// The pools live until exit, after the context is gone, so their GL objects are left to the driver.
+	static GeometryPool& Get(VertexFormat _format)
+	{
+		static GeometryPool float32(VertexFormat::Float32);
+		static GeometryPool packed(VertexFormat::Packed);
+		return _format == VertexFormat::Packed ? packed : float32;
+	}
+
+	GeometryPool(const GeometryPool&) = delete;
+	GeometryPool& operator=(const GeometryPool&) = delete;
+
+	// Upload _vertexCount vertices of this pool's layout and their indices (relative to the first vertex)
+	Handle Allocate(const void* _vertices, uint32_t _vertexCount, const uint16_t* _indices, uint32_t _indexCount);
+	void Free(Handle _handle);
+
+	// Pack the live ranges into buffers of the current size; worthwhile after unloading models
+	void Compact() { Rebuild(vertexAllocator.GetCapacity(), indexAllocator.GetCapacity(), false); }
+
+	// Added to every index / offset of the first index, for the Handle's draws
+	GLint GetBaseVertex(Handle _handle) const { return static_cast<GLint>(ranges[_handle].vertexOffset); }
+	GLuint GetFirstIndex(Handle _handle) const { return ranges[_handle].indexOffset; }
+
+	VertexFormat GetFormat() const { return format; }
+	GLsizei GetVertexSize() const { return format == VertexFormat::Packed ? sizeof(PackedVertex) : sizeof(Vertex); }
+	GLuint GetVAO() const { return VAO; }
+	// Changes whenever ranges move, for anyone caching offsets
+	size_t GetGeneration() const { return grows + compactions; }
+	// A second VAO over the same geometry plus one _format placement per instance from _instanceBuffer,
+	// starting at _offset bytes, from location 3 on (where tangent/bitangent would be), created on first use
+	GLuint GetInstancedVAO(GLuint _instanceBuffer, size_t _offset = 0, InstanceFormat _format = InstanceFormat::Mat4);
+	// Deletes every pool's instanced VAOs over _instanceBuffer; call before the buffer name is deleted,
+	// since GL hands freed names out again and the cache would keep pointing at the old storage
+	static void ReleaseInstanceBuffer(GLuint _instanceBuffer);
+
+	Stats GetStats() const;
+	bool Validate() const;  // Allocators consistent and every live handle matches one of their ranges
+	// Validate after every Allocate and report failures; costs a walk over every range, so off by default
+	void SetValidateOnAllocate(bool _enabled) { validateOnAllocate = _enabled; }
+
+private:
+	struct Range
+	{
+		uint32_t vertexOffset = OffsetAllocator::invalid;
+		uint32_t indexOffset = OffsetAllocator::invalid;
+	};
+
+	struct InstancedVAO
+	{
+		GLuint instanceBuffer;
+		size_t offset;   // of the first instance
+		InstanceFormat format;
+		GLuint vao;
+	};
+
+	static constexpr uint32_t initialVertexCapacity = 1 << 16;
+	static constexpr uint32_t initialIndexCapacity = 3 << 16;
+
+	explicit GeometryPool(VertexFormat _format)
+		: format(_format) {}
+
+	void Rebuild(uint32_t _vertexCapacity, uint32_t _indexCapacity, bool _grow);
+	void SetupAttributes(GLuint _vao) const;
+	void SetupInstanceAttributes(GLuint _vao, const InstancedVAO& _instanced) const;
+
+	VertexFormat format;
+	GLuint VAO = 0, VBO = 0, IBO = 0;
+	std::vector<InstancedVAO> instancedVAOs;
+	OffsetAllocator vertexAllocator, indexAllocator;
+	std::vector<Range> ranges;                             // by Handle
+	std::vector<Handle> freeHandles;
+	size_t grows = 0, compactions = 0, copiedBytes = 0;
+	bool validateOnAllocate = false;
+};
+
+inline GeometryPool::Handle GeometryPool::Allocate(const void* _vertices, uint32_t _vertexCount, const uint16_t* _indices, uint32_t _indexCount)
+{
+	if (VAO == 0)
+		Rebuild(initialVertexCapacity, initialIndexCapacity, true);
+
+	uint32_t vertexOffset = vertexAllocator.Allocate(_vertexCount);
+	uint32_t indexOffset = indexAllocator.Allocate(_indexCount);
+	if (vertexOffset == OffsetAllocator::invalid || indexOffset == OffsetAllocator::invalid) {
+		if (vertexOffset != OffsetAllocator::invalid)
+			vertexAllocator.Free(vertexOffset);
+		if (indexOffset != OffsetAllocator::invalid)
+			indexAllocator.Free(indexOffset);
+
+		// Packing alone is enough when the free space adds up; otherwise at least double
+		auto required = [](const OffsetAllocator& _allocator, uint32_t _count) {
+			uint32_t capacity = _allocator.GetCapacity();
+			if (_allocator.GetFree() >= std::max(_count, 1u))
+				return capacity;
+			return std::max(capacity * 2, _allocator.GetUsed() + _count);
+		};
+		uint32_t vertexCapacity = required(vertexAllocator, _vertexCount);
+		uint32_t indexCapacity = required(indexAllocator, _indexCount);
+		Rebuild(vertexCapacity, indexCapacity, vertexCapacity != vertexAllocator.GetCapacity() || indexCapacity != indexAllocator.GetCapacity());
+
+		vertexOffset = vertexAllocator.Allocate(_vertexCount);
+		indexOffset = indexAllocator.Allocate(_indexCount);
+	}
+
+	const size_t vertexSize = GetVertexSize();
+	glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, vertexOffset * vertexSize, _vertexCount * vertexSize, _vertices);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, IBO);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, indexOffset * sizeof(uint16_t), _indexCount * sizeof(uint16_t), _indices);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	Handle handle;
+	if (!freeHandles.empty()) {
+		handle = freeHandles.back();
+		freeHandles.pop_back();
+	}
+	else {
+		handle = static_cast<Handle>(ranges.size());
+		ranges.emplace_back();
+	}
+	ranges[handle].vertexOffset = vertexOffset;
+	ranges[handle].indexOffset = indexOffset;
+	if (validateOnAllocate && !Validate())
+		std::cout << "ERROR::GEOMETRY_POOL::Inconsistent after allocating " << _vertexCount << " vertices\n";
+	return handle;
+}
+
+inline void GeometryPool::Free(Handle _handle)
+{
+	if (_handle >= ranges.size() || ranges[_handle].vertexOffset == OffsetAllocator::invalid)
+		return;
+	vertexAllocator.Free(ranges[_handle].vertexOffset);
+	indexAllocator.Free(ranges[_handle].indexOffset);
+	ranges[_handle] = Range();
+	freeHandles.push_back(_handle);
+}
+
+// The uploads and copies go through the copy targets, so no VAO's element buffer binding is disturbed
+inline void GeometryPool::Rebuild(uint32_t _vertexCapacity, uint32_t _indexCapacity, bool _grow)
+{
+	const size_t vertexSize = GetVertexSize();
+	GLuint newVBO = 0, newIBO = 0;
+	glGenBuffers(1, &newVBO);
+	glGenBuffers(1, &newIBO);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newVBO);
+	glBufferData(GL_COPY_WRITE_BUFFER, static_cast<size_t>(_vertexCapacity) * vertexSize, nullptr, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newIBO);
+	glBufferData(GL_COPY_WRITE_BUFFER, static_cast<size_t>(_indexCapacity) * sizeof(uint16_t), nullptr, GL_STATIC_DRAW);
+
+	// Copy every live range to its packed offset and remember where it went
+	auto relocate = [&](OffsetAllocator& _allocator, GLuint _from, GLuint _to, uint32_t _capacity, size_t _elementSize) {
+		std::unordered_map<uint32_t, uint32_t> moved;
+		glBindBuffer(GL_COPY_READ_BUFFER, _from);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, _to);
+		for (const OffsetAllocator::Relocation& relocation : _allocator.Compact(_capacity)) {
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, relocation.from * _elementSize,
+				relocation.to * _elementSize, relocation.size * _elementSize);
+			copiedBytes += relocation.size * _elementSize;
+			moved.emplace(relocation.from, relocation.to);
+		}
+		return moved;
+	};
+	std::unordered_map<uint32_t, uint32_t> movedVertices = relocate(vertexAllocator, VBO, newVBO, _vertexCapacity, vertexSize);
+	std::unordered_map<uint32_t, uint32_t> movedIndices = relocate(indexAllocator, IBO, newIBO, _indexCapacity, sizeof(uint16_t));
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	for (Range& range : ranges)
+		if (range.vertexOffset != OffsetAllocator::invalid) {
+			range.vertexOffset = movedVertices[range.vertexOffset];
+			range.indexOffset = movedIndices[range.indexOffset];
+		}
+
+	glDeleteBuffers(1, &VBO);
+	glDeleteBuffers(1, &IBO);
+	VBO = newVBO;
+	IBO = newIBO;
+	if (VAO == 0)
+		glGenVertexArrays(1, &VAO);
+	else
+		(_grow ? grows : compactions)++;
+
+	// Point every VAO of the pool at the new buffers
+	SetupAttributes(VAO);
+	for (const InstancedVAO& instanced : instancedVAOs)
+		SetupInstanceAttributes(instanced.vao, instanced);
+	GLState::Get().BindVertexArray(0);
+}
+
+// Tangent and bitangent are always enabled; meshes without them read zeros there
+inline void GeometryPool::SetupAttributes(GLuint _vao) const
+{
+	GLState::Get().BindVertexArray(_vao);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+
+	if (format == VertexFormat::Packed) {
+		// Same locations as the fp32 layout; the GL converts half floats and snorm 10:10:10:2 back to floats
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, texCoords));
+		// w holds the bitangent sign
+		glEnableVertexAttribArray(3);
+		glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, tangent));
+	}
+	else {
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));
+		glEnableVertexAttribArray(3);
+		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+		glEnableVertexAttribArray(4);
+		glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+	}
+}
+
+inline void GeometryPool::SetupInstanceAttributes(GLuint _vao, const InstancedVAO& _instanced) const
+{
+	SetupAttributes(_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, _instanced.instanceBuffer);
+	EnableInstanceAttributes(_instanced.format, _instanced.offset);
+}
+
+inline GLuint GeometryPool::GetInstancedVAO(GLuint _instanceBuffer, size_t _offset, InstanceFormat _format)
+{
+	for (const InstancedVAO& instanced : instancedVAOs)
+		if (instanced.instanceBuffer == _instanceBuffer && instanced.offset == _offset && instanced.format == _format)
+			return instanced.vao;
+
+	InstancedVAO instanced{ _instanceBuffer, _offset, _format, 0 };
+	glGenVertexArrays(1, &instanced.vao);
+	SetupInstanceAttributes(instanced.vao, instanced);
+	GLState::Get().BindVertexArray(0);
+	instancedVAOs.push_back(instanced);
+	return instanced.vao;
+}
+
+inline void GeometryPool::ReleaseInstanceBuffer(GLuint _instanceBuffer)
+{
+	for (VertexFormat format : { VertexFormat::Float32, VertexFormat::Packed }) {
+		std::vector<InstancedVAO>& cached = Get(format).instancedVAOs;
+		for (size_t i = 0; i < cached.size();)
+			if (cached[i].instanceBuffer == _instanceBuffer) {
+				GLState::Get().DeleteVertexArrays(1, &cached[i].vao);
+				cached[i] = cached.back();
+				cached.pop_back();
+			}
+			else {
+				i++;
+			}
+	}
+}
+
+inline GeometryPool::Stats GeometryPool::GetStats() const
+{
+	Stats stats;
+	stats.vertices = vertexAllocator.GetStats();
+	stats.indices = indexAllocator.GetStats();
+	stats.meshes = ranges.size() - freeHandles.size();
+	stats.grows = grows;
+	stats.compactions = compactions;
+	stats.copiedBytes = copiedBytes;
+	return stats;
+}
+
+inline bool GeometryPool::Validate() const
+{
+	if (!vertexAllocator.Validate() || !indexAllocator.Validate())
+		return false;
+	size_t live = 0;
+	for (const Range& range : ranges) {
+		if (range.vertexOffset == OffsetAllocator::invalid)
+			continue;
+		if (vertexAllocator.GetSize(range.vertexOffset) == 0 || indexAllocator.GetSize(range.indexOffset) == 0)
+			return false;
+		live++;
+	}
+	return live == ranges.size() - freeHandles.size() && live == vertexAllocator.GetStats().allocations
+		&& live == indexAllocator.GetStats().allocations;
+}
+
+inline std::ostream& operator<<(std::ostream& _stream, const GeometryPool::Stats& _stats)
+{
+	return _stream << _stats.meshes << " meshes, vertices " << _stats.vertices << ", indices " << _stats.indices << ", "
+		<< _stats.grows << " grows, " << _stats.compactions << " compactions, " << _stats.copiedBytes / 1024 << " KiB copied";
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstddef>
+#include <iostream>
+
+#include <GL/glew.h>
+
+// Shadow copy of the binding state the demos touch every frame: the current program, the vertex
+// array and the 2D/cube-map texture of each unit. Binds that match the shadow are skipped, so
+// callers can bind unconditionally without paying for a driver call. Everything must go through
+// GLState::Get() on the GL thread; after outside code binds behind its back, call Invalidate().
+class GLState
+{
+public:
+	static constexpr unsigned int maxTextureUnits = 32;
+	static constexpr GLuint unknown = ~0u;
+
+	// Issued and skipped calls per kind, since the last ResetCounters
+	struct Counters
+	{
+		size_t programIssued = 0, programSkipped = 0;
+		size_t vertexArrayIssued = 0, vertexArraySkipped = 0;
+		size_t textureIssued = 0, textureSkipped = 0;
+		size_t activeTextureIssued = 0, activeTextureSkipped = 0;
+
+		size_t GetIssued() const { return programIssued + vertexArrayIssued + textureIssued + activeTextureIssued; }
+		size_t GetSkipped() const { return programSkipped + vertexArraySkipped + textureSkipped + activeTextureSkipped; }
+	};
+
+	static GLState& Get()
+	{
+		static GLState state;
+		return state;
+	}
+
+	GLState(const GLState&) = delete;
+	GLState& operator=(const GLState&) = delete;
+
+	void UseProgram(GLuint _program)
+	{
+		if (Filter(program, _program, counters.programIssued, counters.programSkipped))
+			glUseProgram(_program);
+	}
+
+	void BindVertexArray(GLuint _vertexArray)
+	{
+		if (Filter(vertexArray, _vertexArray, counters.vertexArrayIssued, counters.vertexArraySkipped))
+			glBindVertexArray(_vertexArray);
+	}
+
+	void ActiveTexture(GLenum _unit)
+	{
+		if (Filter(activeUnit, _unit - GL_TEXTURE0, counters.activeTextureIssued, counters.activeTextureSkipped))
+			glActiveTexture(_unit);
+	}
+
+	// On the active unit. Targets other than 2D and cube map are passed through uncached
+	void BindTexture(GLenum _target, GLuint _texture)
+	{
+		int slot = _target == GL_TEXTURE_2D ? 0 : _target == GL_TEXTURE_CUBE_MAP ? 1 : -1;
+		if (slot < 0 || activeUnit >= maxTextureUnits) {
+			counters.textureIssued++;
+			glBindTexture(_target, _texture);
+			return;
+		}
+		if (Filter(textures[activeUnit][slot], _texture, counters.textureIssued, counters.textureSkipped))
+			glBindTexture(_target, _texture);
+	}
+
+	// Deleting an object unbinds it in GL; the shadow follows
+	void DeleteTextures(GLsizei _count, const GLuint* _textures)
+	{
+		for (GLsizei i = 0; i < _count; i++)
+			for (auto& unit : textures)
+				for (GLuint& bound : unit)
+					if (bound == _textures[i])
+						bound = 0;
+		glDeleteTextures(_count, _textures);
+	}
+
+	void DeleteVertexArrays(GLsizei _count, const GLuint* _vertexArrays)
+	{
+		for (GLsizei i = 0; i < _count; i++)
+			if (vertexArray == _vertexArrays[i])
+				vertexArray = 0;
+		glDeleteVertexArrays(_count, _vertexArrays);
+	}
+
+	// A deleted program stays in use until another one is, so the shadow just forgets it
+	void DeleteProgram(GLuint _program)
+	{
+		if (program == _program)
+			program = unknown;
+		glDeleteProgram(_program);
+	}
+
+	// Forget everything; the next bind of each kind is issued
+	void Invalidate()
+	{
+		program = unknown;
+		vertexArray = unknown;
+		activeUnit = unknown;
+		for (auto& unit : textures)
+			unit[0] = unit[1] = unknown;
+	}
+
+	// When false, draws leave their vertex array bound instead of restoring 0 afterwards; the next
+	// draw of the same mesh then needs no bind at all. Only safe if nobody binds an element array
+	// buffer without binding their own vertex array first.
+	void SetUnbindAfterDraw(bool _unbind) { unbindAfterDraw = _unbind; }
+	bool GetUnbindAfterDraw() const { return unbindAfterDraw; }
+
+	// For draw code that would restore 0 when finished
+	void EndDraw()
+	{
+		if (unbindAfterDraw)
+			BindVertexArray(0);
+	}
+
+	const Counters& GetCounters() const { return counters; }
+	void ResetCounters() { counters = Counters(); }
+
+private:
+	GLState() { Invalidate(); }
+
+	// Returns true when the call has to reach the driver
+	static bool Filter(GLuint& _shadow, GLuint _value, size_t& _issued, size_t& _skipped)
+	{
+		if (_shadow == _value) {
+			_skipped++;
+			return false;
+		}
+		_shadow = _value;
+		_issued++;
+		return true;
+	}
+
+	GLuint program = unknown;
+	GLuint vertexArray = unknown;
+	GLuint activeUnit = unknown;
+	GLuint textures[maxTextureUnits][2];
+	bool unbindAfterDraw = true;
+	Counters counters;
+};
+
+inline std::ostream& operator<<(std::ostream& _stream, const GLState::Counters& _counters)
+{
+	return _stream << _counters.GetIssued() << " binds issued, " << _counters.GetSkipped() << " skipped (program "
+		<< _counters.programIssued << "/" << _counters.programSkipped << ", VAO " << _counters.vertexArrayIssued << "/"
+		<< _counters.vertexArraySkipped << ", texture " << _counters.textureIssued << "/" << _counters.textureSkipped
+		<< ", active unit " << _counters.activeTextureIssued << "/" << _counters.activeTextureSkipped << ")";
+}
@@ -0,0 +1,498 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "frustum.h"
+#include "gl_state.h"
+#include "instance_buffer.h"
+#include "instance_format.h"
+#include "mesh_cache.h"
+#include "model.h"
+#include "shader.h"
+
+// Frames per side of the atlas, and pixels per side of a frame
+struct ImpostorSettings
+{
+	unsigned int gridSize = 16;
+	unsigned int frameResolution = 64;
+};
+
+// Octahedral impostor of a model: gridSize^2 orthographic views of its bounding sphere from directions spread
+// over the sphere by an octahedral map, tiled into two RGBA8 atlases, albedo with coverage in alpha and the
+// model-space normal with depth in alpha. Baking renders into its own framebuffer and needs nothing but a
+// GL 3.3 context, so it runs headless on software GL as well; Save/Load keep the result next to the asset.
+// DrawInstanced draws instances of any InstanceFormat with impostor.vs/.fs as camera-facing quads showing
+// the frame nearest to the direction they are seen from, with the baked depth written per fragment.
+class ImpostorAtlas
+{
+public:
+	static constexpr uint32_t version = 2;
+	static constexpr int dilationPasses = 8;  // Texels of color grown into the empty space around each frame
+
+	ImpostorAtlas() = default;
+	~ImpostorAtlas() { Release(); }
+
+	ImpostorAtlas(const ImpostorAtlas&) = delete;
+	ImpostorAtlas& operator=(const ImpostorAtlas&) = delete;
+
+	// Render every frame of _model at full detail into a new atlas; false if the framebuffer is incomplete
+	bool Bake(Model& _model, const ImpostorSettings& _settings = ImpostorSettings());
+
+	// The saved atlas of _assetPath if its GetCacheKey and settings still match, otherwise bake _model
+	// (loaded from _assetPath) and save it
+	bool LoadOrBake(const std::string& _assetPath, Model& _model, const ImpostorSettings& _settings = ImpostorSettings());
+
+	// Read both atlases back (a pipeline stall) and write them; returns false (and leaves no partial file behind) on failure
+	bool Save(const std::string& _path, uint64_t _cacheKey) const;
+	// Fails on a missing file, another version, or another _cacheKey or *_settings when those are given, and on a header
+	// whose atlas is larger than GL_MAX_TEXTURE_SIZE or doesn't match the file's size
+	bool Load(const std::string& _path, uint64_t _cacheKey = 0, const ImpostorSettings* _settings = nullptr);
+
+	// One file per _cacheKey, so atlases for other import options or bake shaders don't overwrite each other
+	static std::string GetCachePath(const std::string& _assetPath, uint64_t _cacheKey)
+	{
+		char key[24];
+		std::snprintf(key, sizeof(key), ".%016llx", static_cast<unsigned long long>(_cacheKey));
+		return _assetPath + key + ".impostor";
+	}
+	// Everything the baked pixels depend on besides the settings: the asset file, the options it was imported
+	// with and the bake shaders. 0 if the asset can't be read
+	static uint64_t GetCacheKey(const std::string& _assetPath, const ModelOptions& _options);
+
+	// Draw _count instances from _firstInstance on, from _instanceBuffer's last write (attribute locations 3 on)
+	void DrawInstanced(Shader& _shader, const InstanceBuffer& _instanceBuffer, unsigned int _count, InstanceFormat _format,
+		unsigned int _firstInstance = 0)
+	{
+		DrawInstanced(_shader, _instanceBuffer.GetID(), _instanceBuffer.GetOffset(), _count, _format, _firstInstance);
+	}
+
+	// Same, from instances at _offset in any vertex buffer. The shader also needs projection, view, cameraPosition
+	// and, for Quantized instances, instanceOffset/instanceExtent
+	void DrawInstanced(Shader& _shader, GLuint _instanceBuffer, size_t _offset, unsigned int _count, InstanceFormat _format,
+		unsigned int _firstInstance = 0);
+
+	// Direction of frame (_column, _row) from the center towards its viewer, in model space
+	glm::vec3 GetFrameAxis(unsigned int _column, unsigned int _row) const;
+
+	bool IsValid() const { return albedo != 0; }
+	const ImpostorSettings& GetSettings() const { return settings; }
+	const BoundingSphere& GetBounds() const { return bounds; }
+	unsigned int GetSize() const { return settings.gridSize * settings.frameResolution; }  // Pixels per side
+	GLuint GetAlbedo() const { return albedo; }
+	GLuint GetNormalDepth() const { return normalDepth; }
+	float GetCoverage() const { return coverage; }  // Fraction of the atlas the model covers
+	double GetBakeMs() const { return bakeMs; }     // Of the last Bake, readback and dilation included
+
+private:
+	struct ImpostorFileHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t cacheKey;
+		uint32_t gridSize;
+		uint32_t frameResolution;
+		float bounds[4];  // center, radius
+	};
+
+	// Octahedral map of [-1, 1]^2 onto the unit sphere, +y at the center and -y at the corners (OctDecode in impostor.vs)
+	static glm::vec3 OctDecode(glm::vec2 _e)
+	{
+		glm::vec3 n(_e.x, 1.0f - std::abs(_e.x) - std::abs(_e.y), _e.y);
+		if (n.y < 0.0f) {
+			glm::vec2 folded = (1.0f - glm::abs(glm::vec2(n.z, n.x))) * glm::vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.z >= 0.0f ? 1.0f : -1.0f);
+			n.x = folded.x;
+			n.z = folded.y;
+		}
+		return glm::normalize(n);
+	}
+
+	// Up vector of a frame's camera, away from the poles where +y would be parallel to the view
+	static glm::vec3 GetFrameUp(const glm::vec3& _axis)
+	{
+		return std::abs(_axis.y) > 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	}
+
+	// (Re)allocate both atlases, with _albedo/_normalDepth as level 0 and their mipmaps if given
+	void CreateTextures(const unsigned char* _albedo, const unsigned char* _normalDepth);
+	void ReadTexture(GLuint _texture, std::vector<unsigned char>& _pixels) const;
+
+	// Grow the colors of covered texels into the empty ones around them, within each frame, so the mipmaps
+	// don't fade the silhouette towards the clear color. Coverage (albedo alpha) stays as baked
+	void Dilate(std::vector<unsigned char>& _albedo, std::vector<unsigned char>& _normalDepth) const;
+
+	static constexpr const char* bakeVertexPath = "res/shaders/impostor_bake.vs";
+	static constexpr const char* bakeFragmentPath = "res/shaders/impostor_bake.fs";
+
+	// DrawInstanced's uniforms, resolved again when it is given another program
+	struct DrawUniforms
+	{
+		GLuint program = 0;
+		Shader::Uniform bounds, gridSize, format;
+	};
+
+	void Release()
+	{
+		GLuint textures[2] = { albedo, normalDepth };
+		if (albedo)
+			GLState::Get().DeleteTextures(2, textures);
+		if (vertexArray)
+			GLState::Get().DeleteVertexArrays(1, &vertexArray);
+		albedo = normalDepth = vertexArray = 0;
+	}
+
+	ImpostorSettings settings;
+	BoundingSphere bounds;
+	GLuint albedo = 0, normalDepth = 0;
+	GLuint vertexArray = 0;  // Instance attributes only; the quad comes from gl_VertexID
+	DrawUniforms drawUniforms;
+	float coverage = 0.0f;
+	double bakeMs = 0.0;
+};
+
+inline glm::vec3 ImpostorAtlas::GetFrameAxis(unsigned int _column, unsigned int _row) const
+{
+	const float last = static_cast<float>(settings.gridSize - 1);
+	return OctDecode(glm::vec2(_column, _row) / last * 2.0f - 1.0f);
+}
+
+inline bool ImpostorAtlas::Bake(Model& _model, const ImpostorSettings& _settings)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	Release();
+	settings = _settings;
+	settings.gridSize = std::max(settings.gridSize, 2u);
+	bounds = _model.GetBoundingSphere();
+	const GLsizei size = static_cast<GLsizei>(GetSize());
+	const GLsizei resolution = static_cast<GLsizei>(settings.frameResolution);
+	CreateTextures(nullptr, nullptr);
+
+	// The caller's framebuffer, viewport and the state the bake changes are put back afterwards
+	GLint previousFramebuffer = 0, previousViewport[4];
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+	glGetIntegerv(GL_VIEWPORT, previousViewport);
+	const GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST), blend = glIsEnabled(GL_BLEND), scissorTest = glIsEnabled(GL_SCISSOR_TEST);
+
+	GLuint framebuffer = 0, depth = 0;
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedo, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalDepth, 0);
+	glGenRenderbuffers(1, &depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+	const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, drawBuffers);
+
+	const bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	if (complete) {
+		glEnable(GL_DEPTH_TEST);
+		glDisable(GL_BLEND);
+		glDisable(GL_SCISSOR_TEST);
+		// Uncovered: no albedo, and a zero normal at the depth of the frame's plane
+		const GLfloat clearAlbedo[4] = { 0.0f, 0.0f, 0.0f, 0.0f }, clearNormalDepth[4] = { 0.5f, 0.5f, 0.5f, 0.5f }, clearDepth = 1.0f;
+		glClearBufferfv(GL_COLOR, 0, clearAlbedo);
+		glClearBufferfv(GL_COLOR, 1, clearNormalDepth);
+		glClearBufferfv(GL_DEPTH, 0, &clearDepth);
+
+		Shader bakeShader(bakeVertexPath, bakeFragmentPath);
+		bakeShader.Bind();
+		Shader::Uniform viewProjection = bakeShader.GetUniform("viewProjection");
+		Shader::Uniform frameAxis = bakeShader.GetUniform("frameAxis");
+		bakeShader.SetVec4(bakeShader.GetUniform("bounds"), glm::vec4(bounds.center, bounds.radius));
+
+		// The camera a little outside the sphere, so nothing on it is clipped by the near or far plane
+		const float radius = bounds.radius, distance = 1.01f * radius;
+		const glm::mat4 projection = glm::ortho(-radius, radius, -radius, radius, 0.0f, 2.0f * distance);
+		for (unsigned int row = 0; row < settings.gridSize; row++)
+			for (unsigned int column = 0; column < settings.gridSize; column++) {
+				glm::vec3 axis = GetFrameAxis(column, row);
+				glm::mat4 view = glm::lookAt(bounds.center + distance * axis, bounds.center, GetFrameUp(axis));
+				glViewport(column * resolution, row * resolution, resolution, resolution);
+				bakeShader.SetMat4(viewProjection, projection * view);
+				bakeShader.SetVec3(frameAxis, axis);
+				_model.Draw(bakeShader);
+			}
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+	glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+	depthTest ? glEnable(GL_DEPTH_TEST) : glDisable(GL_DEPTH_TEST);
+	blend ? glEnable(GL_BLEND) : glDisable(GL_BLEND);
+	scissorTest ? glEnable(GL_SCISSOR_TEST) : glDisable(GL_SCISSOR_TEST);
+	glDeleteRenderbuffers(1, &depth);
+	glDeleteFramebuffers(1, &framebuffer);
+	if (!complete) {
+#ifdef _DEBUG
+		std::cout << "ImpostorAtlas: the bake framebuffer is incomplete\n";
+#endif
+		Release();
+		return false;
+	}
+
+	std::vector<unsigned char> albedoPixels, normalDepthPixels;
+	ReadTexture(albedo, albedoPixels);
+	ReadTexture(normalDepth, normalDepthPixels);
+	size_t covered = 0;
+	for (size_t i = 3; i < albedoPixels.size(); i += 4)
+		covered += albedoPixels[i] != 0;
+	coverage = static_cast<float>(covered) / (static_cast<float>(size) * size);
+	Dilate(albedoPixels, normalDepthPixels);
+	CreateTextures(albedoPixels.data(), normalDepthPixels.data());
+
+	bakeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	return true;
+}
+
+inline bool ImpostorAtlas::LoadOrBake(const std::string& _assetPath, Model& _model, const ImpostorSettings& _settings)
+{
+	const uint64_t cacheKey = GetCacheKey(_assetPath, _model.GetOptions());
+	const std::string cachePath = GetCachePath(_assetPath, cacheKey);
+	if (Load(cachePath, cacheKey, &_settings))
+		return true;
+	if (!Bake(_model, _settings))
+		return false;
+	if (!Save(cachePath, cacheKey)) {
+#ifdef _DEBUG
+		std::cout << "ImpostorAtlas: failed to write " << cachePath << "\n";
+#endif
+	}
+	return true;
+}
+
+inline uint64_t ImpostorAtlas::GetCacheKey(const std::string& _assetPath, const ModelOptions& _options)
+{
+	const uint64_t sourceHash = MeshCache::HashFile(_assetPath);
+	if (sourceHash == 0)
+		return 0;
+
+	// FNV-1a over the parts, as MeshCache::HashFile does over a file's bytes
+	const uint64_t parts[5] = { sourceHash, _options.GetProcessFlags(), static_cast<uint64_t>(_options.vertexFormat),
+		MeshCache::HashFile(bakeVertexPath), MeshCache::HashFile(bakeFragmentPath) };
+	uint64_t key = 14695981039346656037ull;
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(parts);
+	for (size_t i = 0; i < sizeof(parts); i++) {
+		key ^= bytes[i];
+		key *= 1099511628211ull;
+	}
+	return key;
+}
+
+inline bool ImpostorAtlas::Save(const std::string& _path, uint64_t _cacheKey) const
+{
+	if (!IsValid())
+		return false;
+	const std::string tempPath = _path + ".tmp";
+	std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+	if (!out.is_open())
+		return false;
+
+	ImpostorFileHeader header;
+	std::memcpy(header.magic, "AIMP", 4);
+	header.version = version;
+	header.cacheKey = _cacheKey;
+	header.gridSize = settings.gridSize;
+	header.frameResolution = settings.frameResolution;
+	header.bounds[0] = bounds.center.x;
+	header.bounds[1] = bounds.center.y;
+	header.bounds[2] = bounds.center.z;
+	header.bounds[3] = bounds.radius;
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	std::vector<unsigned char> pixels;
+	for (GLuint texture : { albedo, normalDepth }) {
+		ReadTexture(texture, pixels);
+		out.write(reinterpret_cast<const char*>(pixels.data()), pixels.size());
+	}
+	out.close();
+
+	std::error_code ec;
+	if (!out) {
+		std::filesystem::remove(tempPath, ec);
+		return false;
+	}
+	std::filesystem::rename(tempPath, _path, ec);
+	if (ec) {
+		std::filesystem::remove(tempPath, ec);
+		return false;
+	}
+	return true;
+}
+
+inline bool ImpostorAtlas::Load(const std::string& _path, uint64_t _cacheKey, const ImpostorSettings* _settings)
+{
+	std::ifstream in(_path, std::ios::binary);
+	if (!in.is_open())
+		return false;
+
+	ImpostorFileHeader header;
+	if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, "AIMP", 4) != 0
+		|| header.version != version || header.gridSize < 2 || header.frameResolution == 0)
+		return false;
+	if (_cacheKey != 0 && header.cacheKey != _cacheKey)
+		return false;
+	if (_settings && (header.gridSize != _settings->gridSize || header.frameResolution != _settings->frameResolution))
+		return false;
+
+	// Bound the header before sizing anything by it: the atlas has to fit a texture and the file has to hold both of them
+	GLint maxTextureSize = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+	const uint64_t size = static_cast<uint64_t>(header.gridSize) * header.frameResolution;
+	if (size > static_cast<uint64_t>(maxTextureSize))
+		return false;
+	const size_t bytes = static_cast<size_t>(size * size * 4);
+	std::error_code ec;
+	const uintmax_t fileSize = std::filesystem::file_size(_path, ec);
+	if (ec || fileSize != sizeof(header) + 2 * static_cast<uintmax_t>(bytes))
+		return false;
+
+	std::vector<unsigned char> albedoPixels(bytes), normalDepthPixels(bytes);
+	if (!in.read(reinterpret_cast<char*>(albedoPixels.data()), bytes) || !in.read(reinterpret_cast<char*>(normalDepthPixels.data()), bytes))
+		return false;
+
+	Release();
+	settings.gridSize = header.gridSize;
+	settings.frameResolution = header.frameResolution;
+	bounds.center = glm::vec3(header.bounds[0], header.bounds[1], header.bounds[2]);
+	bounds.radius = header.bounds[3];
+	size_t covered = 0;
+	for (size_t i = 3; i < bytes; i += 4)
+		covered += albedoPixels[i] != 0;
+	coverage = static_cast<float>(covered) / (bytes / 4);
+	CreateTextures(albedoPixels.data(), normalDepthPixels.data());
+	return true;
+}
+
+inline void ImpostorAtlas::DrawInstanced(Shader& _shader, GLuint _instanceBuffer, size_t _offset, unsigned int _count,
+	InstanceFormat _format, unsigned int _firstInstance)
+{
+	if (_count == 0 || !IsValid())
+		return;
+	if (!vertexArray)
+		glGenVertexArrays(1, &vertexArray);
+
+	GLState::Get().ActiveTexture(GL_TEXTURE0);
+	GLState::Get().BindTexture(GL_TEXTURE_2D, albedo);
+	GLState::Get().ActiveTexture(GL_TEXTURE1);
+	GLState::Get().BindTexture(GL_TEXTURE_2D, normalDepth);
+	if (drawUniforms.program != _shader.GetID()) {
+		drawUniforms.program = _shader.GetID();
+		drawUniforms.bounds = _shader.GetUniform("impostorBounds");
+		drawUniforms.gridSize = _shader.GetUniform("impostorGridSize");
+		drawUniforms.format = _shader.GetUniform("instanceFormat");
+		// The texture units never change, so the samplers are set once per program
+		_shader.SetInt(_shader.GetUniform("impostorAlbedo"), 0);
+		_shader.SetInt(_shader.GetUniform("impostorNormalDepth"), 1);
+	}
+	_shader.SetVec4(drawUniforms.bounds, glm::vec4(bounds.center, bounds.radius));
+	_shader.SetFloat(drawUniforms.gridSize, static_cast<float>(settings.gridSize));
+	_shader.SetInt(drawUniforms.format, static_cast<int>(_format));
+
+	// The shader declares the attributes of every format, so whatever the last format left enabled goes first;
+	// with its stride, it could read past the end of the buffer
+	GLState::Get().BindVertexArray(vertexArray);
+	glBindBuffer(GL_ARRAY_BUFFER, _instanceBuffer);
+	for (GLuint location = 3; location < 7; location++)
+		glDisableVertexAttribArray(location);
+	EnableInstanceAttributes(_format, _offset + _firstInstance * GetInstanceStride(_format));
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(_count));
+	GLState::Get().EndDraw();
+}
+
+inline void ImpostorAtlas::CreateTextures(const unsigned char* _albedo, const unsigned char* _normalDepth)
+{
+	const GLsizei size = static_cast<GLsizei>(GetSize());
+	if (!albedo) {
+		GLuint textures[2];
+		glGenTextures(2, textures);
+		albedo = textures[0];
+		normalDepth = textures[1];
+	}
+	const GLuint textures[2] = { albedo, normalDepth };
+	const unsigned char* pixels[2] = { _albedo, _normalDepth };
+	GLState::Get().ActiveTexture(GL_TEXTURE0);
+	for (int i = 0; i < 2; i++) {
+		GLState::Get().BindTexture(GL_TEXTURE_2D, textures[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels[i]);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		if (pixels[i]) {
+			// Down to a texel per frame; below, the frames would blend into each other
+			int maxLevel = 0;
+			while ((2u << maxLevel) <= settings.frameResolution)
+				maxLevel++;
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, maxLevel);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			glGenerateMipmap(GL_TEXTURE_2D);
+		}
+		else {
+			// Still a render target; complete without mipmaps
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		}
+	}
+}
+
+inline void ImpostorAtlas::ReadTexture(GLuint _texture, std::vector<unsigned char>& _pixels) const
+{
+	_pixels.resize(static_cast<size_t>(GetSize()) * GetSize() * 4);
+	GLState::Get().ActiveTexture(GL_TEXTURE0);
+	GLState::Get().BindTexture(GL_TEXTURE_2D, _texture);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, _pixels.data());
+}
+
+inline void ImpostorAtlas::Dilate(std::vector<unsigned char>& _albedo, std::vector<unsigned char>& _normalDepth) const
+{
+	const int size = static_cast<int>(GetSize()), resolution = static_cast<int>(settings.frameResolution);
+	// Texels that have a color, baked or grown; a pass only reads the previous pass's
+	std::vector<uint8_t> filled(static_cast<size_t>(size) * size), next;
+	for (size_t i = 0; i < filled.size(); i++)
+		filled[i] = _albedo[i * 4 + 3] != 0;
+
+	for (int pass = 0; pass < dilationPasses; pass++) {
+		next = filled;
+		for (int y = 0; y < size; y++)
+			for (int x = 0; x < size; x++) {
+				const size_t texel = static_cast<size_t>(y) * size + x;
+				if (filled[texel])
+					continue;
+				// Average of the filled 8-neighbours in the same frame
+				const int frameX = x / resolution * resolution, frameY = y / resolution * resolution;
+				int sum[7] = {}, count = 0;
+				for (int ny = std::max(y - 1, frameY); ny <= std::min(y + 1, frameY + resolution - 1); ny++)
+					for (int nx = std::max(x - 1, frameX); nx <= std::min(x + 1, frameX + resolution - 1); nx++) {
+						const size_t neighbour = static_cast<size_t>(ny) * size + nx;
+						if (!filled[neighbour])
+							continue;
+						for (int c = 0; c < 3; c++)
+							sum[c] += _albedo[neighbour * 4 + c];
+						for (int c = 0; c < 4; c++)
+							sum[3 + c] += _normalDepth[neighbour * 4 + c];
+						count++;
+					}
+				if (count == 0)
+					continue;
+				for (int c = 0; c < 3; c++)
+					_albedo[texel * 4 + c] = static_cast<unsigned char>(sum[c] / count);
+				for (int c = 0; c < 4; c++)
+					_normalDepth[texel * 4 + c] = static_cast<unsigned char>(sum[3 + c] / count);
+				next[texel] = 1;
+			}
+		filled.swap(next);
+	}
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "vertex_format.h"
+
+// 16-bit index buffers for meshes of any size. A mesh is drawn as one or more clusters, each
+// a contiguous run of triangles whose vertices lie in [baseVertex, baseVertex + 65535), so every
+// cluster stores uint16 indices relative to its base vertex and is drawn with glDrawElementsBaseVertex.
+
+// Largest vertex count one cluster may reference with 16-bit indices
+constexpr size_t maxShortIndexVertices = 65535;
+
+struct IndexCluster
+{
+	unsigned int firstIndex; // Offset into the index buffer, in indices
+	unsigned int indexCount;
+	unsigned int baseVertex;
+};
+
+// Split a triangle list into clusters referencing at most _maxVertices vertices each.
+// When the mesh already fits, nothing changes and a single cluster is returned. Otherwise the
+// vertices are rewritten so each cluster's vertices are contiguous (vertices shared across a
+// cluster border are duplicated) and _indices are remapped to the new array. Triangle order is kept.
+inline std::vector<IndexCluster> SplitIndexClusters(std::vector<Vertex>& _vertices, std::vector<unsigned int>& _indices,
+	size_t _maxVertices = maxShortIndexVertices)
+{
+	if (_vertices.size() <= _maxVertices)
+		return { IndexCluster{ 0, static_cast<unsigned int>(_indices.size()), 0 } };
+
+	std::vector<IndexCluster> clusters;
+	std::vector<Vertex> result;
+	result.reserve(_vertices.size());
+
+	// clusterSlot[v] is the new index of v if clusterStamp[v] says it was added to the current cluster
+	std::vector<unsigned int> clusterSlot(_vertices.size());
+	std::vector<unsigned int> clusterStamp(_vertices.size(), ~0u);
+
+	IndexCluster current{ 0, 0, 0 };
+	unsigned int stamp = 0;
+	for (size_t t = 0; t + 2 < _indices.size(); t += 3) {
+		unsigned int newVertices = 0;
+		for (size_t k = 0; k < 3; k++)
+			if (clusterStamp[_indices[t + k]] != stamp)
+				newVertices++;
+
+		// Close the cluster when this triangle would push it over the limit
+		if (result.size() - current.baseVertex + newVertices > _maxVertices) {
+			clusters.push_back(current);
+			current = IndexCluster{ static_cast<unsigned int>(t), 0, static_cast<unsigned int>(result.size()) };
+			stamp++;
+		}
+
+		for (size_t k = 0; k < 3; k++) {
+			unsigned int& index = _indices[t + k];
+			if (clusterStamp[index] != stamp) {
+				clusterStamp[index] = stamp;
+				clusterSlot[index] = static_cast<unsigned int>(result.size());
+				result.push_back(_vertices[index]);
+			}
+			index = clusterSlot[index];
+		}
+		current.indexCount += 3;
+	}
+	clusters.push_back(current);
+
+	_vertices.swap(result);
+	return clusters;
+}
+
+// Cluster-relative 16-bit copy of the index list
+inline std::vector<uint16_t> BuildShortIndices(const std::vector<unsigned int>& _indices, const std::vector<IndexCluster>& _clusters)
+{
+	std::vector<uint16_t> shortIndices(_indices.size());
+	for (const IndexCluster& cluster : _clusters)
+		for (unsigned int i = cluster.firstIndex; i < cluster.firstIndex + cluster.indexCount; i++)
+			shortIndices[i] = static_cast<uint16_t>(_indices[i] - cluster.baseVertex);
+	return shortIndices;
+}
+
+// De-indexed triangle positions, snapshotted before SplitIndexClusters rewrites the vertices and indices
+inline std::vector<glm::vec3> GatherTrianglePositions(const std::vector<Vertex>& _vertices, const std::vector<unsigned int>& _indices)
+{
+	std::vector<glm::vec3> positions(_indices.size());
+	for (size_t i = 0; i < _indices.size(); i++)
+		positions[i] = _vertices[_indices[i]].position;
+	return positions;
+}
+
+// Check that drawing the 16-bit clusters over the split vertices reproduces the source triangles,
+// given as GatherTrianglePositions of the mesh before it was split
+inline bool VerifyShortIndices(const std::vector<glm::vec3>& _sourceTriangles, const std::vector<Vertex>& _vertices,
+	const std::vector<uint16_t>& _shortIndices, const std::vector<IndexCluster>& _clusters)
+{
+	if (_shortIndices.size() != _sourceTriangles.size())
+		return false;
+
+	size_t covered = 0;
+	for (const IndexCluster& cluster : _clusters) {
+		if (cluster.firstIndex != covered)
+			return false;
+		for (unsigned int i = cluster.firstIndex; i < cluster.firstIndex + cluster.indexCount; i++) {
+			size_t vertex = static_cast<size_t>(_shortIndices[i]) + cluster.baseVertex;
+			if (vertex >= _vertices.size() || _vertices[vertex].position != _sourceTriangles[i])
+				return false;
+		}
+		covered += cluster.indexCount;
+	}
+	return covered == _sourceTriangles.size();
+}
@@ -0,0 +1,261 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <GL/glew.h>
+
+#include "gl_state.h"
+#include "mesh.h"
+#include "model.h"
+#include "shader.h"
+
+// Layout glMultiDrawElementsIndirect reads from GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// Whole models submitted as one indirect draw per material instead of one draw per mesh.
+// Every mesh lives in the geometry pool of its format, so all of them share one VAO and index buffer
+// and differ only in firstIndex/baseVertex. The per-draw model matrices go into one buffer read as
+// the per-instance mat4 at locations 3-6; each command's baseInstance points at its own matrices, so
+// the vertex shader needs no draw id (aInstanceMatrix, as in instancing_rock.vs).
+// Commands are grouped by pool and texture set, since textures can only change between draws.
+//
+// GL 3.3 has no indirect draws, so Execute picks the best path the context offers:
+//   MultiDrawIndirect    glMultiDrawElementsIndirect, one call per group (GL 4.3 / ARB_multi_draw_indirect)
+//   BaseInstance         glDrawElementsInstancedBaseVertexBaseInstance per command (GL 4.2 / ARB_base_instance)
+//   AttributeOffset      the matrix attribute re-pointed at each command's matrices, then an instanced draw
+class IndirectDrawList
+{
+public:
+	enum class Path { MultiDrawIndirect, BaseInstance, AttributeOffset };
+
+	struct Stats
+	{
+		size_t commands = 0;  // one per index cluster and model
+		size_t groups = 0;    // runs sharing pool and textures
+		size_t drawCalls = 0; // API calls issued by the last Execute
+	};
+
+	IndirectDrawList()
+	{
+		glGenBuffers(1, &drawDataBuffer);
+		glGenBuffers(1, &commandBuffer);
+		if (GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect)
+			path = Path::MultiDrawIndirect;
+		else if (GLEW_VERSION_4_2 || GLEW_ARB_base_instance)
+			path = Path::BaseInstance;
+	}
+
+	~IndirectDrawList()
+	{
+		GeometryPool::ReleaseInstanceBuffer(drawDataBuffer);
+		glDeleteBuffers(1, &drawDataBuffer);
+		glDeleteBuffers(1, &commandBuffer);
+	}
+
+	IndirectDrawList(const IndirectDrawList&) = delete;
+	IndirectDrawList& operator=(const IndirectDrawList&) = delete;
+
+	// Draw every mesh of _model once per matrix in _instances
+	void AddModel(const Model& _model, const std::vector<glm::mat4>& _instances)
+	{
+		for (const Mesh& mesh : _model.meshes)
+			AddMesh(mesh, _instances);
+	}
+
+	void AddModel(const Model& _model, const glm::mat4& _transform) { AddModel(_model, std::vector<glm::mat4>{ _transform }); }
+
+	void AddMesh(const Mesh& _mesh, const std::vector<glm::mat4>& _instances);
+
+	// Start over; the buffers are kept and reused
+	void Clear()
+	{
+		entries.clear();
+		drawData.clear();
+		dirty = true;
+	}
+
+	// Bind each group's mesh textures unless _bindTextures is false (shaders that sample only
+	// what the caller bound), then draw everything. The caller binds _shader and sets its uniforms.
+	void Execute(const Shader& _shader, bool _bindTextures = true);
+
+	// Forced path, for comparing them; a path the context lacks falls back to AttributeOffset
+	void SetPath(Path _path)
+	{
+		path = _path;
+		dirty = true;
+	}
+	Path GetPath() const { return path; }
+	static const char* GetPathName(Path _path)
+	{
+		return _path == Path::MultiDrawIndirect ? "multi-draw indirect" : _path == Path::BaseInstance ? "base instance" : "attribute offset";
+	}
+
+	const Stats& GetStats() const { return stats; }
+
+private:
+	struct Entry
+	{
+		const Mesh* mesh;
+		size_t cluster;
+		uint64_t group;           // pool format : 32 | texture set : 32
+		GLuint instanceCount, baseInstance;
+	};
+
+	void Upload();
+
+	std::vector<Entry> entries;
+	std::vector<glm::mat4> drawData;   // by baseInstance
+	std::vector<DrawElementsIndirectCommand> commands; // sorted by group, as uploaded
+	std::vector<std::pair<size_t, size_t>> groups;     // first command, count
+	std::map<std::vector<unsigned int>, uint32_t> materialIds;
+	GLuint drawDataBuffer = 0, commandBuffer = 0;
+	size_t drawDataCapacity = 0, commandCapacity = 0;   // in bytes
+	bool dirty = true;
+	size_t poolGenerations[2] = {};                    // of the Float32 and Packed pools at the last Upload
+	Path path = Path::AttributeOffset;
+	Stats stats;
+};
+
+inline void IndirectDrawList::AddMesh(const Mesh& _mesh, const std::vector<glm::mat4>& _instances)
+{
+	if (_instances.empty())
+		return;
+
+	std::vector<unsigned int> textures;
+	for (const Texture& texture : _mesh.textures)
+		textures.push_back(texture.id);
+	auto material = materialIds.emplace(std::move(textures), static_cast<uint32_t>(materialIds.size())).first->second;
+
+	const GLuint baseInstance = static_cast<GLuint>(drawData.size());
+	drawData.insert(drawData.end(), _instances.begin(), _instances.end());
+
+	for (size_t cluster = 0; cluster < _mesh.GetIndexClusters().size(); cluster++) {
+		Entry entry;
+		entry.mesh = &_mesh;
+		entry.cluster = cluster;
+		entry.group = static_cast<uint64_t>(_mesh.GetVertexFormat()) << 32 | material;
+		entry.instanceCount = static_cast<GLuint>(_instances.size());
+		entry.baseInstance = baseInstance;
+		entries.push_back(entry);
+	}
+	dirty = true;
+}
+
+// Sort by group and upload commands and matrices; the buffers only grow. The pool offsets are read
+// here, so the commands follow meshes the pools moved since they were added.
+inline void IndirectDrawList::Upload()
+{
+	std::stable_sort(entries.begin(), entries.end(), [](const Entry& _a, const Entry& _b) { return _a.group < _b.group; });
+	commands.clear();
+	groups.clear();
+	for (size_t i = 0; i < entries.size(); i++) {
+		if (i == 0 || entries[i].group != entries[i - 1].group)
+			groups.emplace_back(i, 0);
+		groups.back().second++;
+
+		const Entry& entry = entries[i];
+		const GeometryPool& pool = entry.mesh->GetPool();
+		const IndexCluster& cluster = entry.mesh->GetIndexClusters()[entry.cluster];
+		DrawElementsIndirectCommand command;
+		command.count = cluster.indexCount;
+		command.instanceCount = entry.instanceCount;
+		command.firstIndex = pool.GetFirstIndex(entry.mesh->GetGeometry()) + cluster.firstIndex;
+		command.baseVertex = pool.GetBaseVertex(entry.mesh->GetGeometry()) + static_cast<GLint>(cluster.baseVertex);
+		command.baseInstance = entry.baseInstance;
+		commands.push_back(command);
+	}
+	poolGenerations[0] = GeometryPool::Get(VertexFormat::Float32).GetGeneration();
+	poolGenerations[1] = GeometryPool::Get(VertexFormat::Packed).GetGeneration();
+
+	auto upload = [](GLenum _target, GLuint _buffer, size_t& _capacity, const void* _data, size_t _bytes) {
+		glBindBuffer(_target, _buffer);
+		if (_bytes > _capacity) {
+			_capacity = std::max(_bytes, _capacity * 2);
+			glBufferData(_target, _capacity, nullptr, GL_DYNAMIC_DRAW);
+		}
+		glBufferSubData(_target, 0, _bytes, _data);
+		glBindBuffer(_target, 0);
+	};
+	upload(GL_ARRAY_BUFFER, drawDataBuffer, drawDataCapacity, drawData.data(), drawData.size() * sizeof(glm::mat4));
+	if (path == Path::MultiDrawIndirect)
+		upload(GL_DRAW_INDIRECT_BUFFER, commandBuffer, commandCapacity, commands.data(), commands.size() * sizeof(DrawElementsIndirectCommand));
+	dirty = false;
+}
+
+inline void IndirectDrawList::Execute(const Shader& _shader, bool _bindTextures)
+{
+	if ((path == Path::MultiDrawIndirect && !glMultiDrawElementsIndirect)
+		|| (path == Path::BaseInstance && !glDrawElementsInstancedBaseVertexBaseInstance))
+		path = Path::AttributeOffset;
+	if (dirty || poolGenerations[0] != GeometryPool::Get(VertexFormat::Float32).GetGeneration()
+		|| poolGenerations[1] != GeometryPool::Get(VertexFormat::Packed).GetGeneration())
+		Upload();
+
+	stats = Stats();
+	stats.commands = commands.size();
+	stats.groups = groups.size();
+	if (commands.empty())
+		return;
+
+	if (path == Path::MultiDrawIndirect)
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+
+	for (const auto& [first, count] : groups) {
+		const Mesh& mesh = *entries[first].mesh;
+		if (_bindTextures)
+			mesh.BindTextures(_shader);
+		GLState::Get().BindVertexArray(mesh.GetPool().GetInstancedVAO(drawDataBuffer));
+		if (path == Path::AttributeOffset)
+			glBindBuffer(GL_ARRAY_BUFFER, drawDataBuffer);
+
+		if (path == Path::MultiDrawIndirect) {
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, (void*)(first * sizeof(DrawElementsIndirectCommand)),
+				static_cast<GLsizei>(count), 0);
+			stats.drawCalls++;
+			continue;
+		}
+
+		for (size_t i = first; i < first + count; i++) {
+			const DrawElementsIndirectCommand& command = commands[i];
+			void* offset = (void*)(command.firstIndex * sizeof(uint16_t));
+			if (path == Path::BaseInstance) {
+				glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, command.count, GL_UNSIGNED_SHORT, offset,
+					command.instanceCount, command.baseVertex, command.baseInstance);
+			}
+			else {
+				for (GLuint column = 0; column < 4; column++)
+					glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+						(void*)(command.baseInstance * sizeof(glm::mat4) + sizeof(glm::vec4) * column));
+				glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_SHORT, offset,
+					command.instanceCount, command.baseVertex);
+			}
+			stats.drawCalls++;
+		}
+
+		// The pool's instanced VAO reads from the start of the buffer for everybody else
+		if (path == Path::AttributeOffset)
+			for (GLuint column = 0; column < 4; column++)
+				glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(sizeof(glm::vec4) * column));
+	}
+
+	if (path == Path::MultiDrawIndirect)
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	GLState::Get().EndDraw();
+}
+
+inline std::ostream& operator<<(std::ostream& _stream, const IndirectDrawList::Stats& _stats)
+{
+	return _stream << _stats.commands << " commands in " << _stats.groups << " groups, " << _stats.drawCalls << " draw calls";
+}
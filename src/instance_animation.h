@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <GL/glew.h>
+
+#include "gl_state.h"
+#include "instance_format.h"
+#include "instance_transforms.h"
+#include "shader.h"
+
+// The rock spin on the GPU. rotation(t) = rotation(0) * spin(axis, speed * t) is a pure function of the
+// initial state, so that state is uploaded once and every Update evaluates it per instance in a transform
+// feedback pass (GL 3.3 has no compute shaders), writing PositionScaleRotation instances into a buffer
+// the instanced draw reads directly. Per frame the CPU sets one uniform; nothing is uploaded or culled.
+class InstanceAnimation
+{
+public:
+	static constexpr InstanceFormat outputFormat = InstanceFormat::PositionScaleRotation;
+
+	explicit InstanceAnimation(const InstanceTransforms& _initial)
+		: initial(_initial), program("res/shaders/instance_animate.vs", std::vector<std::string>{ "outPositionScale", "outRotation" })
+	{
+		// Per instance: vec4(position, scale), the quaternion, vec4(axis, speed)
+		std::vector<glm::vec4> state;
+		state.reserve(initial.GetCount() * 3);
+		for (size_t i = 0; i < initial.GetCount(); i++) {
+			glm::quat rotation = initial.GetRotation(i);
+			state.emplace_back(initial.GetPosition(i), initial.GetScale(i));
+			state.emplace_back(rotation.x, rotation.y, rotation.z, rotation.w);
+			state.emplace_back(initial.GetAxis(i), initial.GetSpeed(i));
+		}
+
+		glGenVertexArrays(1, &stateVAO);
+		glGenBuffers(1, &stateBuffer);
+		GLState::Get().BindVertexArray(stateVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, stateBuffer);
+		glBufferData(GL_ARRAY_BUFFER, state.size() * sizeof(glm::vec4), state.data(), GL_STATIC_DRAW);
+		for (GLuint i = 0; i < 3; i++) {
+			glEnableVertexAttribArray(i);
+			glVertexAttribPointer(i, 4, GL_FLOAT, GL_FALSE, 3 * sizeof(glm::vec4), (void*)(i * sizeof(glm::vec4)));
+		}
+		GLState::Get().BindVertexArray(0);
+
+		glGenBuffers(1, &outputBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, outputBuffer);
+		glBufferData(GL_ARRAY_BUFFER, std::max<size_t>(initial.GetCount(), 1) * GetInstanceStride(outputFormat), nullptr, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		timeUniform = program.GetUniform("time");
+	}
+
+	~InstanceAnimation()
+	{
+		GLState::Get().DeleteVertexArrays(1, &stateVAO);
+		glDeleteBuffers(1, &stateBuffer);
+		glDeleteBuffers(1, &outputBuffer);
+	}
+
+	InstanceAnimation(const InstanceAnimation&) = delete;
+	InstanceAnimation& operator=(const InstanceAnimation&) = delete;
+
+	// Write every instance as it is _time seconds after the initial state into the output buffer
+	void Update(float _time);
+
+	// Read the output back (a pipeline stall) and compare it with the initial state advanced by _time on the CPU
+	InstanceTransforms::EncodingError Compare(float _time) const;
+	// Compare within the differences between the GPU's and the CPU kernel's sin/cos
+	bool Verify(float _time) const
+	{
+		InstanceTransforms::EncodingError error = Compare(_time);
+		return error.position <= 1e-4f * (1.0f + GetLargestPosition()) && error.linear <= 1e-3f;
+	}
+
+	GLuint GetOutputBuffer() const { return outputBuffer; }
+	size_t GetCount() const { return initial.GetCount(); }
+
+private:
+	float GetLargestPosition() const
+	{
+		float largest = 0.0f;
+		for (size_t i = 0; i < initial.GetCount(); i++)
+			largest = std::max(largest, glm::length(initial.GetPosition(i)));
+		return largest;
+	}
+
+	InstanceTransforms initial;
+	Shader program;
+	Shader::Uniform timeUniform;
+	GLuint stateVAO = 0, stateBuffer = 0, outputBuffer = 0;
+#ifdef _DEBUG
+	bool verified = false;
+#endif
+};
+
+inline void InstanceAnimation::Update(float _time)
+{
+	if (GetCount() == 0)
+		return;
+
+	program.Bind();
+	program.SetFloat(timeUniform, _time);
+	GLState::Get().BindVertexArray(stateVAO);
+	glEnable(GL_RASTERIZER_DISCARD);
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, outputBuffer);
+	glBeginTransformFeedback(GL_POINTS);
+	glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(GetCount()));
+	glEndTransformFeedback();
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+	glDisable(GL_RASTERIZER_DISCARD);
+
+#ifdef _DEBUG
+	// Once, since the readback waits for the GPU
+	if (!verified) {
+		verified = true;
+		InstanceTransforms::EncodingError error = Compare(_time);
+		std::cout << "InstanceAnimation: GPU " << (Verify(_time) ? "matches" : "DIFFERS FROM") << " the CPU kernel (position error "
+			<< error.position << ", rotation/scale error " << error.linear << ")\n";
+	}
+#endif
+}
+
+inline InstanceTransforms::EncodingError InstanceAnimation::Compare(float _time) const
+{
+	const size_t stride = GetInstanceStride(outputFormat);
+	std::vector<unsigned char> gpu(GetCount() * stride), cpu(GetCount() * stride);
+	glBindBuffer(GL_ARRAY_BUFFER, outputBuffer);
+	glGetBufferSubData(GL_ARRAY_BUFFER, 0, gpu.size(), gpu.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// One step of _time from the initial state is the closed form the shader evaluates
+	InstanceTransforms expected = initial;
+	expected.UpdateRange(_time, cpu.data(), outputFormat, 0, GetCount());
+
+	InstanceTransforms::EncodingError error;
+	for (size_t i = 0; i < GetCount(); i++) {
+		glm::mat4 a = DecodeInstance(outputFormat, gpu.data(), i), b = DecodeInstance(outputFormat, cpu.data(), i);
+		for (int column = 0; column < 4; column++)
+			for (int row = 0; row < 3; row++) {
+				float& maximum = column == 3 ? error.position : error.linear;
+				maximum = std::max(maximum, std::abs(a[column][row] - b[column][row]));
+			}
+	}
+	return error;
+}
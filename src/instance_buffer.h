@@ -0,0 +1,15 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include "stream_buffer.h"
+
+// Vertex buffer for per-instance data that is rewritten every frame. Each BeginWrite returns a
+// write-only pointer producers can fill from any thread until EndWrite; the data starts at GetOffset()
+// in the buffer, which moves between the frame segments of the ring (see StreamBuffer).
+class InstanceBuffer : public StreamBuffer
+{
+public:
+	explicit InstanceBuffer(size_t _capacityBytes, unsigned int _frameCount = defaultFrameCount)
+		: StreamBuffer(GL_ARRAY_BUFFER, _capacityBytes, _frameCount) {}
+};
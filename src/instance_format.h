@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <GL/glew.h>
+
+// Encodings of one instance's placement in a per-instance vertex buffer. Rocks only need a translation,
+// a uniform scale and a rotation, so the smaller ones drop what a mat4 spends on constants and redundancy.
+//   Mat4                   column-major glm::mat4 at locations 3-6                                 64 bytes
+//   Mat3x4                 the three rows of the affine part (xyz of the row, then translation), 3-5  48 bytes
+//   PositionScaleRotation  vec4(position, scale) at 3, the unit quaternion (xyzw) at 4              32 bytes
+//   Quantized              position and scale as unorm16 within an InstanceQuantization range at 3,
+//                          the quaternion as snorm16 at 4                                          16 bytes
+enum class InstanceFormat { Mat4, Mat3x4, PositionScaleRotation, Quantized };
+
+// Range the Quantized positions and scales are stored in: value = offset + extent * unorm16.
+// The vertex shader gets both as the uniforms instanceOffset and instanceExtent.
+struct InstanceQuantization
+{
+	glm::vec4 offset = glm::vec4(0.0f);  // xyz position, w scale
+	glm::vec4 extent = glm::vec4(1.0f);
+};
+
+inline size_t GetInstanceStride(InstanceFormat _format)
+{
+	switch (_format) {
+	case InstanceFormat::Mat4: return 16 * sizeof(float);
+	case InstanceFormat::Mat3x4: return 12 * sizeof(float);
+	case InstanceFormat::PositionScaleRotation: return 8 * sizeof(float);
+	default: return 8 * sizeof(uint16_t);
+	}
+}
+
+inline const char* GetInstanceFormatName(InstanceFormat _format)
+{
+	switch (_format) {
+	case InstanceFormat::Mat4: return "mat4";
+	case InstanceFormat::Mat3x4: return "mat3x4";
+	case InstanceFormat::PositionScaleRotation: return "position+scale+quaternion";
+	default: return "quantized";
+	}
+}
+
+// Point the instance attributes of the bound VAO at the bound GL_ARRAY_BUFFER from _offset on,
+// advanced once per instance
+inline void EnableInstanceAttributes(InstanceFormat _format, size_t _offset)
+{
+	const GLsizei stride = static_cast<GLsizei>(GetInstanceStride(_format));
+	auto enable = [&](GLuint _location, GLenum _type, GLboolean _normalized, size_t _byteOffset) {
+		glEnableVertexAttribArray(_location);
+		glVertexAttribPointer(_location, 4, _type, _normalized, stride, (void*)(_offset + _byteOffset));
+		glVertexAttribDivisor(_location, 1);
+	};
+
+	if (_format == InstanceFormat::Quantized) {
+		enable(3, GL_UNSIGNED_SHORT, GL_TRUE, 0);
+		enable(4, GL_SHORT, GL_TRUE, 4 * sizeof(uint16_t));
+		return;
+	}
+	// A matrix is treated as an array of vec4s
+	const GLuint vec4Count = static_cast<GLuint>(stride / sizeof(glm::vec4));
+	for (GLuint i = 0; i < vec4Count; i++)
+		enable(3 + i, GL_FLOAT, GL_FALSE, i * sizeof(glm::vec4));
+}
+
+// Instance _index of _data as the vertex shader reconstructs it
+inline glm::mat4 DecodeInstance(InstanceFormat _format, const void* _data, size_t _index, const InstanceQuantization& _quantization = {})
+{
+	const unsigned char* instance = static_cast<const unsigned char*>(_data) + _index * GetInstanceStride(_format);
+	glm::mat4 model(1.0f);
+	float f[16];
+	if (_format == InstanceFormat::Mat4) {
+		std::memcpy(&model[0][0], instance, sizeof(glm::mat4));
+		return model;
+	}
+	if (_format == InstanceFormat::Mat3x4) {
+		std::memcpy(f, instance, 12 * sizeof(float));
+		for (int row = 0; row < 3; row++)
+			for (int column = 0; column < 4; column++)
+				model[column][row] = f[row * 4 + column];
+		return model;
+	}
+
+	glm::vec3 position;
+	glm::quat rotation;
+	float scale;
+	if (_format == InstanceFormat::PositionScaleRotation) {
+		std::memcpy(f, instance, 8 * sizeof(float));
+		position = glm::vec3(f[0], f[1], f[2]);
+		scale = f[3];
+		rotation = glm::quat(f[7], f[4], f[5], f[6]);
+	}
+	else {
+		uint16_t unorm[4];
+		int16_t snorm[4];
+		std::memcpy(unorm, instance, sizeof(unorm));
+		std::memcpy(snorm, instance + sizeof(unorm), sizeof(snorm));
+		glm::vec4 positionScale = _quantization.offset + _quantization.extent * (glm::vec4(unorm[0], unorm[1], unorm[2], unorm[3]) / 65535.0f);
+		position = glm::vec3(positionScale);
+		scale = positionScale.w;
+		// The GL's snorm16 conversion
+		glm::vec4 q = glm::max(glm::vec4(snorm[0], snorm[1], snorm[2], snorm[3]) / 32767.0f, -1.0f);
+		rotation = glm::quat(q.w, q.x, q.y, q.z);
+	}
+	model = glm::mat4_cast(glm::normalize(rotation)) * scale;
+	model[3] = glm::vec4(position, 1.0f);
+	return model;
+}
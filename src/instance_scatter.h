@@ -0,0 +1,265 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "frustum.h"
+#include "instance_transforms.h"
+#include "spatial_hash.h"
+#include "thread_pool.h"
+
+// Counter-based random numbers: the value for (seed, index, dimension) is a hash of the three rather than
+// the next state of a sequence, so instance i can be generated without generating the ones before it, on
+// any thread, and always comes out the same. The hash is SplitMix64's finalizer applied twice.
+struct CounterRng
+{
+	static uint64_t Mix(uint64_t _z)
+	{
+		_z += 0x9e3779b97f4a7c15ull;
+		_z = (_z ^ (_z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		_z = (_z ^ (_z >> 27)) * 0x94d049bb133111ebull;
+		return _z ^ (_z >> 31);
+	}
+
+	static uint64_t Hash(uint64_t _seed, uint64_t _index, uint32_t _dimension)
+	{
+		return Mix(_seed ^ Mix(_index * 64 + _dimension));
+	}
+
+	// [0, 1) with 24 bits, exact in a float
+	static float Uniform(uint64_t _seed, uint64_t _index, uint32_t _dimension)
+	{
+		return static_cast<float>(Hash(_seed, _index, _dimension) >> 40) * (1.0f / 16777216.0f);
+	}
+
+	static float Uniform(uint64_t _seed, uint64_t _index, uint32_t _dimension, float _min, float _max)
+	{
+		return _min + (_max - _min) * Uniform(_seed, _index, _dimension);
+	}
+};
+
+// Shape of a RingScatter; the defaults are the instancing demo's ring
+struct RingScatterSettings
+{
+	float radius = 50.0f;
+	float offset = 5.0f;         // largest displacement from the circle, horizontally
+	float heightScale = 0.6f;    // of the vertical displacement, relative to offset
+	float minScale = 0.05f, maxScale = 0.2f;
+	float minSpeed = 4.0f, maxSpeed = 8.0f; // radians per second
+	// ScatterSeparated only: rocks keep separation * (sum of their bounding radii) apart, and a rock is
+	// dropped after this many candidate positions in a row were too close to others
+	float separation = 1.0f;
+	unsigned int attempts = 30;
+};
+
+// What a ScatterSeparated did
+struct ScatterReport
+{
+	size_t requested = 0, placed = 0;
+	size_t candidates = 0, rejected = 0;   // positions tried, and those too close to a placed rock
+	unsigned int sectors = 0;
+	double ms = 0.0;
+
+	double GetRejectionRate() const { return candidates ? static_cast<double>(rejected) / candidates : 0.0; }
+};
+
+inline std::ostream& operator<<(std::ostream& _stream, const ScatterReport& _report)
+{
+	return _stream << _report.placed << "/" << _report.requested << " placed, " << _report.rejected << " of "
+		<< _report.candidates << " candidates rejected (" << 100.0 * _report.GetRejectionRate() << "%), "
+		<< _report.sectors << " sectors, " << _report.ms << " ms";
+}
+
+// The asteroid ring of the instancing demo: instances spread evenly around a circle, pushed off it by a
+// random offset, with a random orientation, scale and spin. Every instance only depends on the seed and
+// its index, so Scatter splits the range over the thread pool and the result is bit-identical for any
+// number of threads.
+class RingScatter
+{
+public:
+	using Settings = RingScatterSettings;
+
+	explicit RingScatter(uint64_t _seed, const Settings& _settings = Settings())
+		: seed(_seed), settings(_settings) {}
+
+	// Instance _index of _count into _transforms, which holds at least _index + 1 instances
+	void Generate(InstanceTransforms& _transforms, size_t _index, size_t _count) const;
+
+	// Replace the contents of _transforms with _count instances
+	void Scatter(InstanceTransforms& _transforms, size_t _count, ThreadPool& _pool = ThreadPool::Global()) const
+	{
+		_transforms.Resize(_count);
+		_pool.ParallelFor(_count, 16384, [&](size_t _begin, size_t _end) {
+			for (size_t i = _begin; i < _end; i++)
+				Generate(_transforms, i, _count);
+		});
+		_transforms.UpdateQuantization();
+	}
+
+	// Replace the contents of _transforms with up to _count instances no two of which overlap, given the
+	// rock's _bounds at scale 1 (Poisson-disk sampling by dart throwing). The ring is cut into sectors
+	// wide enough that only neighbours can collide; the even sectors fill in parallel, then the odd ones
+	// against them, so the result is bit-identical for any number of threads. Rocks that find no room
+	// within Settings::attempts tries are left out, so the count can fall short when the ring is full.
+	ScatterReport ScatterSeparated(InstanceTransforms& _transforms, size_t _count, const BoundingSphere& _bounds,
+		ThreadPool& _pool = ThreadPool::Global()) const;
+
+	uint64_t GetSeed() const { return seed; }
+	const Settings& GetSettings() const { return settings; }
+
+private:
+	static constexpr unsigned int maxSectorCount = 1024;
+
+	// One random dimension per draw
+	enum Dimension : uint32_t { OffsetX, OffsetY, OffsetZ, Angle, AxisX, AxisY, AxisZ, Scale, Speed, RingAngle };
+
+	// Orientation, spin and speed of the instance drawn as _key, written with _position and _scale to _index
+	void SetInstance(InstanceTransforms& _transforms, size_t _index, uint64_t _key, const glm::vec3& _position, float _scale) const;
+
+	// ScatterSeparated's candidate _key: sector in the upper bits, the count of candidates before it in
+	// the sector in the lower ones
+	static constexpr unsigned int candidateBits = 40;
+	void GetCandidate(uint64_t _key, float _sectorAngle, glm::vec3& _position, float& _scale) const
+	{
+		const float angle = (static_cast<float>(_key >> candidateBits) + Random(_key, RingAngle, 0.0f, 1.0f)) * _sectorAngle;
+		const float distance = settings.radius + Random(_key, OffsetX, -1.0f, 1.0f) * settings.offset;
+		_position = glm::vec3(std::sin(angle) * distance, settings.heightScale * Random(_key, OffsetY, -1.0f, 1.0f) * settings.offset,
+			std::cos(angle) * distance);
+		_scale = Random(_key, Scale, settings.minScale, settings.maxScale);
+	}
+
+	// 64-bit like CounterRng, so candidate keys keep their sector bits on 32-bit builds
+	float Random(uint64_t _index, Dimension _dimension, float _min, float _max) const
+	{
+		return CounterRng::Uniform(seed, _index, _dimension, _min, _max);
+	}
+
+	uint64_t seed;
+	Settings settings;
+};
+
+inline void RingScatter::Generate(InstanceTransforms& _transforms, size_t _index, size_t _count) const
+{
+	const float angle = 6.2831853f * static_cast<float>(_index) / static_cast<float>(_count);
+	glm::vec3 position(std::sin(angle) * settings.radius + Random(_index, OffsetX, -1.0f, 1.0f) * settings.offset,
+		settings.heightScale * Random(_index, OffsetY, -1.0f, 1.0f) * settings.offset,
+		std::cos(angle) * settings.radius + Random(_index, OffsetZ, -1.0f, 1.0f) * settings.offset);
+
+	SetInstance(_transforms, _index, _index, position, Random(_index, Scale, settings.minScale, settings.maxScale));
+}
+
+inline void RingScatter::SetInstance(InstanceTransforms& _transforms, size_t _index, uint64_t _key, const glm::vec3& _position,
+	float _scale) const
+{
+	// A random initial rotation around a random axis from the positive octant (nudged away from zero),
+	// which is also the axis the instance keeps spinning around
+	glm::vec3 axis = glm::vec3(Random(_key, AxisX, 0.0f, 1.0f), Random(_key, AxisY, 0.0f, 1.0f), Random(_key, AxisZ, 0.0f, 1.0f)) + 1e-3f;
+	glm::quat rotation = glm::angleAxis(Random(_key, Angle, 0.0f, 6.2831853f), glm::normalize(axis));
+
+	_transforms.Set(_index, _position, rotation, _scale, axis, Random(_key, Speed, settings.minSpeed, settings.maxSpeed));
+}
+
+inline ScatterReport RingScatter::ScatterSeparated(InstanceTransforms& _transforms, size_t _count, const BoundingSphere& _bounds,
+	ThreadPool& _pool) const
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// Rotation swings the mesh around its origin, so the sphere around the origin is what can collide.
+	// Cells fit the largest separation, between two rocks of maxScale
+	const float unitRadius = glm::length(_bounds.center) + _bounds.radius;
+	const float cellSize = std::max(2.0f * settings.separation * unitRadius * settings.maxScale, 1e-6f);
+
+	// Sectors two apart must be a cell apart even on the inner edge of the ring, so a rock is only ever
+	// tested against its own sector and the two next to it. An even count lets the phases alternate all around
+	unsigned int sectorCount = 1;
+	const float innerRadius = settings.radius - settings.offset;
+	if (innerRadius > 0.0f && cellSize < 2.0f * innerRadius) {
+		const float minimumAngle = 2.0f * std::asin(cellSize / (2.0f * innerRadius));
+		sectorCount = std::max(std::min(static_cast<unsigned int>(6.2831853f / minimumAngle), maxSectorCount) & ~1u, 1u);
+	}
+	const float sectorAngle = 6.2831853f / static_cast<float>(sectorCount);
+
+	struct Sector
+	{
+		Sector(float _cellSize, size_t _expectedCount) : placed(_cellSize, _expectedCount) {}
+		SpatialHash placed;
+		std::vector<uint64_t> keys;   // of the placed candidates, in placement order
+		size_t candidates = 0, rejected = 0;
+	};
+	std::vector<Sector> sectors;
+	sectors.reserve(sectorCount);
+	auto getTarget = [&](size_t _sector) { return _count * (_sector + 1) / sectorCount - _count * _sector / sectorCount; };
+	for (unsigned int i = 0; i < sectorCount; i++)
+		sectors.emplace_back(cellSize, getTarget(i));
+
+	auto fill = [&](size_t _sector) {
+		Sector& sector = sectors[_sector];
+		const SpatialHash* neighbours[2] = { nullptr, nullptr };
+		if (sectorCount > 1)
+			neighbours[0] = &sectors[(_sector + 1) % sectorCount].placed;
+		if (sectorCount > 2)
+			neighbours[1] = &sectors[(_sector + sectorCount - 1) % sectorCount].placed;
+
+		const size_t target = getTarget(_sector);
+		for (size_t i = 0; i < target; i++)
+			for (unsigned int attempt = 0; attempt < settings.attempts; attempt++) {
+				const uint64_t key = static_cast<uint64_t>(_sector) << candidateBits | sector.candidates++;
+				glm::vec3 position;
+				float scale;
+				GetCandidate(key, sectorAngle, position, scale);
+				const float radius = unitRadius * scale;
+				bool overlaps = sector.placed.Overlaps(position, radius, settings.separation);
+				for (const SpatialHash* neighbour : neighbours)
+					overlaps = overlaps || (neighbour && neighbour->Overlaps(position, radius, settings.separation));
+				if (overlaps) {
+					sector.rejected++;
+					continue;
+				}
+				sector.placed.Insert(position, radius);
+				sector.keys.push_back(key);
+				break;
+			}
+	};
+	// The odd sectors are all empty while the even ones fill and read-only after
+	_pool.ParallelFor((sectorCount + 1) / 2, 1, [&](size_t _begin, size_t _end) {
+		for (size_t i = _begin; i < _end; i++)
+			fill(2 * i);
+	});
+	_pool.ParallelFor(sectorCount / 2, 1, [&](size_t _begin, size_t _end) {
+		for (size_t i = _begin; i < _end; i++)
+			fill(2 * i + 1);
+	});
+
+	// Instances in sector order, i.e. around the ring like Scatter's
+	ScatterReport report;
+	std::vector<size_t> firstIndex(sectorCount + 1, 0);
+	for (unsigned int i = 0; i < sectorCount; i++) {
+		firstIndex[i + 1] = firstIndex[i] + sectors[i].keys.size();
+		report.candidates += sectors[i].candidates;
+		report.rejected += sectors[i].rejected;
+	}
+	_transforms.Resize(firstIndex[sectorCount]);
+	_pool.ParallelFor(sectorCount, 1, [&](size_t _begin, size_t _end) {
+		for (size_t i = _begin; i < _end; i++)
+			for (size_t j = 0; j < sectors[i].keys.size(); j++) {
+				glm::vec3 position;
+				float scale;
+				GetCandidate(sectors[i].keys[j], sectorAngle, position, scale);
+				SetInstance(_transforms, firstIndex[i] + j, sectors[i].keys[j], position, scale);
+			}
+	});
+	_transforms.UpdateQuantization();
+
+	report.requested = _count;
+	report.placed = _transforms.GetCount();
+	report.sectors = sectorCount;
+	report.ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	return report;
+}
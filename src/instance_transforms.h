@@ -0,0 +1,588 @@
+#pragma once
+
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "frustum.h"
+#include "instance_format.h"
+#include "lod_selector.h"
+#include "occlusion_buffer.h"
+#include "simd_lanes.h"
+#include "thread_pool.h"
+
+// Structure-of-arrays store for instances that spin around their own axis at their own speed.
+// Each instance is a position, a unit quaternion, a uniform scale and a (unit axis, radians per second)
+// spin. Update integrates the spin into the quaternions and emits one matrix per instance, several
+// instances per SSE/AVX register (picked from glm's GLM_ARCH), partitioned over a thread pool.
+// UpdateVisible additionally frustum-culls each instance's bounding sphere and only writes the
+// matrices of the visible ones, packed at the front of the destination; UpdateVisibleLod also groups
+// them by level of detail, and can drop the instances an OcclusionBuffer hides.
+// The output is any InstanceFormat; Quantized is relative to GetQuantization(), the bounds of everything added.
+class InstanceTransforms
+{
+public:
+	using OutputLayout = InstanceFormat;
+
+	// Largest differences between decoded instances and GetMatrix, in the translation and in the scaled rotation
+	struct EncodingError
+	{
+		float position = 0.0f, linear = 0.0f;
+	};
+
+	static size_t GetOutputStride(OutputLayout _layout) { return GetInstanceStride(_layout); }
+	static const char* GetKernelName();
+
+	void Reserve(size_t _count);
+	void Add(const glm::vec3& _position, const glm::quat& _rotation, float _scale, const glm::vec3& _axis, float _speed);
+
+	// For filling many instances in parallel: Resize, then Set each index from any thread (distinct indices),
+	// then UpdateQuantization once on one thread
+	void Resize(size_t _count);
+	void Set(size_t _index, const glm::vec3& _position, const glm::quat& _rotation, float _scale, const glm::vec3& _axis, float _speed);
+	void UpdateQuantization();
+
+	// Advance every instance by _deltaTime and write its matrix to _destination, which receives
+	// GetCount() * GetOutputStride(_layout) bytes and may be write-only memory
+	void Update(float _deltaTime, void* _destination, OutputLayout _layout = OutputLayout::Mat4, ThreadPool& _pool = ThreadPool::Global());
+	// Same as Update without advancing, e.g. for the initial fill of a buffer
+	void Write(void* _destination, OutputLayout _layout = OutputLayout::Mat4, ThreadPool& _pool = ThreadPool::Global());
+	// Update of [_begin, _end) on the calling thread
+	void UpdateRange(float _deltaTime, void* _destination, OutputLayout _layout, size_t _begin, size_t _end);
+
+	// Update, but only instances whose _localBounds (the mesh's sphere, scaled and moved with the instance)
+	// intersect _frustum are written, in instance order. Returns how many; draw that many instances
+	size_t UpdateVisible(float _deltaTime, const Frustum& _frustum, const BoundingSphere& _localBounds, void* _destination,
+		OutputLayout _layout = OutputLayout::Mat4, ThreadPool& _pool = ThreadPool::Global());
+	// UpdateVisible of [_begin, _end) on the calling thread, written to the start of _destination.
+	// _visibleIndices, if given, receives the index of every instance written
+	size_t UpdateRangeVisible(float _deltaTime, const Frustum& _frustum, const BoundingSphere& _localBounds, void* _destination,
+		OutputLayout _layout, size_t _begin, size_t _end, uint32_t* _visibleIndices = nullptr);
+	// UpdateVisible with the visible instances grouped by the level _lod selects for each, level 0 first and
+	// every group in instance order. _levelCounts receives the size of each group, one per bucket of _lod
+	// (its levels, then the impostors if it has any). With _occlusion, instances inside the frustum whose
+	// GetOcclusionBox it hides are left out too; GetOccludedCount says how many
+	size_t UpdateVisibleLod(float _deltaTime, const Frustum& _frustum, const BoundingSphere& _localBounds, const LodSelector& _lod,
+		void* _destination, std::vector<size_t>& _levelCounts, OutputLayout _layout = OutputLayout::Mat4,
+		ThreadPool& _pool = ThreadPool::Global(), const OcclusionBuffer* _occlusion = nullptr);
+	size_t GetOccludedCount() const { return occludedCount; }  // By the last UpdateVisibleLod
+	// World-space box around instance _index's _localBounds
+	void GetOcclusionBox(size_t _index, const BoundingSphere& _localBounds, glm::vec3& _min, glm::vec3& _max) const;
+
+	// Brute-force check of an UpdateVisible result against Frustum::IntersectsSphere per instance.
+	// Spheres within a rounding margin of a plane may go either way. Instances _occlusion hides are not expected.
+	bool VerifyVisible(const Frustum& _frustum, const BoundingSphere& _localBounds, const void* _visible,
+		OutputLayout _layout, size_t _visibleCount, const OcclusionBuffer* _occlusion = nullptr) const;
+
+	// Decode every instance of an Update/Write result and compare it with GetMatrix. The float formats
+	// must match up to rounding, Quantized up to half a step of its 16-bit encodings
+	EncodingError MeasureEncodingError(const void* _output, OutputLayout _layout) const;
+	bool VerifyEncoding(const void* _output, OutputLayout _layout) const;
+
+	size_t GetCount() const { return scale.size(); }
+	glm::mat4 GetMatrix(size_t _index) const;
+	glm::vec3 GetPosition(size_t _index) const { return glm::vec3(positionX[_index], positionY[_index], positionZ[_index]); }
+	glm::quat GetRotation(size_t _index) const { return glm::quat(rotationW[_index], rotationX[_index], rotationY[_index], rotationZ[_index]); }
+	float GetScale(size_t _index) const { return scale[_index]; }
+	glm::vec3 GetAxis(size_t _index) const { return glm::vec3(axisX[_index], axisY[_index], axisZ[_index]); }
+	float GetSpeed(size_t _index) const { return speed[_index]; }
+	const InstanceQuantization& GetQuantization() const { return quantization; }
+
+private:
+	// Without a frustum instance i goes to _destination[i]; with one the visible instances are packed
+	// from _destination[0], and their indices to _visibleIndices if given. Returns the number written
+	template<class Lanes>
+	size_t Kernel(float _deltaTime, float* _destination, OutputLayout _layout, size_t _begin, size_t _end,
+		const Frustum* _frustum, const BoundingSphere& _localBounds, uint32_t* _visibleIndices = nullptr);
+
+	// The two halves of VerifyVisible: the visible count against the brute-force test, and one written matrix
+	bool VerifyVisibleCount(const Frustum& _frustum, const BoundingSphere& _localBounds, size_t _visibleCount,
+		const OcclusionBuffer* _occlusion) const;
+	bool MayBeVisible(const Frustum& _frustum, const BoundingSphere& _localBounds, const glm::mat4& _model) const;
+	// Spheres within this rounding margin of a plane may go either way
+	static float VisibilityMargin(const BoundingSphere& _sphere);
+	// VerifyVisible of the last UpdateVisible(Lod) from its staged chunks, so the write-only destination is never read
+	bool VerifyStaged(const Frustum& _frustum, const BoundingSphere& _localBounds, OutputLayout _layout, size_t _visibleCount,
+		size_t _chunkSize, const OcclusionBuffer* _occlusion) const;
+
+	std::vector<float> positionX, positionY, positionZ;
+	std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+	std::vector<float> scale;
+	std::vector<float> axisX, axisY, axisZ;
+	std::vector<float> speed; // radians per second
+	glm::vec4 minimum = glm::vec4(FLT_MAX), maximum = glm::vec4(-FLT_MAX); // xyz position, w scale
+	InstanceQuantization quantization;
+
+	// UpdateVisible scratch: each chunk packs its visible matrices into its own slice first
+	std::vector<float> cullStaging;
+	std::vector<size_t> chunkVisible;
+	std::vector<size_t> chunkOffset;
+	// UpdateVisibleLod scratch: per staged instance its index and level, per chunk and level the count.
+	// Occluded instances are staged like the others with occludedLevel, and skipped when copying
+	static constexpr uint8_t occludedLevel = 0xff;
+	std::vector<uint32_t> cullIndices;
+	std::vector<uint8_t> cullLevels;
+	std::vector<size_t> chunkLevelCounts;
+	std::vector<size_t> chunkOccluded;
+	size_t occludedCount = 0;
+};
+
+inline const char* InstanceTransforms::GetKernelName()
+{
+#if GLM_ARCH & GLM_ARCH_AVX2_BIT
+	return "AVX2";
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
+
+inline void InstanceTransforms::Reserve(size_t _count)
+{
+	for (std::vector<float>* array : { &positionX, &positionY, &positionZ, &rotationX, &rotationY, &rotationZ, &rotationW,
+		&scale, &axisX, &axisY, &axisZ, &speed })
+		array->reserve(_count);
+}
+
+inline void InstanceTransforms::Add(const glm::vec3& _position, const glm::quat& _rotation, float _scale, const glm::vec3& _axis, float _speed)
+{
+	Resize(GetCount() + 1);
+	Set(GetCount() - 1, _position, _rotation, _scale, _axis, _speed);
+
+	// Positions and scales never change, so their range is final once everything is added
+	minimum = glm::min(minimum, glm::vec4(_position, _scale));
+	maximum = glm::max(maximum, glm::vec4(_position, _scale));
+	quantization.offset = minimum;
+	quantization.extent = glm::max(maximum - minimum, glm::vec4(1e-6f));
+}
+
+inline void InstanceTransforms::Resize(size_t _count)
+{
+	for (std::vector<float>* array : { &positionX, &positionY, &positionZ, &rotationX, &rotationY, &rotationZ, &rotationW,
+		&scale, &axisX, &axisY, &axisZ, &speed })
+		array->resize(_count);
+}
+
+inline void InstanceTransforms::Set(size_t _index, const glm::vec3& _position, const glm::quat& _rotation, float _scale,
+	const glm::vec3& _axis, float _speed)
+{
+	glm::quat rotation = glm::normalize(_rotation);
+	glm::vec3 axis = glm::normalize(_axis);
+	positionX[_index] = _position.x;
+	positionY[_index] = _position.y;
+	positionZ[_index] = _position.z;
+	rotationX[_index] = rotation.x;
+	rotationY[_index] = rotation.y;
+	rotationZ[_index] = rotation.z;
+	rotationW[_index] = rotation.w;
+	scale[_index] = _scale;
+	axisX[_index] = axis.x;
+	axisY[_index] = axis.y;
+	axisZ[_index] = axis.z;
+	speed[_index] = _speed;
+}
+
+inline void InstanceTransforms::UpdateQuantization()
+{
+	minimum = glm::vec4(FLT_MAX);
+	maximum = glm::vec4(-FLT_MAX);
+	for (size_t i = 0; i < GetCount(); i++) {
+		glm::vec4 value(positionX[i], positionY[i], positionZ[i], scale[i]);
+		minimum = glm::min(minimum, value);
+		maximum = glm::max(maximum, value);
+	}
+	quantization.offset = minimum;
+	quantization.extent = glm::max(maximum - minimum, glm::vec4(1e-6f));
+}
+
+inline void InstanceTransforms::Update(float _deltaTime, void* _destination, OutputLayout _layout, ThreadPool& _pool)
+{
+	// Chunks of a few thousand instances amortize the scheduling cost
+	_pool.ParallelFor(GetCount(), 2048, [this, _deltaTime, _destination, _layout](size_t _begin, size_t _end) {
+		UpdateRange(_deltaTime, _destination, _layout, _begin, _end);
+	});
+}
+
+inline void InstanceTransforms::Write(void* _destination, OutputLayout _layout, ThreadPool& _pool)
+{
+	// A zero spin leaves the unit quaternions unchanged up to renormalization
+	Update(0.0f, _destination, _layout, _pool);
+}
+
+inline void InstanceTransforms::UpdateRange(float _deltaTime, void* _destination, OutputLayout _layout, size_t _begin, size_t _end)
+{
+	using Widest = simd_lanes::Widest;
+	float* destination = static_cast<float*>(_destination);
+	size_t vectorEnd = _begin + (_end - _begin) / Widest::width * Widest::width;
+	Kernel<Widest>(_deltaTime, destination, _layout, _begin, vectorEnd, nullptr, BoundingSphere());
+	Kernel<simd_lanes::Scalar>(_deltaTime, destination, _layout, vectorEnd, _end, nullptr, BoundingSphere());
+}
+
+inline size_t InstanceTransforms::UpdateVisible(float _deltaTime, const Frustum& _frustum, const BoundingSphere& _localBounds,
+	void* _destination, OutputLayout _layout, ThreadPool& _pool)
+{
+	// Fixed chunks so each one's visible count is known; their packed runs are concatenated afterwards
+	const size_t count = GetCount();
+	const size_t stride = GetOutputStride(_layout) / sizeof(float);
+	const size_t chunkSize = 4096;
+	const size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+	cullStaging.resize(count * stride);
+	chunkVisible.assign(chunkCount, 0);
+
+	_pool.ParallelFor(chunkCount, 1, [&](size_t _firstChunk, size_t _lastChunk) {
+		for (size_t chunk = _firstChunk; chunk < _lastChunk; chunk++) {
+			size_t begin = chunk * chunkSize;
+			chunkVisible[chunk] = UpdateRangeVisible(_deltaTime, _frustum, _localBounds, &cullStaging[begin * stride],
+				_layout, begin, std::min(begin + chunkSize, count));
+		}
+	});
+
+	chunkOffset.resize(chunkCount);
+	size_t visible = 0;
+	for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+		chunkOffset[chunk] = visible;
+		visible += chunkVisible[chunk];
+	}
+
+	float* destination = static_cast<float*>(_destination);
+	_pool.ParallelFor(chunkCount, 1, [&](size_t _firstChunk, size_t _lastChunk) {
+		for (size_t chunk = _firstChunk; chunk < _lastChunk; chunk++)
+			std::memcpy(destination + chunkOffset[chunk] * stride, &cullStaging[chunk * chunkSize * stride],
+				chunkVisible[chunk] * stride * sizeof(float));
+	});
+
+#ifdef _DEBUG
+	if (!VerifyStaged(_frustum, _localBounds, _layout, visible, chunkSize, nullptr))
+		std::cout << "InstanceTransforms: culling disagrees with the brute-force frustum test (" << visible << " visible)\n";
+#endif
+	return visible;
+}
+
+inline size_t InstanceTransforms::UpdateRangeVisible(float _deltaTime, const Frustum& _frustum, const BoundingSphere& _localBounds,
+	void* _destination, OutputLayout _layout, size_t _begin, size_t _end, uint32_t* _visibleIndices)
+{
+	using Widest = simd_lanes::Widest;
+	float* destination = static_cast<float*>(_destination);
+	const size_t stride = GetOutputStride(_layout) / sizeof(float);
+	size_t vectorEnd = _begin + (_end - _begin) / Widest::width * Widest::width;
+	size_t visible = Kernel<Widest>(_deltaTime, destination, _layout, _begin, vectorEnd, &_frustum, _localBounds, _visibleIndices);
+	return visible + Kernel<simd_lanes::Scalar>(_deltaTime, destination + visible * stride, _layout, vectorEnd, _end,
+		&_frustum, _localBounds, _visibleIndices ? _visibleIndices + visible : nullptr);
+}
+
+inline size_t InstanceTransforms::UpdateVisibleLod(float _deltaTime, const Frustum& _frustum, const BoundingSphere& _localBounds,
+	const LodSelector& _lod, void* _destination, std::vector<size_t>& _levelCounts, OutputLayout _layout, ThreadPool& _pool,
+	const OcclusionBuffer* _occlusion)
+{
+	// As UpdateVisible, except that each chunk also picks and counts the level of its visible instances,
+	// and the concatenation puts every instance behind all lower levels and the same level's earlier chunks
+	const size_t count = GetCount();
+	const size_t stride = GetOutputStride(_layout) / sizeof(float);
+	const size_t chunkSize = 4096;
+	const size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+	const unsigned int levels = _lod.GetBucketCount();
+	cullStaging.resize(count * stride);
+	cullIndices.resize(count);
+	cullLevels.resize(count);
+	chunkVisible.assign(chunkCount, 0);
+	chunkLevelCounts.assign(chunkCount * levels, 0);
+	chunkOccluded.assign(chunkCount, 0);
+
+	_pool.ParallelFor(chunkCount, 1, [&](size_t _firstChunk, size_t _lastChunk) {
+		for (size_t chunk = _firstChunk; chunk < _lastChunk; chunk++) {
+			size_t begin = chunk * chunkSize;
+			size_t visible = UpdateRangeVisible(_deltaTime, _frustum, _localBounds, &cullStaging[begin * stride], _layout, begin,
+				std::min(begin + chunkSize, count), &cullIndices[begin]);
+			for (size_t i = begin; i < begin + visible; i++) {
+				uint32_t index = cullIndices[i];
+				if (_occlusion) {
+					glm::vec3 boxMin, boxMax;
+					GetOcclusionBox(index, _localBounds, boxMin, boxMax);
+					if (!_occlusion->IsBoxVisible(boxMin, boxMax)) {
+						cullLevels[i] = occludedLevel;
+						chunkOccluded[chunk]++;
+						continue;
+					}
+				}
+				unsigned int level = _lod.Select(glm::vec3(positionX[index], positionY[index], positionZ[index]), scale[index]);
+				cullLevels[i] = static_cast<uint8_t>(level);
+				chunkLevelCounts[chunk * levels + level]++;
+			}
+			chunkVisible[chunk] = visible;
+		}
+	});
+
+	occludedCount = 0;
+	for (size_t occluded : chunkOccluded)
+		occludedCount += occluded;
+
+	// chunkLevelCounts becomes where each chunk's instances of each level start
+	_levelCounts.assign(levels, 0);
+	size_t visible = 0;
+	for (unsigned int level = 0; level < levels; level++)
+		for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+			size_t& slot = chunkLevelCounts[chunk * levels + level];
+			_levelCounts[level] += slot;
+			std::swap(slot, visible);
+			visible += slot;
+		}
+
+	float* destination = static_cast<float*>(_destination);
+	_pool.ParallelFor(chunkCount, 1, [&](size_t _firstChunk, size_t _lastChunk) {
+		for (size_t chunk = _firstChunk; chunk < _lastChunk; chunk++) {
+			size_t* next = &chunkLevelCounts[chunk * levels];
+			for (size_t i = chunk * chunkSize; i < chunk * chunkSize + chunkVisible[chunk]; i++)
+				if (cullLevels[i] != occludedLevel)
+					std::memcpy(destination + next[cullLevels[i]]++ * stride, &cullStaging[i * stride], stride * sizeof(float));
+		}
+	});
+
+#ifdef _DEBUG
+	if (!VerifyStaged(_frustum, _localBounds, _layout, visible, chunkSize, _occlusion))
+		std::cout << "InstanceTransforms: culling disagrees with the brute-force frustum test (" << visible << " visible)\n";
+#endif
+	return visible;
+}
+
+// A cube around the rotated bounding sphere: cheap, and it doesn't change as the instance spins
+inline void InstanceTransforms::GetOcclusionBox(size_t _index, const BoundingSphere& _localBounds, glm::vec3& _min, glm::vec3& _max) const
+{
+	glm::vec3 center = GetPosition(_index) + GetRotation(_index) * (_localBounds.center * scale[_index]);
+	glm::vec3 extent(_localBounds.radius * scale[_index]);
+	_min = center - extent;
+	_max = center + extent;
+}
+
+inline bool InstanceTransforms::VerifyVisible(const Frustum& _frustum, const BoundingSphere& _localBounds, const void* _visible,
+	OutputLayout _layout, size_t _visibleCount, const OcclusionBuffer* _occlusion) const
+{
+	if (!VerifyVisibleCount(_frustum, _localBounds, _visibleCount, _occlusion))
+		return false;
+	for (size_t i = 0; i < _visibleCount; i++)
+		if (!MayBeVisible(_frustum, _localBounds, DecodeInstance(_layout, _visible, i, quantization)))
+			return false;
+	return true;
+}
+
+inline bool InstanceTransforms::VerifyStaged(const Frustum& _frustum, const BoundingSphere& _localBounds, OutputLayout _layout,
+	size_t _visibleCount, size_t _chunkSize, const OcclusionBuffer* _occlusion) const
+{
+	if (!VerifyVisibleCount(_frustum, _localBounds, _visibleCount, _occlusion))
+		return false;
+	const size_t stride = GetOutputStride(_layout) / sizeof(float);
+	for (size_t chunk = 0; chunk < chunkVisible.size(); chunk++) {
+		const float* staged = &cullStaging[chunk * _chunkSize * stride];
+		for (size_t i = 0; i < chunkVisible[chunk]; i++)
+			if (!(_occlusion && cullLevels[chunk * _chunkSize + i] == occludedLevel) &&
+				!MayBeVisible(_frustum, _localBounds, DecodeInstance(_layout, staged, i, quantization)))
+				return false;
+	}
+	return true;
+}
+
+inline float InstanceTransforms::VisibilityMargin(const BoundingSphere& _sphere)
+{
+	return 1e-4f * (1.0f + _sphere.radius + glm::length(_sphere.center));
+}
+
+inline bool InstanceTransforms::VerifyVisibleCount(const Frustum& _frustum, const BoundingSphere& _localBounds, size_t _visibleCount,
+	const OcclusionBuffer* _occlusion) const
+{
+	// Every instance that is clearly inside must be counted, and nothing clearly outside
+	size_t surelyVisible = 0, maybeVisible = 0;
+	for (size_t i = 0; i < GetCount(); i++) {
+		if (_occlusion) {
+			glm::vec3 boxMin, boxMax;
+			GetOcclusionBox(i, _localBounds, boxMin, boxMax);
+			if (!_occlusion->IsBoxVisible(boxMin, boxMax))
+				continue;
+		}
+		BoundingSphere sphere{ glm::vec3(GetMatrix(i) * glm::vec4(_localBounds.center, 1.0f)), _localBounds.radius * scale[i] };
+		surelyVisible += _frustum.IntersectsSphere(sphere.center, sphere.radius - VisibilityMargin(sphere)) ? 1 : 0;
+		maybeVisible += _frustum.IntersectsSphere(sphere.center, sphere.radius + VisibilityMargin(sphere)) ? 1 : 0;
+	}
+	return _visibleCount >= surelyVisible && _visibleCount <= maybeVisible;
+}
+
+// A written matrix must belong to an instance that may be visible
+inline bool InstanceTransforms::MayBeVisible(const Frustum& _frustum, const BoundingSphere& _localBounds, const glm::mat4& _model) const
+{
+	BoundingSphere sphere{ glm::vec3(_model * glm::vec4(_localBounds.center, 1.0f)), _localBounds.radius * glm::length(glm::vec3(_model[0])) };
+	return _frustum.IntersectsSphere(sphere.center, sphere.radius + VisibilityMargin(sphere));
+}
+
+inline InstanceTransforms::EncodingError InstanceTransforms::MeasureEncodingError(const void* _output, OutputLayout _layout) const
+{
+	EncodingError error;
+	for (size_t i = 0; i < GetCount(); i++) {
+		glm::mat4 expected = GetMatrix(i), decoded = DecodeInstance(_layout, _output, i, quantization);
+		for (int column = 0; column < 4; column++)
+			for (int row = 0; row < 3; row++) {
+				float& maximum = column == 3 ? error.position : error.linear;
+				maximum = std::max(maximum, std::abs(decoded[column][row] - expected[column][row]));
+			}
+	}
+	return error;
+}
+
+inline bool InstanceTransforms::VerifyEncoding(const void* _output, OutputLayout _layout) const
+{
+	// Float formats: rounding relative to the largest position and scale
+	const float largestPosition = glm::max(glm::max(std::abs(minimum.x), std::abs(maximum.x)),
+		glm::max(glm::max(std::abs(minimum.y), std::abs(maximum.y)), glm::max(std::abs(minimum.z), std::abs(maximum.z))));
+	float positionTolerance = 1e-5f * (1.0f + largestPosition);
+	float linearTolerance = 1e-5f * (1.0f + maximum.w);
+	if (_layout == OutputLayout::Quantized) {
+		// Half a unorm16 step per axis, and a few snorm16 steps of the quaternion spread over a rotation entry
+		positionTolerance += 0.5f * glm::max(quantization.extent.x, glm::max(quantization.extent.y, quantization.extent.z)) / 65535.0f;
+		linearTolerance += 0.5f * quantization.extent.w / 65535.0f + maximum.w * 8.0f / 32767.0f;
+	}
+	EncodingError error = MeasureEncodingError(_output, _layout);
+	return error.position <= positionTolerance && error.linear <= linearTolerance;
+}
+
+inline glm::mat4 InstanceTransforms::GetMatrix(size_t _index) const
+{
+	glm::quat rotation(rotationW[_index], rotationX[_index], rotationY[_index], rotationZ[_index]);
+	glm::mat4 model = glm::mat4_cast(rotation) * scale[_index];
+	model[3] = glm::vec4(positionX[_index], positionY[_index], positionZ[_index], 1.0f);
+	return model;
+}
+
+template<class Lanes>
+inline size_t InstanceTransforms::Kernel(float _deltaTime, float* _destination, OutputLayout _layout, size_t _begin, size_t _end,
+	const Frustum* _frustum, const BoundingSphere& _localBounds, uint32_t* _visibleIndices)
+{
+	using L = Lanes;
+	using Float = typename L::Float;
+	const size_t stride = GetOutputStride(_layout) / sizeof(float);
+	const Float zero = L::Splat(0.0f), one = L::Splat(1.0f), two = L::Splat(2.0f);
+	const Float halfDeltaTime = L::Splat(0.5f * _deltaTime);
+	const FrustumLanes<L> frustum(_frustum ? *_frustum : Frustum());
+	const Float centerX = L::Splat(_localBounds.center.x), centerY = L::Splat(_localBounds.center.y), centerZ = L::Splat(_localBounds.center.z);
+	const Float radius = L::Splat(_localBounds.radius);
+	// Quantized: (value - offset) * 65535 / extent
+	const Float offsetX = L::Splat(quantization.offset.x), offsetY = L::Splat(quantization.offset.y);
+	const Float offsetZ = L::Splat(quantization.offset.z), offsetScale = L::Splat(quantization.offset.w);
+	const Float stepsX = L::Splat(65535.0f / quantization.extent.x), stepsY = L::Splat(65535.0f / quantization.extent.y);
+	const Float stepsZ = L::Splat(65535.0f / quantization.extent.z), stepsScale = L::Splat(65535.0f / quantization.extent.w);
+	const Float snorm = L::Splat(32767.0f);
+	const int allCulled = (1 << L::width) - 1;
+	size_t written = 0;
+
+	for (size_t i = _begin; i < _end; i += L::width) {
+		// Spin this frame as a quaternion: (axis * sin(angle / 2), cos(angle / 2))
+		Float sinHalf, cosHalf;
+		simd_lanes::SinCos<L>(L::Mul(L::Load(&speed[i]), halfDeltaTime), sinHalf, cosHalf);
+		Float dx = L::Mul(L::Load(&axisX[i]), sinHalf);
+		Float dy = L::Mul(L::Load(&axisY[i]), sinHalf);
+		Float dz = L::Mul(L::Load(&axisZ[i]), sinHalf);
+		Float dw = cosHalf;
+
+		// rotation * spin, i.e. the spin is applied in the instance's local space like glm::rotate(model, ...)
+		Float qx = L::Load(&rotationX[i]), qy = L::Load(&rotationY[i]), qz = L::Load(&rotationZ[i]), qw = L::Load(&rotationW[i]);
+		Float x = L::Add(L::Add(L::Mul(qw, dx), L::Mul(qx, dw)), L::Sub(L::Mul(qy, dz), L::Mul(qz, dy)));
+		Float y = L::Add(L::Sub(L::Mul(qw, dy), L::Mul(qx, dz)), L::Add(L::Mul(qy, dw), L::Mul(qz, dx)));
+		Float z = L::Add(L::Add(L::Mul(qw, dz), L::Mul(qx, dy)), L::Sub(L::Mul(qz, dw), L::Mul(qy, dx)));
+		Float w = L::Sub(L::Sub(L::Mul(qw, dw), L::Mul(qx, dx)), L::Add(L::Mul(qy, dy), L::Mul(qz, dz)));
+
+		// Renormalize every step so rounding never accumulates into shear
+		Float length = L::Sqrt(L::Add(L::Add(L::Mul(x, x), L::Mul(y, y)), L::Add(L::Mul(z, z), L::Mul(w, w))));
+		Float inverseLength = L::Div(one, length);
+		x = L::Mul(x, inverseLength);
+		y = L::Mul(y, inverseLength);
+		z = L::Mul(z, inverseLength);
+		w = L::Mul(w, inverseLength);
+		L::Store(&rotationX[i], x);
+		L::Store(&rotationY[i], y);
+		L::Store(&rotationZ[i], z);
+		L::Store(&rotationW[i], w);
+
+		// Rotation matrix (as glm::mat3_cast) times the uniform scale
+		Float s = L::Load(&scale[i]);
+		Float s2 = L::Mul(s, two);
+		Float xx = L::Mul(x, x), yy = L::Mul(y, y), zz = L::Mul(z, z);
+		Float xy = L::Mul(x, y), xz = L::Mul(x, z), yz = L::Mul(y, z);
+		Float wx = L::Mul(w, x), wy = L::Mul(w, y), wz = L::Mul(w, z);
+		Float m00 = L::Sub(s, L::Mul(s2, L::Add(yy, zz)));
+		Float m01 = L::Mul(s2, L::Add(xy, wz));
+		Float m02 = L::Mul(s2, L::Sub(xz, wy));
+		Float m10 = L::Mul(s2, L::Sub(xy, wz));
+		Float m11 = L::Sub(s, L::Mul(s2, L::Add(xx, zz)));
+		Float m12 = L::Mul(s2, L::Add(yz, wx));
+		Float m20 = L::Mul(s2, L::Add(xz, wy));
+		Float m21 = L::Mul(s2, L::Sub(yz, wx));
+		Float m22 = L::Sub(s, L::Mul(s2, L::Add(xx, yy)));
+		Float px = L::Load(&positionX[i]), py = L::Load(&positionY[i]), pz = L::Load(&positionZ[i]);
+
+		if (!_destination)
+			continue;
+
+		// Culled lanes are dropped; the others are transposed into a block and packed from there
+		float* out = _destination + i * stride;
+		int culled = 0;
+		float block[L::width * 16];
+		if (_frustum) {
+			Float worldX = L::Add(px, L::Add(L::Add(L::Mul(m00, centerX), L::Mul(m10, centerY)), L::Mul(m20, centerZ)));
+			Float worldY = L::Add(py, L::Add(L::Add(L::Mul(m01, centerX), L::Mul(m11, centerY)), L::Mul(m21, centerZ)));
+			Float worldZ = L::Add(pz, L::Add(L::Add(L::Mul(m02, centerX), L::Mul(m12, centerY)), L::Mul(m22, centerZ)));
+			culled = frustum.CullMask(worldX, worldY, worldZ, L::Mul(radius, s));
+			if (culled == allCulled)
+				continue;
+			out = culled ? block : _destination + written * stride;
+		}
+
+		switch (_layout) {
+		case OutputLayout::Mat4:
+			L::StoreTransposed(out, stride, m00, m01, m02, zero);
+			L::StoreTransposed(out + 4, stride, m10, m11, m12, zero);
+			L::StoreTransposed(out + 8, stride, m20, m21, m22, zero);
+			L::StoreTransposed(out + 12, stride, px, py, pz, one);
+			break;
+		case OutputLayout::Mat3x4:
+			L::StoreTransposed(out, stride, m00, m10, m20, px);
+			L::StoreTransposed(out + 4, stride, m01, m11, m21, py);
+			L::StoreTransposed(out + 8, stride, m02, m12, m22, pz);
+			break;
+		case OutputLayout::PositionScaleRotation:
+			L::StoreTransposed(out, stride, px, py, pz, s);
+			L::StoreTransposed(out + 4, stride, x, y, z, w);
+			break;
+		case OutputLayout::Quantized:
+			// Each float lane carries two 16-bit values; the bits are only moved from here on
+			L::StoreTransposed(out, stride,
+				L::PackInt16x2(L::Mul(L::Sub(px, offsetX), stepsX), L::Mul(L::Sub(py, offsetY), stepsY)),
+				L::PackInt16x2(L::Mul(L::Sub(pz, offsetZ), stepsZ), L::Mul(L::Sub(s, offsetScale), stepsScale)),
+				L::PackInt16x2(L::Mul(x, snorm), L::Mul(y, snorm)),
+				L::PackInt16x2(L::Mul(z, snorm), L::Mul(w, snorm)));
+			break;
+		}
+
+		if (!_frustum)
+			continue;
+		if (culled == 0) {
+			if (_visibleIndices)
+				for (size_t lane = 0; lane < L::width; lane++)
+					_visibleIndices[written + lane] = static_cast<uint32_t>(i + lane);
+			written += L::width;
+			continue;
+		}
+		for (size_t lane = 0; lane < L::width; lane++) {
+			if (culled & (1 << lane))
+				continue;
+			std::memcpy(_destination + written * stride, block + lane * stride, stride * sizeof(float));
+			if (_visibleIndices)
+				_visibleIndices[written] = static_cast<uint32_t>(i + lane);
+			written++;
+		}
+	}
+	return _frustum ? written : _end - _begin;
+}
@@ -1,10 +1,17 @@
-#include <random>
+#include <chrono>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <glm/gtc/type_ptr.hpp>
 
 #include "camera.h"
+#include "impostor_atlas.h"
+#include "instance_animation.h"
+#include "instance_buffer.h"
+#include "instance_scatter.h"
+#include "instance_transforms.h"
+#include "lod_selector.h"
 #include "model.h"
+#include "occlusion_buffer.h"
 #include "shader.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -26,6 +33,14 @@ bool firstMouse = true;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
+// instance encoding of the rocks, switched with keys 1-4; G animates them on the GPU instead
+InstanceFormat instanceFormat = InstanceFormat::Mat4;
+bool gpuAnimation = false;
+// distant rocks as impostors, I to turn on and M for meshes only
+bool rockImpostors = true;
+// rocks hidden by the planet culled on the CPU, O to turn on and P for frustum culling only
+bool rockOcclusion = true;
+
 int main()
 {
 	// glfw & glew configs
@@ -55,103 +70,149 @@ int main()
 	}
 
 	// Load model(s)
-	Model rock("res/models/rock/rock.obj");
-	Model mars("res/models/planet/planet.obj");
+	// The rock is drawn thousands of times, so reorder it for the vertex cache at import, with four
+	// simplified levels of detail for the distant ones
+	ModelOptions rockOptions;
+	rockOptions.optimizeVertexCache = true;
+	rockOptions.lodLevels = 4;
+	Model rock("res/models/rock/rock.obj", rockOptions);
+	// The planet fills the view up close, so it is split into meshlets and only the ones in view and facing
+	// the camera are drawn
+	ModelOptions marsOptions;
+	marsOptions.optimizeVertexCache = true;
+	marsOptions.buildMeshlets = true;
+	Model mars("res/models/planet/planet.obj", marsOptions);
 	//Model nanosuit("res/models/nanosuit.obj");
 
 	// Build & compile shader(s)
 	Shader marsShader("res/shaders/instancing_mars.vs", "res/shaders/instancing_mars.fs");
-	Shader rockShader("res/shaders/instancing_rock.vs", "res/shaders/instancing_rock.fs");
+	// Reads every InstanceFormat
+	Shader impostorShader("res/shaders/impostor.vs", "res/shaders/impostor.fs");
+	// One rock vertex shader per InstanceFormat, in enum order
+	Shader rockShaders[] = {
+		Shader("res/shaders/instancing_rock.vs", "res/shaders/instancing_rock.fs"),
+		Shader("res/shaders/instancing_rock_mat3x4.vs", "res/shaders/instancing_rock.fs"),
+		Shader("res/shaders/instancing_rock_quat.vs", "res/shaders/instancing_rock.fs"),
+		Shader("res/shaders/instancing_rock_quantized.vs", "res/shaders/instancing_rock.fs"),
+	};
+
+	// Rocks whose bounding sphere is outside the view are culled while their transformations are updated
+	BoundingSphere rockBounds = rock.GetBoundingSphere();
+
+	// Each visible rock is drawn at the coarsest level that is off by at most a pixel where it is
+	LodSelector rockLod(rock.GetLevelErrors(), glm::radians(45.0f), static_cast<float>(SCR_HEIGHT));
+	std::vector<size_t> rockLevelCounts;
+	for (unsigned int level = 0; level < rock.GetLevelCount(); level++)
+		std::cout << "rock LOD " << level << ": " << rock.GetTriangleCount(level) << " triangles, error "
+			<< rock.GetLevelErrors()[level] << " (" << 100.0f * rock.GetLevelErrors()[level] / rockBounds.radius << "% of the radius)\n";
+
+	// Rocks farther than rockImpostorDistance are drawn as quads showing the rock from the nearest of the
+	// directions baked into its impostor atlas, which is made once and then loaded from next to the model
+	const float rockImpostorDistance = 60.0f;
+	ImpostorAtlas rockImpostor;
+	auto bakeStart = std::chrono::high_resolution_clock::now();
+	if (rockImpostor.LoadOrBake("res/models/rock/rock.obj", rock)) {
+		const float pixelsPerUnit = SCR_HEIGHT / (2.0f * std::tan(glm::radians(45.0f) / 2.0f));
+		std::cout << "rock impostor: " << rockImpostor.GetSettings().gridSize << "^2 frames of " << rockImpostor.GetSettings().frameResolution
+			<< " px, " << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - bakeStart).count()
+			<< " ms to load or bake, " << 100.0f * rockImpostor.GetCoverage() << "% covered; the largest rock spans "
+			<< 2.0f * rockBounds.radius * RingScatter::Settings().maxScale * pixelsPerUnit / rockImpostorDistance
+			<< " px at " << rockImpostorDistance << "\n";
+	}
+	else {
+		std::cout << "rock impostor unavailable, drawing meshes only\n";
+	}
 
-	// Generate a large list of semi-random model transformation matrices
+	// Generate a large list of semi-random rock transformations: a ring of radius 50 with every rock
+	// displaced by up to 5 units, placed in parallel and identical on every run for the same seed.
+	// Separated placement keeps the rocks from intersecting and may place fewer when the ring is full
 	unsigned int amount = 5000;
-	glm::mat4* modelMatrices = new glm::mat4[amount]; // the actual data storing the model matrices
-	glm::vec3* axis = new glm::vec3[amount]; // Stores the rotation axis for each rock instance
-
-	std::random_device rd;
-	std::mt19937 gen(rd()); // Initialize Mersenne Twister random number generator
-	std::uniform_real_distribution<float> dis(-1.0, 1.0);
-	std::uniform_real_distribution<float> scaleDis(0.05, 0.2);
-	std::uniform_real_distribution<float> angleDis(0.0, 360.0);
-	std::uniform_real_distribution<float> axisDis(0.0, 1.0);
-
-	float radius = 50.0f;
-
-	// Offset: Controls the random displacement of each rock. 
-    // Choose a rational range to minimize rock collisions.
-	float offset = 5.0f; 
-
-	// Loop to initialize each rock's model matrix
-	// Notice: reversed order here
-	for (size_t i = 0; i < amount; i++) {
-		glm::mat4 model = glm::mat4(1.0f);
-
-		// 3. Translation: Displace each rock along a circle with a radius and a random offset
-		float angle = (float)(i) / (float)(amount) * 360.0f;
-		float x = sin(angle) * radius + dis(gen) * offset;
-		float y = 0.6 * dis(gen) * offset;
-		float z = cos(angle) * radius + dis(gen) * offset;
-		model = glm::translate(model, glm::vec3(+x, +y, +z));
-
-		// 2. Scaling: Randomly scale each rock
-		float scale = scaleDis(gen);
-		model = glm::scale(model, glm::vec3(scale));
-
-		// 1. Rotation: Apply a random initial rotation around a random axis
-		float rotAngle = angleDis(gen);
-		glm::vec3 randomAxis(axisDis(gen), axisDis(gen), axisDis(gen));
-		model = glm::rotate(model, glm::radians(rotAngle), randomAxis);
-		axis[i] = randomAxis; // Store this axis for later use
-
-		// 4. Store the model matrix
-		modelMatrices[i] = model;
+	const uint64_t rockSeed = 1;
+	const bool separateRocks = true;
+	InstanceTransforms rockTransforms; // position, rotation, scale and spin of every rock
+	if (separateRocks) {
+		std::cout << "rock placement: " << RingScatter(rockSeed).ScatterSeparated(rockTransforms, amount, rockBounds) << "\n";
+		amount = static_cast<unsigned int>(rockTransforms.GetCount());
+	}
+	else {
+		RingScatter(rockSeed).Scatter(rockTransforms, amount);
 	}
-
-	// Generate a random rotation speed array for rocks
-	float* rotationSpeeds = new float[amount];
-	std::uniform_real_distribution<float>angleDistribution(4.0f, 8.0f);
-	for (size_t i = 0; i < amount; i++) 
-		rotationSpeeds[i] = angleDistribution(gen);  // Random rotation speed
 
 	// configure instanced array
-	unsigned int instancingBuffer;
-	glGenBuffers(1, &instancingBuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, instancingBuffer);
-	glBufferData(GL_ARRAY_BUFFER, amount * sizeof(glm::mat4), &modelMatrices[0][0], GL_STATIC_DRAW);
-
-	// Loop through each mesh in the rock model
-	for (unsigned int i = 0; i < rock.meshes.size(); i++) {
-		// Bind the VAO of the current mesh
-		unsigned int VAO = rock.meshes[i].GetVAO();
-		glBindVertexArray(VAO);
-
-		// Enable and set vertex attributes for the model matrix.
-		// A mat4 is treated as an array of 4 vec4s.
-		for (int j = 0; j < 4; j++) {
-			// Enable the vertex attribute at location 3 + j
-			glEnableVertexAttribArray(3 + j);
-
-			// Specify how the data for that attribute is retrieved from the array
-			glVertexAttribPointer(3 + j, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(sizeof(glm::vec4)* j));
-
-			// Set the attribute divisor to 1 to update the attribute once per instance
-			glVertexAttribDivisor(3 + j, 1);
-		}
-
-		glBindVertexArray(0);
+	// The per-frame spin runs on the thread pool and writes straight into the mapped instance buffer,
+	// a ring of three frames so the CPU never writes what the GPU is still reading; sized for the largest format
+	InstanceBuffer instancingBuffer(amount * GetInstanceStride(InstanceFormat::Mat4));
+	rockTransforms.Write(instancingBuffer.BeginWrite(amount * GetInstanceStride(instanceFormat)), instanceFormat);
+	instancingBuffer.EndWrite();
+
+	// The same rocks animated by a transform feedback pass, from the state before any CPU update
+	InstanceAnimation rockAnimation(rockTransforms);
+	float animationTime = 0.0f;
+
+	// The quantized rocks are stored relative to the bounds of the whole field
+	Shader& quantizedShader = rockShaders[static_cast<int>(InstanceFormat::Quantized)];
+	quantizedShader.Bind();
+	quantizedShader.SetVec4("instanceOffset", rockTransforms.GetQuantization().offset);
+	quantizedShader.SetVec4("instanceExtent", rockTransforms.GetQuantization().extent);
+	impostorShader.Bind();
+	impostorShader.SetVec4("instanceOffset", rockTransforms.GetQuantization().offset);
+	impostorShader.SetVec4("instanceExtent", rockTransforms.GetQuantization().extent);
+
+	// Uniform locations for the per-frame setters, resolved once
+	Shader::Uniform marsProjection = marsShader.GetUniform("projection");
+	Shader::Uniform marsView = marsShader.GetUniform("view");
+	Shader::Uniform marsModel = marsShader.GetUniform("model");
+	Shader::Uniform rockProjections[4], rockViews[4];
+	for (int i = 0; i < 4; i++) {
+		rockProjections[i] = rockShaders[i].GetUniform("projection");
+		rockViews[i] = rockShaders[i].GetUniform("view");
 	}
+	Shader::Uniform impostorProjection = impostorShader.GetUniform("projection");
+	Shader::Uniform impostorView = impostorShader.GetUniform("view");
+	Shader::Uniform impostorCamera = impostorShader.GetUniform("cameraPosition");
+
+	// Binds go through the GL shadow state; meshes stay bound after drawing instead of restoring 0
+	GLState::Get().SetUnbindAfterDraw(false);
 
 	int counter = 0;
 	const int maxPrints = 50;
+	double updateMs = 0.0;
+	size_t visibleRocks = amount;
+	size_t rockTriangles = 0;
+	size_t impostorRocks = 0;
+	MeshletCullStats marsCulling;
+	// The planet is the only occluder; a quarter of the window in each direction is plenty for it
+	OcclusionBuffer occlusion(SCR_WIDTH / 4, SCR_HEIGHT / 4);
+	size_t occludedRocks = 0;
 	while (!glfwWindowShouldClose(window)) {
 		// Per-frame logic
 		float currentFrame = glfwGetTime();
 		deltaTime = currentFrame - lastFrame;
 		lastFrame = currentFrame;
 		if (counter < maxPrints) {
-			std::cout << "fps: " << 1.0f / deltaTime << "\n";
+			std::cout << "fps: " << 1.0f / deltaTime << ", rock update: " << updateMs << " ms, visible rocks: "
+				<< visibleRocks << "/" << amount << ", " << GetInstanceFormatName(instanceFormat) << " instances ("
+				<< (gpuAnimation ? "animated on the GPU" : std::to_string(visibleRocks * GetInstanceStride(instanceFormat)) + " bytes") << ")\n";
+			std::cout << "rock triangles: " << rockTriangles << " (" << visibleRocks * rock.GetTriangleCount() << " at full detail), "
+				<< impostorRocks << " impostors\n";
+			std::cout << "planet meshlets: " << marsCulling.meshlets << ", " << marsCulling.frustumCulled << " outside the view, "
+				<< marsCulling.backfaceCulled << " facing away, " << marsCulling.trianglesDrawn << "/" << marsCulling.triangles
+				<< " triangles in " << marsCulling.ranges << " ranges\n";
+			if (rockOcclusion && !gpuAnimation)
+				std::cout << "occlusion: " << occludedRocks << " rocks behind the planet, " << occlusion.GetStats().rasterizedTriangles
+					<< "/" << occlusion.GetStats().occluderTriangles << " occluder triangles in " << occlusion.GetStats().rasterizeMs << " ms\n";
+			// Calls made through Shader last frame; every set used to add its own glGetUniformLocation
+			const Shader::CallCounters& calls = Shader::GetCallCounters();
+			std::cout << "uniform calls: " << calls.uniformUploads << " uploads + " << calls.locationQueries << " location queries, "
+				<< calls.namedSets << " by name from the location table\n";
+			std::cout << "GL state: " << GLState::Get().GetCounters() << "\n";
+			// Stalls mean the CPU ran more than two frames ahead of the GPU and waited for it
+			std::cout << "instance stream (" << (instancingBuffer.IsPersistent() ? "persistent" : "orphaned") << "): "
+				<< instancingBuffer.GetStats() << "\n";
 			counter++;
 		}
+		Shader::ResetCallCounters();
+		GLState::Get().ResetCounters();
 		
 		// Render
 		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
@@ -160,57 +221,91 @@ int main()
 		// Process input
 		ProcessInput(window);
 
-		// Update the rotation of each rock around its own random axis at a random speed.
-		// Using deltaTime to ensure frame-rate independent rotation
-		for (unsigned int i = 0; i < amount; i++) {
-			glm::mat4 model = modelMatrices[i];
-
-			// Rotate around the rock's own axis
-			float angle = rotationSpeeds[i] * deltaTime;
-			model = glm::rotate(model, angle, axis[i]); // random angle & random axis
-			modelMatrices[i] = model;
-		}
-		// Update the buffer with the new transformations
-		glBindBuffer(GL_ARRAY_BUFFER, instancingBuffer);
-		glBufferSubData(GL_ARRAY_BUFFER, 0, amount * sizeof(glm::mat4), &modelMatrices[0][0]);
-
 		// Configure transformation matrices
 		glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 1000.0f);
 		glm::mat4 view = camera.GetViewMatrix();
 		glm::mat4 model = glm::mat4(1.0f);
+		model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
+		model = glm::scale(model, glm::vec3(4.0f));
+
+		// Update the rotation of each rock around its own random axis at a random speed.
+		// Using deltaTime to ensure frame-rate independent rotation.
+		// The next segment of the instance ring is mapped, so the workers write the new transformations
+		// in place, only for the rocks inside the view frustum.
+		// Rocks are grouped by level of detail as they are written, impostors last.
+		// On the GPU every rock is evaluated at the animation time and drawn at full detail, with nothing uploaded.
+		auto updateStart = std::chrono::high_resolution_clock::now();
+		animationTime += deltaTime;
+		if (gpuAnimation) {
+			instanceFormat = InstanceAnimation::outputFormat;
+			rockAnimation.Update(animationTime);
+			visibleRocks = amount;
+			rockLevelCounts.assign(1, amount);
+		}
+		else {
+			rockLod.SetCamera(camera.position);
+			rockLod.SetImpostorDistance(rockImpostors && rockImpostor.IsValid() ? rockImpostorDistance : 0.0f);
+			// The planet's depth at low resolution, then every rock in the frustum is tested against it
+			if (rockOcclusion) {
+				occlusion.Clear(projection * view);
+				for (const Mesh& mesh : mars.meshes)
+					occlusion.RasterizeTriangles(mesh.vertices, mesh.indices, model);
+				occlusion.BuildHierarchy();
+			}
+			visibleRocks = rockTransforms.UpdateVisibleLod(deltaTime, Frustum::FromMatrix(projection * view), rockBounds, rockLod,
+				instancingBuffer.BeginWrite(amount * GetInstanceStride(instanceFormat)), rockLevelCounts, instanceFormat,
+				ThreadPool::Global(), rockOcclusion ? &occlusion : nullptr);
+			instancingBuffer.EndWrite();
+			occludedRocks = rockTransforms.GetOccludedCount();
+		}
+		const unsigned int rockLevels = std::min(static_cast<unsigned int>(rockLevelCounts.size()), rock.GetLevelCount());
+		impostorRocks = rockLevelCounts.size() > rockLevels ? rockLevelCounts[rockLevels] : 0;
+		rockTriangles = 2 * impostorRocks;
+		for (unsigned int level = 0; level < rockLevels; level++)
+			rockTriangles += rockLevelCounts[level] * rock.GetTriangleCount(level);
+		updateMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - updateStart).count();
 
 		// Draw planet(mars)
 		marsShader.Bind();
-		marsShader.SetMat4("projection", projection);
-		marsShader.SetMat4("view", view);
-		model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
-		model = glm::scale(model, glm::vec3(4.0f));
-		marsShader.SetMat4("model", model);
-		mars.Draw(marsShader);
+		marsShader.SetMat4(marsProjection, projection);
+		marsShader.SetMat4(marsView, view);
+		marsShader.SetMat4(marsModel, model);
+		marsCulling = mars.DrawCulled(marsShader, model, Frustum::FromMatrix(projection * view), camera.position);
 
 		// Draw amount of rocks
+		const int format = static_cast<int>(instanceFormat);
+		Shader& rockShader = rockShaders[format];
 		rockShader.Bind();
-		rockShader.SetMat4("projection", projection);
-		rockShader.SetMat4("view", view);
-		//rockShader.SetInt("texture_normal1", 0);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, rock.textures_loaded[0].id);
-
-		// Special case: The rock model has only one mesh.
-        // Directly bind its VAO and draw it instanced.
-        // Note: This won't work for models with multiple meshes.
-		glBindVertexArray(rock.meshes[0].GetVAO());
-		glDrawElementsInstanced(GL_TRIANGLES, (unsigned int)(rock.meshes[0].indices.size()), GL_UNSIGNED_INT, 0, amount);
-		glBindVertexArray(0);
+		rockShader.SetMat4(rockProjections[format], projection);
+		rockShader.SetMat4(rockViews[format], view);
+		// One instanced draw per mesh of the rock model and level of detail, reading the segment written this frame
+		if (gpuAnimation) {
+			rock.DrawInstanced(rockShader, rockAnimation.GetOutputBuffer(), 0, static_cast<unsigned int>(visibleRocks), instanceFormat);
+		}
+		else {
+			size_t firstRock = 0;
+			for (unsigned int level = 0; level < rockLevels; level++) {
+				rock.DrawInstanced(rockShader, instancingBuffer, static_cast<unsigned int>(rockLevelCounts[level]), instanceFormat, level,
+					static_cast<unsigned int>(firstRock));
+				firstRock += rockLevelCounts[level];
+			}
+
+			// The farthest rocks, after all the meshes
+			if (impostorRocks) {
+				impostorShader.Bind();
+				impostorShader.SetMat4(impostorProjection, projection);
+				impostorShader.SetMat4(impostorView, view);
+				impostorShader.SetVec3(impostorCamera, camera.position);
+				rockImpostor.DrawInstanced(impostorShader, instancingBuffer, static_cast<unsigned int>(impostorRocks), instanceFormat,
+					static_cast<unsigned int>(firstRock));
+			}
+		}
 
 		// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
 		glfwSwapBuffers(window);
 		glfwPollEvents();
 	}
 
-	delete[] modelMatrices;
-	delete[] axis;
-	delete[] rotationSpeeds;
 	glfwTerminate();
 }
 
@@ -229,6 +324,27 @@ void ProcessInput(GLFWwindow* window)
 		camera.ProcessKeyboard(LEFT, deltaTime);
 	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
 		camera.ProcessKeyboard(RIGHT, deltaTime);
+
+	// 1: mat4, 2: mat3x4, 3: position+scale+quaternion, 4: quantized, all updated on the CPU
+	for (int i = 0; i < 4; i++)
+		if (glfwGetKey(window, GLFW_KEY_1 + i) == GLFW_PRESS) {
+			instanceFormat = static_cast<InstanceFormat>(i);
+			gpuAnimation = false;
+		}
+	if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS)
+		gpuAnimation = true;
+
+	// I: distant rocks as impostors (if the atlas could be made), M: meshes for all
+	if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS)
+		rockImpostors = true;
+	if (glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS)
+		rockImpostors = false;
+
+	// O: cull the rocks behind the planet, P: frustum culling only
+	if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS)
+		rockOcclusion = true;
+	if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS)
+		rockOcclusion = false;
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
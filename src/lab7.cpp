@@ -105,7 +105,7 @@ int main()
 	glGenVertexArrays(1, &VAO);
 	glGenBuffers(1, &VBO);
 
-	glBindVertexArray(VAO);
+	GLState::Get().BindVertexArray(VAO);
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
@@ -160,7 +160,7 @@ int main()
 
 void drawFloorAndCubes(Shader& shader)
 {
-	glBindVertexArray(VAO);
+	GLState::Get().BindVertexArray(VAO);
 
 	//floor
 	shader.Bind();
@@ -181,7 +181,7 @@ void drawFloorAndCubes(Shader& shader)
 			}
 		}
 	}
-	glBindVertexArray(0);
+	GLState::Get().BindVertexArray(0);
 }
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Level of detail per instance from its projected size: an instance gets the coarsest level whose error,
+// scaled with the instance and projected at its distance from the camera, stays within maxPixelError
+// pixels. Each level thus has a switch distance per unit of scale, and selection is one squared distance
+// compared against them. Optionally, instances beyond an impostor distance go into one more bucket after
+// the levels, for a renderer that draws them as ImpostorAtlas quads instead of meshes.
+class LodSelector
+{
+public:
+	static constexpr unsigned int maxLevels = 8;
+
+	LodSelector() = default;
+
+	// _levelErrors: per level, full detail first, the error in model units (see Model::GetLevelErrors)
+	LodSelector(const std::vector<float>& _levelErrors, float _fovY, float _viewportHeight, float _maxPixelError = 1.0f)
+		: levelCount(static_cast<unsigned int>(std::min<size_t>(std::max<size_t>(_levelErrors.size(), 1), maxLevels))),
+		pixelsPerUnit(_viewportHeight / (2.0f * std::tan(0.5f * _fovY))), maxPixelError(_maxPixelError)
+	{
+		// Errors only grow with the level, so the switch distances do too
+		float error = 0.0f;
+		for (unsigned int level = 0; level < levelCount; level++) {
+			error = std::max(error, level < _levelErrors.size() ? _levelErrors[level] : 0.0f);
+			errors[level] = error;
+			float distance = error * pixelsPerUnit / maxPixelError;
+			switchDistanceSquared[level] = distance * distance;
+		}
+	}
+
+	void SetCamera(const glm::vec3& _position) { camera = _position; }
+
+	// Centers at least _distance from the camera select GetImpostorBucket(); 0 turns impostors off
+	void SetImpostorDistance(float _distance) { impostorDistanceSquared = _distance * _distance; }
+
+	unsigned int Select(const glm::vec3& _position, float _scale) const
+	{
+		glm::vec3 offset = _position - camera;
+		// distance / scale >= switch distance, squared
+		float distanceSquared = glm::dot(offset, offset);
+		float scaleSquared = _scale * _scale;
+		if (impostorDistanceSquared > 0.0f && distanceSquared >= impostorDistanceSquared)
+			return levelCount;
+		unsigned int level = 0;
+		while (level + 1 < levelCount && distanceSquared >= switchDistanceSquared[level + 1] * scaleSquared)
+			level++;
+		return level;
+	}
+
+	// Error of _level in pixels for an instance at _distance with _scale
+	float GetProjectedError(unsigned int _level, float _distance, float _scale) const
+	{
+		return errors[std::min(_level, levelCount - 1)] * _scale * pixelsPerUnit / std::max(_distance, 1e-6f);
+	}
+
+	unsigned int GetLevelCount() const { return levelCount; }
+	// Levels plus the impostor bucket, if any; what Select can return is below this
+	unsigned int GetBucketCount() const { return levelCount + (HasImpostors() ? 1 : 0); }
+	unsigned int GetImpostorBucket() const { return levelCount; }
+	bool HasImpostors() const { return impostorDistanceSquared > 0.0f; }
+	float GetImpostorDistance() const { return std::sqrt(impostorDistanceSquared); }
+	float GetMaxPixelError() const { return maxPixelError; }
+
+private:
+	unsigned int levelCount = 1;
+	float pixelsPerUnit = 1.0f;    // at distance 1
+	float maxPixelError = 1.0f;
+	float impostorDistanceSquared = 0.0f;
+	float errors[maxLevels] = {};
+	float switchDistanceSquared[maxLevels] = {};
+	glm::vec3 camera = glm::vec3(0.0f);
+};
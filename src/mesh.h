@@ -1,20 +1,18 @@
 #pragma once
 
+#include <algorithm>
 #include <vector>
 #include <string>
 
 #include <GL/glew.h>
 
+#include "geometry_pool.h"
+#include "gl_state.h"
+#include "index_buffer.h"
+#include "meshlet_builder.h"
+#include "mesh_simplifier.h"
 #include "shader.h"
-
-struct Vertex
-{
-	glm::vec3 position;
-	glm::vec3 normal;
-	glm::vec2 texCoords;
-	glm::vec3 Tangent;
-	glm::vec3 Bitangent;
-};
+#include "vertex_format.h"
 
 struct Texture
 {
@@ -23,15 +21,26 @@ struct Texture
 	std::string path;
 };
 
+// Arguments of DrawRanges' multi-draws, owned by the caller so they are reused from frame to frame
+struct MultiDrawArgs
+{
+	std::vector<GLsizei> counts;
+	std::vector<const void*> offsets;
+	std::vector<GLint> baseVertices;
+};
+
 class Mesh
 {
 public:
 	// Constructors and Destructor
 	Mesh() = delete;  // Deleted default constructor
-	Mesh(const std::vector<Vertex>& vertices,
-		const std::vector<unsigned int>& indices,
-		const std::vector<Texture>& textures,
-		bool hasTangentAndBitangent);  // Parameterized constructor
+	Mesh(std::vector<Vertex> vertices,
+		std::vector<unsigned int> indices,
+		std::vector<Texture> textures,
+		bool hasTangentAndBitangent,
+		VertexFormat vertexFormat = VertexFormat::Float32,
+		std::vector<MeshLod> lods = {},
+		std::vector<Meshlet> meshlets = {});  // Parameterized constructor, takes ownership of the arrays
 	~Mesh();  // Destructor
 
 	// Move Semantics
@@ -45,34 +54,65 @@ public:
 
 	// Public Methods
 	void Draw(Shader& shader) const;  // Draw the mesh
+	void DrawInstanced(unsigned int instanceCount) const;  // Draw the geometry only, the caller binds textures
+	void BindTextures(const Shader& shader) const;  // Bind every texture to unit i and point its sampler at it
+	void DrawBound(unsigned int instanceCount, unsigned int level = 0, unsigned int baseInstance = 0) const;  // DrawInstanced with the pool's VAO already bound, leaves it bound
+	void DrawRanges(const std::vector<IndexRange>& ranges, MultiDrawArgs& args) const;  // Full-detail index ranges (e.g. CullMeshlets' output), the caller binds textures
 
 	// Accessors
-	unsigned int GetVAO() { return VAO; }
-	const unsigned int GetVAO() const { return VAO; }
+	unsigned int GetVAO() const { return GetPool().GetVAO(); }  // Shared by every mesh of the same vertex format
+	GeometryPool& GetPool() const { return GeometryPool::Get(vertexFormat); }
+	GeometryPool::Handle GetGeometry() const { return geometry; }
+	bool HasTangentAndBitangent() const { return hasTangentAndBitangent; }
+	VertexFormat GetVertexFormat() const { return vertexFormat; }
+	size_t GetVertexBufferSize() const { return vertices.size() * (vertexFormat == VertexFormat::Packed ? sizeof(PackedVertex) : sizeof(Vertex)); }
+	const VertexQuantizationError& GetQuantizationError() const { return quantizationError; }
+	GLenum GetIndexType() const { return indexType; }
+	size_t GetIndexBufferSize() const;  // All levels
+	const std::vector<IndexCluster>& GetIndexClusters() const { return levelClusters[0]; }  // Full detail
+
+	// Levels of detail: 0 is indices, level i > 0 is lods[i - 1]
+	unsigned int GetLevelCount() const { return static_cast<unsigned int>(lods.size()) + 1; }
+	size_t GetTriangleCount(unsigned int level = 0) const { return (level == 0 ? indices.size() : lods[level - 1].indices.size()) / 3; }
+	float GetLevelError(unsigned int level) const { return level == 0 ? 0.0f : lods[level - 1].error; }
 
 	// Public Members
 	std::vector<Vertex> vertices;
 	std::vector<unsigned int> indices;
+	std::vector<MeshLod> lods;  // Coarser triangle lists over the same vertices
+	std::vector<Meshlet> meshlets;  // Contiguous clusters of indices with culling bounds, empty unless built
 	std::vector<Texture> textures;
 
 private:
 	// Private Methods
-	void SetupMesh();  // Initialize OpenGL objects
+	void SetupMesh();  // Upload the geometry into the pool of its vertex format
+	void BuildSamplerNames();  // Sampler uniform name of every texture
 
 	// Private Members
-	unsigned int VAO, VBO, IBO;
+	GeometryPool::Handle geometry = GeometryPool::invalidHandle; // Vertex and index range in the pool
 	bool hasTangentAndBitangent = false;
+	VertexFormat vertexFormat = VertexFormat::Float32;
+	VertexQuantizationError quantizationError; // Only filled for VertexFormat::Packed
+	GLenum indexType = GL_UNSIGNED_SHORT;
+	std::vector<std::vector<IndexCluster>> levelClusters; // 16-bit draw ranges per level, one unless the mesh exceeds 65535 vertices
+	std::vector<std::string> samplerNames; // texture_diffuse1, texture_specular1, ... parallel to textures
 };
 
-Mesh::Mesh(const std::vector<Vertex>& _vertices, 
-	const std::vector<unsigned int>& _indices, 
-	const std::vector<Texture>& _textures,
-	bool _hasTangentAndBitangent)
+Mesh::Mesh(std::vector<Vertex> _vertices, 
+	std::vector<unsigned int> _indices, 
+	std::vector<Texture> _textures,
+	bool _hasTangentAndBitangent,
+	VertexFormat _vertexFormat,
+	std::vector<MeshLod> _lods,
+	std::vector<Meshlet> _meshlets)
 {
-	this->vertices = _vertices;
-	this->indices = _indices;
-	this->textures = _textures;
+	this->vertices = std::move(_vertices);
+	this->indices = std::move(_indices);
+	this->lods = std::move(_lods);
+	this->meshlets = std::move(_meshlets);
+	this->textures = std::move(_textures);
 	this->hasTangentAndBitangent = _hasTangentAndBitangent;
+	this->vertexFormat = _vertexFormat;
 #ifdef _DEBUG
 	if (hasTangentAndBitangent) {
 		std::cout << "Mesh has tangents and bitangents.\n";
@@ -81,26 +121,25 @@ Mesh::Mesh(const std::vector<Vertex>& _vertices,
 		std::cout << "Mesh does not have tangents and bitangents.\n";
 	}
 #endif
+	BuildSamplerNames();
 	SetupMesh();
 }
 
 Mesh::~Mesh()
 {
-	glDeleteVertexArrays(1, &VAO);
-	glDeleteBuffers(1, &VBO);
-	glDeleteBuffers(1, &IBO);
+	GetPool().Free(geometry);
 }
 
 // Move constructor
 Mesh::Mesh(Mesh&& other) noexcept
-	: VAO(other.VAO), VBO(other.VBO), IBO(other.IBO),
-	vertices(std::move(other.vertices)), indices(std::move(other.indices)),
-	textures(std::move(other.textures)), hasTangentAndBitangent(other.hasTangentAndBitangent)
+	: vertices(std::move(other.vertices)), indices(std::move(other.indices)), lods(std::move(other.lods)),
+	meshlets(std::move(other.meshlets)), textures(std::move(other.textures)), geometry(other.geometry),
+	hasTangentAndBitangent(other.hasTangentAndBitangent),
+	vertexFormat(other.vertexFormat), quantizationError(other.quantizationError),
+	indexType(other.indexType), levelClusters(std::move(other.levelClusters)), samplerNames(std::move(other.samplerNames))
 {
-	// Invalidate the moved-from object's OpenGL handles
-	other.VAO = 0;
-	other.VBO = 0;
-	other.IBO = 0;
+	// Invalidate the moved-from object's pool range
+	other.geometry = GeometryPool::invalidHandle;
 }
 
 // Move assignment operator
@@ -109,38 +148,59 @@ Mesh& Mesh::operator=(Mesh&& other) noexcept
 	if (this != &other)
 	{
 		// Release any resources held by *this
-		glDeleteVertexArrays(1, &VAO);
-		glDeleteBuffers(1, &VBO);
-		glDeleteBuffers(1, &IBO);
+		GetPool().Free(geometry);
 
 		// Steal the resources from other
-		VAO = other.VAO;
-		VBO = other.VBO;
-		IBO = other.IBO;
+		geometry = other.geometry;
 		vertices = std::move(other.vertices);
 		indices = std::move(other.indices);
+		lods = std::move(other.lods);
+		meshlets = std::move(other.meshlets);
 		textures = std::move(other.textures);
 		hasTangentAndBitangent = other.hasTangentAndBitangent;
+		vertexFormat = other.vertexFormat;
+		quantizationError = other.quantizationError;
+		indexType = other.indexType;
+		levelClusters = std::move(other.levelClusters);
+		samplerNames = std::move(other.samplerNames);
 
-		// Invalidate the moved-from object's OpenGL handles
-		other.VAO = 0;
-		other.VBO = 0;
-		other.IBO = 0;
+		// Invalidate the moved-from object's pool range
+		other.geometry = GeometryPool::invalidHandle;
 	}
 	return *this;
 }
-// first calculate the N-component per texture type and concatenate it to the texture's type string to get the uniform name. 
-// then locate the appropriate sampler, give it the location value to correspond with the currently active texture unit, and bind the texture. 
+// locate the sampler of each texture (names precomputed by BuildSamplerNames), give it the location value
+// to correspond with the currently active texture unit, and bind the texture. 
 void Mesh::Draw(Shader& shader) const
+{
+	BindTextures(shader);
+	//glActiveTexture(GL_TEXTURE0);
+
+	// Draw mesh
+	DrawInstanced(1);
+}
+
+void Mesh::BindTextures(const Shader& shader) const
+{
+	for (size_t i = 0; i < textures.size(); i++) {
+		GLState::Get().ActiveTexture(GL_TEXTURE0 + i); 
+		shader.SetInt(samplerNames[i], i);
+		GLState::Get().BindTexture(GL_TEXTURE_2D, textures[i].id);
+	}
+}
+
+// calculate the N-component per texture type and concatenate it to the texture's type string to get the uniform name. 
+void Mesh::BuildSamplerNames()
 {
 	// Start from material.diffuse1 or material.specular1
 	size_t diffuseNr = 1, specularNr = 1, normalNr = 1, heightNr = 1;
 
-	for (size_t i = 0; i < textures.size(); i++) {
-		glActiveTexture(GL_TEXTURE0 + i); 
-		// Get texture numberN in diffuse_textureN 
+	samplerNames.clear();
+	samplerNames.reserve(textures.size());
+	for (const Texture& texture : textures) {
+		// Get texture number (N in diffuse_textureN)
 		std::string number;
-		std::string name = textures[i].type;
+		const std::string& name = texture.type;
 		if (name == "texture_diffuse")
 			number = std::to_string(diffuseNr++);
 		else if (name == "texture_specular")
@@ -149,53 +209,116 @@ void Mesh::Draw(Shader& shader) const
 			number = std::to_string(normalNr++);
 		else if (name == "texture_height")
 			number = std::to_string(heightNr++);
-
-		shader.SetInt((name + number).c_str(), i);
-		glBindTexture(GL_TEXTURE_2D, textures[i].id);
+		samplerNames.push_back(name + number);
 	}
-	//glActiveTexture(GL_TEXTURE0);
+}
 
-	// Draw mesh
-	glBindVertexArray(VAO);
-	glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
+void Mesh::DrawInstanced(unsigned int instanceCount) const
+{
+	GLState::Get().BindVertexArray(GetVAO());
+	DrawBound(instanceCount);
+	GLState::Get().EndDraw();
 }
 
-void Mesh::SetupMesh()
+size_t Mesh::GetIndexBufferSize() const
 {
-	// VAO, VBO, and IBO(EBO)
-	glGenVertexArrays(1, &VAO);
-	glGenBuffers(1, &VBO);
-	glGenBuffers(1, &IBO);
+	size_t indexCount = indices.size();
+	for (const MeshLod& lod : lods)
+		indexCount += lod.indices.size();
+	return indexCount * (indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int));
+}
 
-	glBindVertexArray(VAO);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+// Index values are relative to their cluster; the pool offsets add the mesh's place in the shared buffers.
+// A base instance needs GL 4.2 / ARB_base_instance; the caller checks
+void Mesh::DrawBound(unsigned int instanceCount, unsigned int level, unsigned int baseInstance) const
+{
+	const GeometryPool& pool = GetPool();
+	const GLint baseVertex = pool.GetBaseVertex(geometry);
+	const size_t firstIndex = pool.GetFirstIndex(geometry);
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+	for (const IndexCluster& cluster : levelClusters[std::min<size_t>(level, levelClusters.size() - 1)]) {
+		void* offset = (void*)((firstIndex + cluster.firstIndex) * sizeof(uint16_t));
+		if (baseInstance != 0)
+			glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, cluster.indexCount, indexType, offset, instanceCount,
+				baseVertex + cluster.baseVertex, baseInstance);
+		else if (instanceCount == 1)
+			glDrawElementsBaseVertex(GL_TRIANGLES, cluster.indexCount, indexType, offset, baseVertex + cluster.baseVertex);
+		else
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, cluster.indexCount, indexType, offset, instanceCount, baseVertex + cluster.baseVertex);
+	}
+}
 
-	// Positions
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+// One multi-draw per 16-bit cluster the ranges touch, each range clipped to the clusters it spans
+void Mesh::DrawRanges(const std::vector<IndexRange>& ranges, MultiDrawArgs& args) const
+{
+	if (ranges.empty())
+		return;
+	const GeometryPool& pool = GetPool();
+	const GLint baseVertex = pool.GetBaseVertex(geometry);
+	const size_t firstIndex = pool.GetFirstIndex(geometry);
 
-	// Normals
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+	for (const IndexCluster& cluster : levelClusters[0]) {
+		args.counts.clear();
+		args.offsets.clear();
+		for (const IndexRange& range : ranges) {
+			size_t first = std::max<size_t>(range.firstIndex, cluster.firstIndex);
+			size_t last = std::min<size_t>(range.firstIndex + range.indexCount, cluster.firstIndex + cluster.indexCount);
+			if (first >= last)
+				continue;
+			args.counts.push_back(static_cast<GLsizei>(last - first));
+			args.offsets.push_back((const void*)((firstIndex + first) * sizeof(uint16_t)));
+		}
+		if (args.counts.empty())
+			continue;
+		args.baseVertices.assign(args.counts.size(), baseVertex + cluster.baseVertex);
+		glMultiDrawElementsBaseVertex(GL_TRIANGLES, args.counts.data(), indexType, args.offsets.data(),
+			static_cast<GLsizei>(args.counts.size()), args.baseVertices.data());
+	}
+}
+
+void Mesh::SetupMesh()
+{
+	// All levels go into one index range, coarser ones after the full detail, over the same vertices
+	std::vector<unsigned int> allIndices = indices;
+	std::vector<size_t> levelStart = { 0, indices.size() };
+	for (const MeshLod& lod : lods) {
+		allIndices.insert(allIndices.end(), lod.indices.begin(), lod.indices.end());
+		levelStart.push_back(allIndices.size());
+	}
 
-	// TexCoords
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));
+	// 16-bit indices; meshes over 65535 vertices are first split into clusters drawn with a base vertex
+#ifdef _DEBUG
+	std::vector<glm::vec3> sourceTriangles = GatherTrianglePositions(vertices, allIndices);
+#endif
+	std::vector<IndexCluster> clusters = SplitIndexClusters(vertices, allIndices);
+	std::vector<uint16_t> shortIndices = BuildShortIndices(allIndices, clusters);
+#ifdef _DEBUG
+	if (!VerifyShortIndices(sourceTriangles, vertices, shortIndices, clusters))
+		std::cout << "ERROR::MESH::16-bit index clusters do not reproduce the source triangles\n";
+#endif
 
-	if (hasTangentAndBitangent) {
-		// vertex tangent
-		glEnableVertexAttribArray(3);
-		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+	// Each level draws the part of the clusters in its range; splitting may have renumbered the vertices
+	levelClusters.assign(levelStart.size() - 1, {});
+	for (size_t level = 0; level + 1 < levelStart.size(); level++) {
+		std::vector<unsigned int>& levelIndices = level == 0 ? indices : lods[level - 1].indices;
+		levelIndices.assign(allIndices.begin() + levelStart[level], allIndices.begin() + levelStart[level + 1]);
+		for (const IndexCluster& cluster : clusters) {
+			size_t first = std::max<size_t>(cluster.firstIndex, levelStart[level]);
+			size_t last = std::min<size_t>(cluster.firstIndex + cluster.indexCount, levelStart[level + 1]);
+			if (first < last)
+				levelClusters[level].push_back(IndexCluster{ static_cast<unsigned int>(first), static_cast<unsigned int>(last - first),
+					cluster.baseVertex });
+		}
+	}
 
-		// vertex bitangent
-		glEnableVertexAttribArray(4);
-		glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+	// Vertex and index ranges in the shared buffers of the format, drawn through the pool's VAO
+	const uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+	const uint32_t indexCount = static_cast<uint32_t>(shortIndices.size());
+	if (vertexFormat == VertexFormat::Packed) {
+		std::vector<PackedVertex> packed = PackVertices(vertices, hasTangentAndBitangent, &quantizationError);
+		geometry = GetPool().Allocate(packed.data(), vertexCount, shortIndices.data(), indexCount);
 	}
-	// Unbind VAO
-	glBindVertexArray(0);
-}
\ No newline at end of file
+	else {
+		geometry = GetPool().Allocate(vertices.data(), vertexCount, shortIndices.data(), indexCount);
+	}
+}
@@ -0,0 +1,431 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <type_traits>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mesh.h"
+
+// Vertices and indices are written and mapped back as raw bytes
+static_assert(std::is_trivially_copyable<Vertex>::value, "Vertex must be trivially copyable to be cached");
+static_assert(sizeof(Vertex) % 4 == 0, "Vertex size must keep the cache 4-byte aligned");
+static_assert(std::is_trivially_copyable<Meshlet>::value, "Meshlet must be trivially copyable to be cached");
+static_assert(sizeof(Meshlet) % 4 == 0, "Meshlet size must keep the cache 4-byte aligned");
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile() { Close(); }
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool Open(const std::string& _filePath);
+	void Close();
+
+	const unsigned char* Data() const { return data; }
+	size_t Size() const { return size; }
+
+private:
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#endif
+};
+
+// One mesh as it is laid out inside a mapped cache file.
+// The pointers reference the mapping and are only valid while the MeshCacheReader is alive.
+struct MeshCacheView
+{
+	const Vertex* vertices = nullptr;
+	uint32_t vertexCount = 0;
+	const unsigned int* indices = nullptr;
+	uint32_t indexCount = 0;
+	std::vector<std::pair<std::string, std::string>> textures; // (type, path relative to the model directory)
+	bool hasTangentAndBitangent = false;
+
+	struct Lod
+	{
+		const unsigned int* indices = nullptr;
+		uint32_t indexCount = 0;
+		float error = 0.0f;
+	};
+	std::vector<Lod> lods;
+
+	const Meshlet* meshlets = nullptr;
+	uint32_t meshletCount = 0;
+};
+
+// Binary mesh cache stored next to the source asset as "<asset>.<processing flags in hex>.meshcache".
+// Layout (all little-endian, every section 4-byte aligned):
+//   MeshCacheHeader
+//   per mesh: MeshCacheMeshHeader, texture records, Vertex[vertexCount], uint32[indexCount], level records,
+//             Meshlet[meshletCount]
+// A texture record is { uint32 typeLength, uint32 pathLength, type chars, path chars } padded to 4 bytes.
+// A level record is { uint32 indexCount, float error, uint32[indexCount] }, one per level of detail.
+// The cache is keyed by a hash of the source file contents, the Assimp import flags and our own
+// processing flags, so editing the asset or changing how it is processed invalidates it. The processing
+// flags also name the file, so loads of one asset with different options keep separate caches.
+class MeshCache
+{
+public:
+	static constexpr uint32_t version = 4;
+
+	static std::string GetCachePath(const std::string& _assetPath, uint32_t _processFlags)
+	{
+		char flags[16];
+		std::snprintf(flags, sizeof(flags), ".%x", _processFlags);
+		return _assetPath + flags + ".meshcache";
+	}
+
+	// FNV-1a 64 over the whole file; returns 0 when the file can't be read
+	static uint64_t HashFile(const std::string& _filePath);
+
+	// Write all meshes of a model; returns false (and leaves no partial file behind) on failure
+	static bool Save(const std::string& _assetPath, uint64_t _sourceHash, uint32_t _importFlags,
+		uint32_t _processFlags, const std::vector<Mesh>& _meshes);
+
+private:
+	friend class MeshCacheReader;
+
+	struct MeshCacheHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t sourceHash;
+		uint32_t importFlags;
+		uint32_t processFlags;
+		uint32_t meshCount;
+		uint32_t reserved;
+	};
+
+	struct MeshCacheMeshHeader
+	{
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t textureCount;
+		uint32_t hasTangentAndBitangent;
+		uint32_t lodCount;
+		uint32_t meshletCount;
+	};
+
+	static size_t Align4(size_t _value) { return (_value + 3) & ~size_t(3); }
+};
+
+// Maps a cache file and exposes its meshes without copying them
+class MeshCacheReader
+{
+public:
+	// Returns false on a miss: no cache file, a stale hash/flags/version, or a truncated file
+	bool Open(const std::string& _assetPath, uint64_t _sourceHash, uint32_t _importFlags, uint32_t _processFlags);
+
+	const std::vector<MeshCacheView>& GetMeshes() const { return meshes; }
+
+private:
+	MappedFile file;
+	std::vector<MeshCacheView> meshes;
+};
+
+#ifdef _WIN32
+inline bool MappedFile::Open(const std::string& _filePath)
+{
+	Close();
+	file = CreateFileA(_filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+		Close();
+		return false;
+	}
+	size = static_cast<size_t>(fileSize.QuadPart);
+
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping) {
+		Close();
+		return false;
+	}
+	data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!data) {
+		Close();
+		return false;
+	}
+	return true;
+}
+
+inline void MappedFile::Close()
+{
+	if (data)
+		UnmapViewOfFile(data);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+	data = nullptr;
+	mapping = nullptr;
+	file = INVALID_HANDLE_VALUE;
+	size = 0;
+}
+#else
+inline bool MappedFile::Open(const std::string& _filePath)
+{
+	Close();
+	int fd = open(_filePath.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+
+	void* mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // The mapping keeps its own reference to the file
+	if (mapped == MAP_FAILED)
+		return false;
+
+	data = static_cast<const unsigned char*>(mapped);
+	size = static_cast<size_t>(st.st_size);
+	return true;
+}
+
+inline void MappedFile::Close()
+{
+	if (data)
+		munmap(const_cast<unsigned char*>(data), size);
+	data = nullptr;
+	size = 0;
+}
+#endif
+
+inline uint64_t MeshCache::HashFile(const std::string& _filePath)
+{
+	MappedFile source;
+	if (!source.Open(_filePath))
+		return 0;
+
+	uint64_t hash = 14695981039346656037ull;
+	const unsigned char* bytes = source.Data();
+	for (size_t i = 0; i < source.Size(); i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+inline bool MeshCache::Save(const std::string& _assetPath, uint64_t _sourceHash, uint32_t _importFlags,
+	uint32_t _processFlags, const std::vector<Mesh>& _meshes)
+{
+	const std::string cachePath = GetCachePath(_assetPath, _processFlags);
+	const std::string tempPath = cachePath + ".tmp";
+
+	std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+	if (!out.is_open())
+		return false;
+
+	auto writePadding = [&out](size_t _written) {
+		static const char zeros[4] = { 0, 0, 0, 0 };
+		out.write(zeros, Align4(_written) - _written);
+	};
+
+	MeshCacheHeader header;
+	std::memcpy(header.magic, "AMSH", 4);
+	header.version = version;
+	header.sourceHash = _sourceHash;
+	header.importFlags = _importFlags;
+	header.processFlags = _processFlags;
+	header.meshCount = static_cast<uint32_t>(_meshes.size());
+	header.reserved = 0;
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	for (const Mesh& mesh : _meshes) {
+		MeshCacheMeshHeader meshHeader;
+		meshHeader.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+		meshHeader.indexCount = static_cast<uint32_t>(mesh.indices.size());
+		meshHeader.textureCount = static_cast<uint32_t>(mesh.textures.size());
+		meshHeader.hasTangentAndBitangent = mesh.HasTangentAndBitangent() ? 1u : 0u;
+		meshHeader.lodCount = static_cast<uint32_t>(mesh.lods.size());
+		meshHeader.meshletCount = static_cast<uint32_t>(mesh.meshlets.size());
+		out.write(reinterpret_cast<const char*>(&meshHeader), sizeof(meshHeader));
+
+		for (const Texture& texture : mesh.textures) {
+			uint32_t lengths[2] = { static_cast<uint32_t>(texture.type.size()), static_cast<uint32_t>(texture.path.size()) };
+			out.write(reinterpret_cast<const char*>(lengths), sizeof(lengths));
+			out.write(texture.type.data(), texture.type.size());
+			out.write(texture.path.data(), texture.path.size());
+			writePadding(texture.type.size() + texture.path.size());
+		}
+
+		out.write(reinterpret_cast<const char*>(mesh.vertices.data()), mesh.vertices.size() * sizeof(Vertex));
+		out.write(reinterpret_cast<const char*>(mesh.indices.data()), mesh.indices.size() * sizeof(unsigned int));
+
+		for (const MeshLod& lod : mesh.lods) {
+			const uint32_t indexCount = static_cast<uint32_t>(lod.indices.size());
+			out.write(reinterpret_cast<const char*>(&indexCount), sizeof(indexCount));
+			out.write(reinterpret_cast<const char*>(&lod.error), sizeof(lod.error));
+			out.write(reinterpret_cast<const char*>(lod.indices.data()), lod.indices.size() * sizeof(unsigned int));
+		}
+		out.write(reinterpret_cast<const char*>(mesh.meshlets.data()), mesh.meshlets.size() * sizeof(Meshlet));
+	}
+
+	out.close();
+	std::error_code ec;
+	if (!out) {
+		std::filesystem::remove(tempPath, ec);
+		return false;
+	}
+
+	// Replace the old cache in one step so a crash never leaves a half-written file under the real name
+	std::filesystem::rename(tempPath, cachePath, ec);
+	if (ec) {
+		std::filesystem::remove(tempPath, ec);
+		return false;
+	}
+	return true;
+}
+
+inline bool MeshCacheReader::Open(const std::string& _assetPath, uint64_t _sourceHash, uint32_t _importFlags,
+	uint32_t _processFlags)
+{
+	meshes.clear();
+	if (_sourceHash == 0 || !file.Open(MeshCache::GetCachePath(_assetPath, _processFlags)))
+		return false;
+
+	const unsigned char* base = file.Data();
+	const size_t size = file.Size();
+	size_t offset = 0;
+
+	// Bounds-checked cursor over the mapping; any overrun is treated as a miss
+	auto take = [&](size_t _bytes) -> const unsigned char* {
+		if (_bytes > size - offset)
+			return nullptr;
+		const unsigned char* p = base + offset;
+		offset += _bytes;
+		return p;
+	};
+
+	MeshCache::MeshCacheHeader header;
+	const unsigned char* p = take(sizeof(header));
+	if (!p)
+		return false;
+	std::memcpy(&header, p, sizeof(header));
+
+	if (std::memcmp(header.magic, "AMSH", 4) != 0 || header.version != MeshCache::version ||
+		header.sourceHash != _sourceHash || header.importFlags != _importFlags || header.processFlags != _processFlags) {
+		file.Close();
+		return false;
+	}
+
+	// A corrupt count can't ask for more meshes than the file could possibly hold
+	bool ok = header.meshCount <= (size - offset) / sizeof(MeshCache::MeshCacheMeshHeader);
+	if (ok)
+		meshes.resize(header.meshCount);
+
+	for (size_t m = 0; ok && m < meshes.size(); m++) {
+		MeshCacheView& view = meshes[m];
+		MeshCache::MeshCacheMeshHeader meshHeader;
+		if (!(p = take(sizeof(meshHeader)))) {
+			ok = false;
+			break;
+		}
+		std::memcpy(&meshHeader, p, sizeof(meshHeader));
+
+		for (uint32_t i = 0; i < meshHeader.textureCount && ok; i++) {
+			uint32_t lengths[2];
+			if (!(p = take(sizeof(lengths)))) {
+				ok = false;
+				break;
+			}
+			std::memcpy(lengths, p, sizeof(lengths));
+			const size_t stringBytes = size_t(lengths[0]) + size_t(lengths[1]);
+			if (!(p = take(MeshCache::Align4(stringBytes)))) {
+				ok = false;
+				break;
+			}
+			const char* chars = reinterpret_cast<const char*>(p);
+			view.textures.emplace_back(std::string(chars, lengths[0]), std::string(chars + lengths[0], lengths[1]));
+		}
+		if (!ok)
+			break;
+
+		// Every section is 4-byte aligned, so the arrays can be used in place
+		const unsigned char* vertexBytes = take(size_t(meshHeader.vertexCount) * sizeof(Vertex));
+		const unsigned char* indexBytes = vertexBytes ? take(size_t(meshHeader.indexCount) * sizeof(unsigned int)) : nullptr;
+		if (!vertexBytes || !indexBytes) {
+			ok = false;
+			break;
+		}
+
+		view.vertices = reinterpret_cast<const Vertex*>(vertexBytes);
+		view.vertexCount = meshHeader.vertexCount;
+		view.indices = reinterpret_cast<const unsigned int*>(indexBytes);
+		view.indexCount = meshHeader.indexCount;
+		view.hasTangentAndBitangent = meshHeader.hasTangentAndBitangent != 0;
+
+		for (uint32_t i = 0; i < meshHeader.lodCount && ok; i++) {
+			uint32_t indexCount;
+			float error;
+			if (!(p = take(sizeof(indexCount) + sizeof(error)))) {
+				ok = false;
+				break;
+			}
+			std::memcpy(&indexCount, p, sizeof(indexCount));
+			std::memcpy(&error, p + sizeof(indexCount), sizeof(error));
+			if (!(p = take(size_t(indexCount) * sizeof(unsigned int)))) {
+				ok = false;
+				break;
+			}
+			view.lods.push_back(MeshCacheView::Lod{ reinterpret_cast<const unsigned int*>(p), indexCount, error });
+		}
+		if (!ok)
+			break;
+
+		// Meshlets are drawn as index ranges, so one pointing past the indices is corruption
+		if (!(p = take(size_t(meshHeader.meshletCount) * sizeof(Meshlet)))) {
+			ok = false;
+			break;
+		}
+		view.meshlets = reinterpret_cast<const Meshlet*>(p);
+		view.meshletCount = meshHeader.meshletCount;
+		for (uint32_t i = 0; i < view.meshletCount && ok; i++)
+			ok = size_t(view.meshlets[i].firstIndex) + 3 * size_t(view.meshlets[i].triangleCount) <= view.indexCount;
+	}
+
+	if (!ok || offset != size) {
+#ifdef _DEBUG
+		std::cout << "Mesh cache is truncated or corrupt, ignoring: " << MeshCache::GetCachePath(_assetPath, _processFlags) << "\n";
+#endif
+		meshes.clear();
+		file.Close();
+		return false;
+	}
+	return true;
+}
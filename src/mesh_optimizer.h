@@ -0,0 +1,299 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include "vertex_format.h"
+
+// Import-time index/vertex reordering for the post-transform vertex cache, vertex fetch and overdraw.
+// All passes keep the triangle set (and each triangle's winding) unchanged; only the order moves.
+
+// Post-transform cache efficiency of an index buffer under a simulated FIFO cache
+struct VertexCacheStats
+{
+	float acmr = 0.0f; // transformed vertices per triangle, 0.5 is ideal on large regular meshes, 3 is worst
+	float atvr = 0.0f; // transformed vertices per referenced vertex, 1 is ideal
+};
+
+inline VertexCacheStats ComputeVertexCacheStats(const std::vector<unsigned int>& _indices, size_t _vertexCount,
+	unsigned int _cacheSize = 16)
+{
+	VertexCacheStats stats;
+	if (_indices.empty())
+		return stats;
+
+	// A vertex is cached if it was transformed within the last _cacheSize misses (FIFO replacement)
+	std::vector<unsigned int> cacheTime(_vertexCount, 0);
+	std::vector<bool> referenced(_vertexCount, false);
+	unsigned int time = _cacheSize + 1;
+	size_t misses = 0, referencedCount = 0;
+
+	for (unsigned int index : _indices) {
+		if (time - cacheTime[index] > _cacheSize) {
+			cacheTime[index] = time++;
+			misses++;
+		}
+		if (!referenced[index]) {
+			referenced[index] = true;
+			referencedCount++;
+		}
+	}
+
+	stats.acmr = static_cast<float>(misses) / (_indices.size() / 3);
+	stats.atvr = referencedCount ? static_cast<float>(misses) / referencedCount : 0.0f;
+	return stats;
+}
+
+// Forsyth's "linear-speed vertex cache optimisation": greedily emit the triangle whose vertices
+// score best given their position in a simulated LRU cache and how many triangles still use them.
+inline void OptimizeVertexCache(std::vector<unsigned int>& _indices, size_t _vertexCount)
+{
+	const int cacheSize = 32;
+	const size_t triangleCount = _indices.size() / 3;
+	if (triangleCount == 0)
+		return;
+
+	auto vertexScore = [cacheSize](int _cachePosition, unsigned int _remainingValence) {
+		if (_remainingValence == 0)
+			return -1.0f; // No triangles left to emit, the vertex is dead
+		float score = 0.0f;
+		if (_cachePosition >= 0) {
+			if (_cachePosition < 3) {
+				// Vertices of the last triangle get a fixed score so it isn't chosen again right away
+				score = 0.75f;
+			}
+			else {
+				float scaler = 1.0f - float(_cachePosition - 3) / float(cacheSize - 3);
+				score = std::pow(scaler, 1.5f);
+			}
+		}
+		// Favour vertices with few remaining triangles so they can leave the cache early
+		return score + 2.0f / std::sqrt(static_cast<float>(_remainingValence));
+	};
+
+	// Vertex -> triangle adjacency in CSR form
+	std::vector<unsigned int> valence(_vertexCount, 0);
+	for (unsigned int index : _indices)
+		valence[index]++;
+
+	std::vector<unsigned int> adjacencyOffset(_vertexCount + 1, 0);
+	for (size_t v = 0; v < _vertexCount; v++)
+		adjacencyOffset[v + 1] = adjacencyOffset[v] + valence[v];
+
+	std::vector<unsigned int> adjacency(_indices.size());
+	std::vector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+	for (size_t t = 0; t < triangleCount; t++)
+		for (size_t k = 0; k < 3; k++)
+			adjacency[fill[_indices[t * 3 + k]]++] = static_cast<unsigned int>(t);
+
+	std::vector<int> cachePosition(_vertexCount, -1);
+	std::vector<float> score(_vertexCount);
+	for (size_t v = 0; v < _vertexCount; v++)
+		score[v] = vertexScore(-1, valence[v]);
+
+	std::vector<float> triangleScore(triangleCount);
+	for (size_t t = 0; t < triangleCount; t++)
+		triangleScore[t] = score[_indices[t * 3]] + score[_indices[t * 3 + 1]] + score[_indices[t * 3 + 2]];
+
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<unsigned int> cache, nextCache;
+	cache.reserve(cacheSize + 3);
+	nextCache.reserve(cacheSize + 3);
+
+	std::vector<unsigned int> result;
+	result.reserve(_indices.size());
+
+	size_t scanCursor = 0; // Fallback when the cache holds no live triangle
+	size_t bestTriangle = 0;
+	for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++) {
+		if (emitted[bestTriangle]) {
+			while (emitted[scanCursor])
+				scanCursor++;
+			bestTriangle = scanCursor;
+		}
+
+		emitted[bestTriangle] = true;
+		const unsigned int* tri = &_indices[bestTriangle * 3];
+		result.insert(result.end(), tri, tri + 3);
+
+		// Remove the triangle from its vertices' live adjacency
+		for (size_t k = 0; k < 3; k++) {
+			unsigned int v = tri[k];
+			unsigned int* begin = &adjacency[adjacencyOffset[v]];
+			unsigned int* end = begin + valence[v];
+			*std::find(begin, end, static_cast<unsigned int>(bestTriangle)) = *(end - 1);
+			valence[v]--;
+		}
+
+		// Move the triangle's vertices to the front of the LRU cache
+		nextCache.assign(tri, tri + 3);
+		for (unsigned int v : cache)
+			if (v != tri[0] && v != tri[1] && v != tri[2])
+				nextCache.push_back(v);
+		for (size_t i = cacheSize; i < nextCache.size(); i++)
+			cachePosition[nextCache[i]] = -1;
+		if (nextCache.size() > static_cast<size_t>(cacheSize))
+			nextCache.resize(cacheSize);
+		cache.swap(nextCache);
+
+		// Rescore cached vertices and their triangles; the best one becomes the next candidate
+		for (size_t i = 0; i < cache.size(); i++) {
+			unsigned int v = cache[i];
+			cachePosition[v] = static_cast<int>(i);
+			float newScore = vertexScore(static_cast<int>(i), valence[v]);
+			float delta = newScore - score[v];
+			score[v] = newScore;
+			for (unsigned int a = adjacencyOffset[v]; a < adjacencyOffset[v] + valence[v]; a++)
+				triangleScore[adjacency[a]] += delta;
+		}
+		// Evicted vertices lost their cache bonus
+		for (unsigned int v : nextCache) {
+			if (cachePosition[v] != -1)
+				continue;
+			float newScore = vertexScore(-1, valence[v]);
+			float delta = newScore - score[v];
+			score[v] = newScore;
+			for (unsigned int a = adjacencyOffset[v]; a < adjacencyOffset[v] + valence[v]; a++)
+				triangleScore[adjacency[a]] += delta;
+		}
+
+		float bestScore = -1.0f;
+		for (unsigned int v : cache) {
+			for (unsigned int a = adjacencyOffset[v]; a < adjacencyOffset[v] + valence[v]; a++) {
+				unsigned int t = adjacency[a];
+				if (triangleScore[t] > bestScore) {
+					bestScore = triangleScore[t];
+					bestTriangle = t;
+				}
+			}
+		}
+	}
+
+	_indices.swap(result);
+}
+
+// View-independent overdraw reduction (Sander et al., "Fast Triangle Reordering for Vertex Locality
+// and Reduced Overdraw"): cut the cache-optimized order into clusters where the running ACMR stays
+// within _threshold of the whole mesh, then draw clusters that face outwards from the mesh centre first.
+inline void OptimizeOverdraw(std::vector<unsigned int>& _indices, const std::vector<Vertex>& _vertices,
+	float _threshold = 1.05f)
+{
+	const unsigned int cacheSize = 16;
+	const size_t triangleCount = _indices.size() / 3;
+	if (triangleCount < 2)
+		return;
+
+	const float meshACMR = ComputeVertexCacheStats(_indices, _vertices.size(), cacheSize).acmr;
+
+	// 1. Cluster boundaries: hard where a triangle misses on all three vertices (the cache effectively
+	// restarted), soft once the cluster's ACMR, simulated from a cold cache as it will be after sorting,
+	// has come down to within _threshold of the whole mesh.
+	std::vector<size_t> clusterStart;
+	std::vector<unsigned int> meshCacheTime(_vertices.size(), 0), clusterCacheTime(_vertices.size(), 0);
+	unsigned int meshTime = cacheSize + 1, clusterTime = cacheSize + 1;
+	size_t clusterMisses = 0, clusterTriangles = 0;
+	for (size_t t = 0; t < triangleCount; t++) {
+		unsigned int meshMisses = 0;
+		for (size_t k = 0; k < 3; k++) {
+			unsigned int v = _indices[t * 3 + k];
+			if (meshTime - meshCacheTime[v] > cacheSize) {
+				meshCacheTime[v] = meshTime++;
+				meshMisses++;
+			}
+		}
+
+		bool hardBoundary = meshMisses == 3;
+		bool softBoundary = clusterTriangles > 0 && float(clusterMisses) / clusterTriangles <= meshACMR * _threshold;
+		if (t == 0 || hardBoundary || softBoundary) {
+			clusterStart.push_back(t);
+			clusterMisses = 0;
+			clusterTriangles = 0;
+			clusterTime += cacheSize + 1; // Every entry is now stale: a cold cache
+		}
+
+		for (size_t k = 0; k < 3; k++) {
+			unsigned int v = _indices[t * 3 + k];
+			if (clusterTime - clusterCacheTime[v] > cacheSize) {
+				clusterCacheTime[v] = clusterTime++;
+				clusterMisses++;
+			}
+		}
+		clusterTriangles++;
+	}
+	clusterStart.push_back(triangleCount);
+
+	// 2. Sort key per cluster: how far its area-weighted centroid lies out along its average normal
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+	std::vector<glm::vec3> clusterCentroid(clusterStart.size() - 1, glm::vec3(0.0f));
+	std::vector<glm::vec3> clusterNormal(clusterStart.size() - 1, glm::vec3(0.0f));
+	for (size_t c = 0; c + 1 < clusterStart.size(); c++) {
+		float clusterArea = 0.0f;
+		for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; t++) {
+			const glm::vec3& p0 = _vertices[_indices[t * 3]].position;
+			const glm::vec3& p1 = _vertices[_indices[t * 3 + 1]].position;
+			const glm::vec3& p2 = _vertices[_indices[t * 3 + 2]].position;
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0); // length = 2 * area
+			float area = glm::length(normal);
+			glm::vec3 centroid = (p0 + p1 + p2) / 3.0f;
+			clusterCentroid[c] += centroid * area;
+			clusterNormal[c] += normal;
+			clusterArea += area;
+			meshCentroid += centroid * area;
+			meshArea += area;
+		}
+		if (clusterArea > 0.0f)
+			clusterCentroid[c] /= clusterArea;
+	}
+	if (meshArea > 0.0f)
+		meshCentroid /= meshArea;
+
+	std::vector<float> sortKey(clusterCentroid.size());
+	for (size_t c = 0; c < sortKey.size(); c++) {
+		float normalLength = glm::length(clusterNormal[c]);
+		sortKey[c] = normalLength > 0.0f ? glm::dot(clusterCentroid[c] - meshCentroid, clusterNormal[c] / normalLength) : 0.0f;
+	}
+
+	std::vector<size_t> order(sortKey.size());
+	std::iota(order.begin(), order.end(), size_t(0));
+	std::stable_sort(order.begin(), order.end(), [&sortKey](size_t _a, size_t _b) { return sortKey[_a] > sortKey[_b]; });
+
+	std::vector<unsigned int> result;
+	result.reserve(_indices.size());
+	for (size_t c : order)
+		result.insert(result.end(), _indices.begin() + clusterStart[c] * 3, _indices.begin() + clusterStart[c + 1] * 3);
+	_indices.swap(result);
+}
+
+// Reorder vertices by first use in the index buffer so vertex fetch walks memory linearly.
+// Vertices no triangle references are dropped.
+inline void OptimizeVertexFetch(std::vector<Vertex>& _vertices, std::vector<unsigned int>& _indices)
+{
+	const unsigned int unused = ~0u;
+	std::vector<unsigned int> remap(_vertices.size(), unused);
+	std::vector<Vertex> result;
+	result.reserve(_vertices.size());
+
+	for (unsigned int& index : _indices) {
+		if (remap[index] == unused) {
+			remap[index] = static_cast<unsigned int>(result.size());
+			result.push_back(_vertices[index]);
+		}
+		index = remap[index];
+	}
+	_vertices.swap(result);
+}
+
+// The full import pass: triangle order for the vertex cache, optionally clustered for overdraw,
+// then vertex order for fetch locality
+inline void OptimizeMesh(std::vector<Vertex>& _vertices, std::vector<unsigned int>& _indices, bool _optimizeOverdraw)
+{
+	OptimizeVertexCache(_indices, _vertices.size());
+	if (_optimizeOverdraw)
+		OptimizeOverdraw(_indices, _vertices);
+	OptimizeVertexFetch(_vertices, _indices);
+}
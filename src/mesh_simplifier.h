@@ -0,0 +1,429 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vertex_format.h"
+
+// Import-time level-of-detail generation by edge collapse under quadric error metrics (Garland and
+// Heckbert, "Surface Simplification Using Quadric Error Metrics"). Every level is a new triangle list over
+// the unchanged full-detail vertices, so all levels of a mesh share one vertex range on the GPU.
+
+// One level of detail of a mesh
+struct MeshLod
+{
+	std::vector<unsigned int> indices;
+	float error = 0.0f;  // model units; how far the surface may have moved from the full-detail one
+};
+
+// Sum of squared distances to a set of planes, as the symmetric 4x4 matrix of the plane equations
+struct Quadric
+{
+	double xx = 0, xy = 0, xz = 0, xw = 0, yy = 0, yz = 0, yw = 0, zz = 0, zw = 0, ww = 0;
+
+	// The plane dot(normal, p) + d = 0, with a unit normal
+	static Quadric FromPlane(const glm::dvec3& _normal, double _d, double _weight)
+	{
+		Quadric q;
+		q.xx = _weight * _normal.x * _normal.x; q.xy = _weight * _normal.x * _normal.y; q.xz = _weight * _normal.x * _normal.z;
+		q.xw = _weight * _normal.x * _d;       q.yy = _weight * _normal.y * _normal.y; q.yz = _weight * _normal.y * _normal.z;
+		q.yw = _weight * _normal.y * _d;       q.zz = _weight * _normal.z * _normal.z; q.zw = _weight * _normal.z * _d;
+		q.ww = _weight * _d * _d;
+		return q;
+	}
+
+	void Add(const Quadric& _other)
+	{
+		xx += _other.xx; xy += _other.xy; xz += _other.xz; xw += _other.xw; yy += _other.yy;
+		yz += _other.yz; yw += _other.yw; zz += _other.zz; zw += _other.zw; ww += _other.ww;
+	}
+
+	double Evaluate(const glm::dvec3& _p) const
+	{
+		double error = xx * _p.x * _p.x + 2.0 * xy * _p.x * _p.y + 2.0 * xz * _p.x * _p.z + 2.0 * xw * _p.x
+			+ yy * _p.y * _p.y + 2.0 * yz * _p.y * _p.z + 2.0 * yw * _p.y
+			+ zz * _p.z * _p.z + 2.0 * zw * _p.z + ww;
+		return std::max(error, 0.0);
+	}
+};
+
+// Collapses one vertex onto a neighbour at a time, cheapest first, and can be stopped at any triangle
+// count and continued, which is how a whole chain comes out of one run. Vertices with the same position
+// (UV and normal seams) collapse together: each copy moves to the copy of the target across the collapsed
+// edge, so seams stay closed. Open borders are held in place by planes perpendicular to them, and a
+// collapse that would flip a triangle or pinch the surface is skipped.
+class MeshSimplifier
+{
+public:
+	MeshSimplifier(const std::vector<Vertex>& _vertices, const std::vector<unsigned int>& _indices);
+
+	// Collapse until at most _targetTriangles are left or nothing can be collapsed any more
+	void Simplify(size_t _targetTriangles);
+
+	std::vector<unsigned int> GetIndices() const;
+	size_t GetTriangleCount() const { return triangleCount; }
+	// Largest distance from a full-detail vertex to the triangles within two edges of the point it was
+	// collapsed into, in model units. Those are only part of the surface, so this bounds the distance to
+	// the simplified surface from above
+	float MeasureError();
+
+private:
+	struct Collapse
+	{
+		double cost;
+		uint32_t from, to;
+		uint32_t fromVersion, toVersion;
+		bool operator<(const Collapse& _other) const { return cost > _other.cost; }  // cheapest on top
+	};
+
+	uint32_t GetPoint(uint32_t _vertex) const { return points[_vertex]; }
+	uint32_t GetSurvivor(uint32_t _point);
+	bool HasPoint(uint32_t _triangle, uint32_t _point) const;
+	// Alive triangles around _point; drops the dead ones from its list on the way
+	const std::vector<uint32_t>& GetTriangles(uint32_t _point);
+	void GetNeighbours(uint32_t _point, std::vector<uint32_t>& _neighbours);
+	void Push(uint32_t _from, uint32_t _to);
+	bool IsValid(uint32_t _from, uint32_t _to);
+	void Apply(uint32_t _from, uint32_t _to);
+
+	std::vector<glm::dvec3> positions;              // by point
+	std::vector<uint32_t> points;                   // by vertex: the first vertex with its position
+	std::vector<uint32_t> triangles;                // vertex triples
+	std::vector<bool> triangleAlive;
+	std::vector<std::vector<uint32_t>> pointTriangles;
+	std::vector<Quadric> quadrics;                  // by point
+	std::vector<uint32_t> versions;                 // by point, bumped whenever its neighbourhood changes
+	std::vector<bool> pointAlive;
+	std::vector<uint32_t> collapsedInto;            // by point, itself while alive
+	std::priority_queue<Collapse> queue;
+	size_t triangleCount = 0;
+	std::vector<uint32_t> scratch, scratch2;
+};
+
+inline MeshSimplifier::MeshSimplifier(const std::vector<Vertex>& _vertices, const std::vector<unsigned int>& _indices)
+{
+	// Vertices are welded into points by exact position
+	struct PositionHash
+	{
+		size_t operator()(const glm::vec3& _p) const
+		{
+			uint32_t bits[3];
+			std::memcpy(bits, &_p, sizeof(bits));
+			return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+		}
+	};
+	std::unordered_map<glm::vec3, uint32_t, PositionHash> pointOf;
+	points.resize(_vertices.size());
+	positions.resize(_vertices.size());
+	for (size_t v = 0; v < _vertices.size(); v++) {
+		auto inserted = pointOf.emplace(_vertices[v].position, static_cast<uint32_t>(v));
+		points[v] = inserted.first->second;
+		positions[v] = glm::dvec3(_vertices[v].position);
+	}
+
+	triangles.assign(_indices.begin(), _indices.begin() + _indices.size() / 3 * 3);
+	triangleCount = triangles.size() / 3;
+	triangleAlive.assign(triangleCount, true);
+	pointTriangles.resize(_vertices.size());
+	quadrics.resize(_vertices.size());
+	versions.assign(_vertices.size(), 0);
+	pointAlive.assign(_vertices.size(), false);
+	collapsedInto.resize(_vertices.size());
+	for (size_t p = 0; p < _vertices.size(); p++)
+		collapsedInto[p] = static_cast<uint32_t>(p);
+
+	// Every point starts with the planes of its triangles
+	std::unordered_map<uint64_t, int> edgeUses;  // by point pair, +1 per use a -> b, -1 per b -> a
+	for (uint32_t t = 0; t < triangleCount; t++) {
+		uint32_t p[3] = { GetPoint(triangles[t * 3]), GetPoint(triangles[t * 3 + 1]), GetPoint(triangles[t * 3 + 2]) };
+		if (p[0] == p[1] || p[1] == p[2] || p[0] == p[2]) {
+			triangleAlive[t] = false;
+			triangleCount--;
+			continue;
+		}
+		glm::dvec3 normal = glm::cross(positions[p[1]] - positions[p[0]], positions[p[2]] - positions[p[0]]);
+		double length = glm::length(normal);
+		if (length > 0.0)
+			normal /= length;
+		Quadric plane = Quadric::FromPlane(normal, -glm::dot(normal, positions[p[0]]), 1.0);
+		for (int k = 0; k < 3; k++) {
+			quadrics[p[k]].Add(plane);
+			pointTriangles[p[k]].push_back(t);
+			pointAlive[p[k]] = true;
+			uint32_t a = p[k], b = p[(k + 1) % 3];
+			edgeUses[a < b ? uint64_t(a) << 32 | b : uint64_t(b) << 32 | a] += a < b ? 1 : -1;
+		}
+	}
+
+	// Edges of only one triangle are borders: planes through them, perpendicular to the triangle, keep
+	// border points on the border
+	for (uint32_t t = 0; t < triangles.size() / 3; t++) {
+		if (!triangleAlive[t])
+			continue;
+		uint32_t p[3] = { GetPoint(triangles[t * 3]), GetPoint(triangles[t * 3 + 1]), GetPoint(triangles[t * 3 + 2]) };
+		glm::dvec3 normal = glm::cross(positions[p[1]] - positions[p[0]], positions[p[2]] - positions[p[0]]);
+		for (int k = 0; k < 3; k++) {
+			uint32_t a = p[k], b = p[(k + 1) % 3];
+			if (edgeUses[a < b ? uint64_t(a) << 32 | b : uint64_t(b) << 32 | a] == 0)
+				continue;
+			glm::dvec3 edge = positions[b] - positions[a];
+			glm::dvec3 borderNormal = glm::cross(edge, normal);
+			double length = glm::length(borderNormal);
+			if (length == 0.0)
+				continue;
+			borderNormal /= length;
+			Quadric border = Quadric::FromPlane(borderNormal, -glm::dot(borderNormal, positions[a]), 10.0);
+			quadrics[a].Add(border);
+			quadrics[b].Add(border);
+		}
+	}
+
+	for (uint32_t t = 0; t < triangles.size() / 3; t++)
+		if (triangleAlive[t])
+			for (int k = 0; k < 3; k++)
+				Push(GetPoint(triangles[t * 3 + k]), GetPoint(triangles[t * 3 + (k + 1) % 3]));
+}
+
+inline bool MeshSimplifier::HasPoint(uint32_t _triangle, uint32_t _point) const
+{
+	return GetPoint(triangles[_triangle * 3]) == _point || GetPoint(triangles[_triangle * 3 + 1]) == _point
+		|| GetPoint(triangles[_triangle * 3 + 2]) == _point;
+}
+
+inline const std::vector<uint32_t>& MeshSimplifier::GetTriangles(uint32_t _point)
+{
+	std::vector<uint32_t>& list = pointTriangles[_point];
+	list.erase(std::remove_if(list.begin(), list.end(), [&](uint32_t _t) { return !triangleAlive[_t]; }), list.end());
+	return list;
+}
+
+inline void MeshSimplifier::GetNeighbours(uint32_t _point, std::vector<uint32_t>& _neighbours)
+{
+	_neighbours.clear();
+	for (uint32_t t : GetTriangles(_point))
+		for (int k = 0; k < 3; k++) {
+			uint32_t p = GetPoint(triangles[t * 3 + k]);
+			if (p != _point && std::find(_neighbours.begin(), _neighbours.end(), p) == _neighbours.end())
+				_neighbours.push_back(p);
+		}
+}
+
+// Collapsing keeps the target's position, so the cost is the combined quadric there
+inline void MeshSimplifier::Push(uint32_t _from, uint32_t _to)
+{
+	Quadric combined = quadrics[_from];
+	combined.Add(quadrics[_to]);
+	queue.push(Collapse{ combined.Evaluate(positions[_to]), _from, _to, versions[_from], versions[_to] });
+}
+
+inline bool MeshSimplifier::IsValid(uint32_t _from, uint32_t _to)
+{
+	// Link condition: the two may only share the neighbours across the triangles of their edge,
+	// otherwise the collapse glues two sheets of the surface together
+	size_t edgeTriangles = 0;
+	for (uint32_t t : GetTriangles(_from))
+		edgeTriangles += HasPoint(t, _to) ? 1 : 0;
+	if (edgeTriangles == 0)
+		return false;
+	GetNeighbours(_from, scratch);
+	GetNeighbours(_to, scratch2);
+	size_t shared = 0;
+	for (uint32_t p : scratch)
+		shared += std::find(scratch2.begin(), scratch2.end(), p) != scratch2.end() ? 1 : 0;
+	if (shared > edgeTriangles)
+		return false;
+
+	// The triangles that stay must keep facing the same way and not collapse to slivers
+	for (uint32_t t : GetTriangles(_from)) {
+		if (HasPoint(t, _to))
+			continue;
+		glm::dvec3 before[3], after[3];
+		for (int k = 0; k < 3; k++) {
+			uint32_t p = GetPoint(triangles[t * 3 + k]);
+			before[k] = positions[p];
+			after[k] = p == _from ? positions[_to] : positions[p];
+		}
+		glm::dvec3 oldNormal = glm::cross(before[1] - before[0], before[2] - before[0]);
+		glm::dvec3 newNormal = glm::cross(after[1] - after[0], after[2] - after[0]);
+		double oldLength = glm::length(oldNormal), newLength = glm::length(newNormal);
+		if (newLength <= 1e-12 * oldLength || glm::dot(oldNormal, newNormal) < 0.2 * oldLength * newLength)
+			return false;
+	}
+	return true;
+}
+
+inline void MeshSimplifier::Apply(uint32_t _from, uint32_t _to)
+{
+	// Each copy of _from follows the copy of _to it shares a collapsed triangle with; copies on no
+	// collapsed triangle take the first copy of _to seen
+	std::vector<std::pair<uint32_t, uint32_t>> copies;
+	uint32_t fallback = ~0u;
+	for (uint32_t t : GetTriangles(_from)) {
+		if (!HasPoint(t, _to))
+			continue;
+		uint32_t fromVertex = 0, toVertex = 0;
+		for (int k = 0; k < 3; k++) {
+			uint32_t v = triangles[t * 3 + k];
+			if (GetPoint(v) == _from)
+				fromVertex = v;
+			if (GetPoint(v) == _to)
+				toVertex = v;
+		}
+		copies.emplace_back(fromVertex, toVertex);
+		if (fallback == ~0u)
+			fallback = toVertex;
+	}
+
+	for (uint32_t t : GetTriangles(_from)) {
+		if (HasPoint(t, _to)) {
+			triangleAlive[t] = false;
+			triangleCount--;
+			continue;
+		}
+		for (int k = 0; k < 3; k++) {
+			uint32_t& v = triangles[t * 3 + k];
+			if (GetPoint(v) != _from)
+				continue;
+			uint32_t target = fallback;
+			for (const auto& copy : copies)
+				if (copy.first == v) {
+					target = copy.second;
+					break;
+				}
+			v = target;
+		}
+		pointTriangles[_to].push_back(t);
+	}
+
+	quadrics[_to].Add(quadrics[_from]);
+	pointAlive[_from] = false;
+	collapsedInto[_from] = _to;
+	pointTriangles[_from].clear();
+	versions[_to]++;
+
+	// Every edge around the kept point has a new cost
+	GetNeighbours(_to, scratch);
+	for (uint32_t p : scratch) {
+		versions[p]++;
+		Push(_to, p);
+		Push(p, _to);
+	}
+}
+
+inline void MeshSimplifier::Simplify(size_t _targetTriangles)
+{
+	while (triangleCount > _targetTriangles && !queue.empty()) {
+		Collapse collapse = queue.top();
+		queue.pop();
+		if (!pointAlive[collapse.from] || !pointAlive[collapse.to] || versions[collapse.from] != collapse.fromVersion
+			|| versions[collapse.to] != collapse.toVersion || !IsValid(collapse.from, collapse.to))
+			continue;
+		Apply(collapse.from, collapse.to);
+	}
+}
+
+inline uint32_t MeshSimplifier::GetSurvivor(uint32_t _point)
+{
+	uint32_t survivor = _point;
+	while (collapsedInto[survivor] != survivor)
+		survivor = collapsedInto[survivor];
+	// Shorten the path for the next lookup
+	while (collapsedInto[_point] != survivor) {
+		uint32_t next = collapsedInto[_point];
+		collapsedInto[_point] = survivor;
+		_point = next;
+	}
+	return survivor;
+}
+
+inline float MeshSimplifier::MeasureError()
+{
+	// Closest point on a triangle (Ericson, "Real-Time Collision Detection" 5.1.5)
+	auto distance = [](const glm::dvec3& _p, const glm::dvec3& _a, const glm::dvec3& _b, const glm::dvec3& _c) {
+		glm::dvec3 ab = _b - _a, ac = _c - _a, ap = _p - _a;
+		double d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+		if (d1 <= 0.0 && d2 <= 0.0)
+			return glm::length(ap);
+		glm::dvec3 bp = _p - _b;
+		double d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+		if (d3 >= 0.0 && d4 <= d3)
+			return glm::length(bp);
+		double vc = d1 * d4 - d3 * d2;
+		if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0)
+			return glm::length(ap - ab * (d1 / (d1 - d3)));
+		glm::dvec3 cp = _p - _c;
+		double d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+		if (d6 >= 0.0 && d5 <= d6)
+			return glm::length(cp);
+		double vb = d5 * d2 - d1 * d6;
+		if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0)
+			return glm::length(ap - ac * (d2 / (d2 - d6)));
+		double va = d3 * d6 - d5 * d4;
+		if (va <= 0.0 && d4 - d3 >= 0.0 && d5 - d6 >= 0.0)
+			return glm::length(bp - (_c - _b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6))));
+		double denominator = 1.0 / (va + vb + vc);
+		return glm::length(ap - ab * (vb * denominator) - ac * (vc * denominator));
+	};
+
+	double largest = 0.0;
+	for (uint32_t p = 0; p < points.size(); p++) {
+		// Copies are measured as their point; points still in place are on the surface
+		if (points[p] != p)
+			continue;
+		uint32_t survivor = GetSurvivor(p);
+		if (survivor == p)
+			continue;
+		// The triangles around the survivor and around its neighbours
+		double closest = DBL_MAX;
+		GetNeighbours(survivor, scratch);
+		scratch.push_back(survivor);
+		for (uint32_t around : scratch)
+			for (uint32_t t : GetTriangles(around))
+				closest = std::min(closest, distance(positions[p], positions[GetPoint(triangles[t * 3])],
+					positions[GetPoint(triangles[t * 3 + 1])], positions[GetPoint(triangles[t * 3 + 2])]));
+		if (closest != DBL_MAX)
+			largest = std::max(largest, closest);
+	}
+	return static_cast<float>(largest);
+}
+
+inline std::vector<unsigned int> MeshSimplifier::GetIndices() const
+{
+	std::vector<unsigned int> indices;
+	indices.reserve(triangleCount * 3);
+	for (size_t t = 0; t < triangleAlive.size(); t++)
+		if (triangleAlive[t])
+			indices.insert(indices.end(), triangles.begin() + t * 3, triangles.begin() + t * 3 + 3);
+	return indices;
+}
+
+// _levelCount levels below full detail, each with about _ratio of the triangles of the one before and an
+// error no smaller than theirs. The chain stops early when simplification runs out of valid collapses
+inline std::vector<MeshLod> BuildLodChain(const std::vector<Vertex>& _vertices, const std::vector<unsigned int>& _indices,
+	unsigned int _levelCount, float _ratio = 0.5f)
+{
+	std::vector<MeshLod> levels;
+	if (_levelCount == 0 || _indices.size() < 3)
+		return levels;
+
+	MeshSimplifier simplifier(_vertices, _indices);
+	size_t previous = _indices.size() / 3;
+	for (unsigned int level = 1; level <= _levelCount; level++) {
+		simplifier.Simplify(static_cast<size_t>(previous * _ratio));
+		// Less than a tenth fewer triangles isn't worth a level
+		if (simplifier.GetTriangleCount() == 0 || simplifier.GetTriangleCount() * 10 > previous * 9)
+			break;
+		previous = simplifier.GetTriangleCount();
+		float error = std::max(simplifier.MeasureError(), levels.empty() ? 0.0f : levels.back().error);
+		levels.push_back(MeshLod{ simplifier.GetIndices(), error });
+	}
+	return levels;
+}
@@ -0,0 +1,324 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "frustum.h"
+#include "vertex_format.h"
+
+// Import-time partition of a mesh into meshlets: small runs of triangles with a bounding sphere and a normal
+// cone each, so whole clusters can be frustum and backface culled on the CPU before the draw. GL 3.3 has no
+// mesh shaders, so a meshlet is simply a contiguous range of the mesh's index list and the survivors are
+// drawn as merged ranges.
+
+constexpr size_t meshletMaxVertices = 64;
+constexpr size_t meshletMaxTriangles = 124;
+
+// Stored in the mesh cache as raw bytes, so it stays trivially copyable and 4-byte aligned
+struct Meshlet
+{
+	uint32_t firstIndex = 0;     // into the mesh's full-detail indices
+	uint32_t triangleCount = 0;
+	uint32_t vertexCount = 0;    // distinct vertices referenced
+	float coneCutoff = 1.0f;     // sin of the normal spread; 1 means the triangles face too many ways to cull
+	glm::vec3 center = glm::vec3(0.0f);
+	float radius = 0.0f;
+	glm::vec3 coneApex = glm::vec3(0.0f);
+	glm::vec3 coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+
+	bool HasCone() const { return coneCutoff < 1.0f; }
+
+	// Every triangle faces away from (or edge-on to) a camera at _eye, both in the mesh's model space.
+	// The apex is placed behind (or on) every triangle's plane; a camera inside the cone around -axis
+	// through the apex is then behind all of the planes too
+	bool IsBackfacing(const glm::vec3& _eye) const
+	{
+		if (!HasCone())
+			return false;
+		glm::vec3 toApex = coneApex - _eye;
+		float distance = glm::length(toApex);
+		return distance > 0.0f && glm::dot(toApex, coneAxis) >= coneCutoff * distance;
+	}
+};
+
+// Contiguous index range of a mesh's full-detail indices
+struct IndexRange
+{
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+};
+
+struct MeshletCullStats
+{
+	size_t meshlets = 0;
+	size_t frustumCulled = 0;
+	size_t backfaceCulled = 0;
+	size_t triangles = 0;       // before culling
+	size_t trianglesDrawn = 0;
+	size_t ranges = 0;          // draw ranges after merging neighbours
+
+	MeshletCullStats& operator+=(const MeshletCullStats& _other)
+	{
+		meshlets += _other.meshlets;
+		frustumCulled += _other.frustumCulled;
+		backfaceCulled += _other.backfaceCulled;
+		triangles += _other.triangles;
+		trianglesDrawn += _other.trianglesDrawn;
+		ranges += _other.ranges;
+		return *this;
+	}
+};
+
+// Bounding sphere (box center, farthest vertex) and normal cone of the triangles in [_firstIndex, + 3 * _triangleCount)
+inline Meshlet ComputeMeshletBounds(const std::vector<Vertex>& _vertices, const std::vector<unsigned int>& _indices,
+	uint32_t _firstIndex, uint32_t _triangleCount)
+{
+	Meshlet meshlet;
+	meshlet.firstIndex = _firstIndex;
+	meshlet.triangleCount = _triangleCount;
+	const uint32_t end = _firstIndex + 3 * _triangleCount;
+
+	glm::vec3 minimum(FLT_MAX), maximum(-FLT_MAX);
+	std::vector<unsigned int> distinct(_indices.begin() + _firstIndex, _indices.begin() + end);
+	std::sort(distinct.begin(), distinct.end());
+	distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+	meshlet.vertexCount = static_cast<uint32_t>(distinct.size());
+	for (unsigned int v : distinct) {
+		minimum = glm::min(minimum, _vertices[v].position);
+		maximum = glm::max(maximum, _vertices[v].position);
+	}
+	meshlet.center = (minimum + maximum) * 0.5f;
+	for (unsigned int v : distinct)
+		meshlet.radius = std::max(meshlet.radius, glm::length(_vertices[v].position - meshlet.center));
+
+	// Cone axis: the average face normal; degenerate triangles have no facing and don't constrain it
+	std::vector<glm::vec3> normals;
+	normals.reserve(_triangleCount);
+	glm::vec3 axis(0.0f);
+	for (uint32_t i = _firstIndex; i < end; i += 3) {
+		const glm::vec3& a = _vertices[_indices[i]].position;
+		glm::vec3 normal = glm::cross(_vertices[_indices[i + 1]].position - a, _vertices[_indices[i + 2]].position - a);
+		float length = glm::length(normal);
+		normals.push_back(length > 0.0f ? normal / length : glm::vec3(0.0f));
+		axis += normals.back();
+	}
+	float axisLength = glm::length(axis);
+	if (axisLength <= 0.0f)
+		return meshlet;
+	axis /= axisLength;
+
+	float minDot = 1.0f;
+	for (const glm::vec3& normal : normals)
+		if (normal != glm::vec3(0.0f))
+			minDot = std::min(minDot, glm::dot(normal, axis));
+	// Past ~84 degrees the apex runs off towards infinity and the cone almost never culls anything
+	if (minDot <= 0.1f)
+		return meshlet;
+
+	// Move the apex back along -axis until it is behind (or on) every triangle's plane
+	float t = 0.0f;
+	for (uint32_t i = _firstIndex, k = 0; i < end; i += 3, k++)
+		if (normals[k] != glm::vec3(0.0f))
+			t = std::max(t, -glm::dot(normals[k], _vertices[_indices[i]].position - meshlet.center) / glm::dot(normals[k], axis));
+
+	meshlet.coneAxis = axis;
+	meshlet.coneApex = meshlet.center - axis * t;
+	meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+	return meshlet;
+}
+
+// Reorders the triangles of _indices so each meshlet is a contiguous run and returns the meshlets in index order.
+// Meshlets grow greedily over shared vertices: the next triangle is the neighbour adding the fewest new vertices,
+// ties going to the one closest to the meshlet and best aligned with its normals, which keeps the spheres tight
+// and the cones narrow. A meshlet that runs out of neighbours while still small continues with the next
+// unused triangle in index order, which after vertex cache optimization is usually close by.
+inline std::vector<Meshlet> BuildMeshlets(const std::vector<Vertex>& _vertices, std::vector<unsigned int>& _indices,
+	size_t _maxVertices = meshletMaxVertices, size_t _maxTriangles = meshletMaxTriangles, float _coneWeight = 0.5f)
+{
+	const size_t triangleCount = _indices.size() / 3;
+	std::vector<Meshlet> meshlets;
+	if (triangleCount == 0 || _maxVertices < 3 || _maxTriangles == 0)
+		return meshlets;
+
+	// Face normals, centroids and the vertex -> triangle adjacency in compressed rows
+	std::vector<glm::vec3> normals(triangleCount), centroids(triangleCount);
+	std::vector<uint32_t> adjacencyStart(_vertices.size() + 1, 0);
+	double area = 0.0;
+	for (size_t t = 0; t < triangleCount; t++) {
+		const glm::vec3& a = _vertices[_indices[3 * t]].position;
+		const glm::vec3& b = _vertices[_indices[3 * t + 1]].position;
+		const glm::vec3& c = _vertices[_indices[3 * t + 2]].position;
+		glm::vec3 normal = glm::cross(b - a, c - a);
+		float length = glm::length(normal);
+		normals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+		centroids[t] = (a + b + c) / 3.0f;
+		area += 0.5 * length;
+		for (size_t k = 0; k < 3; k++)
+			adjacencyStart[_indices[3 * t + k] + 1]++;
+	}
+	for (size_t v = 0; v < _vertices.size(); v++)
+		adjacencyStart[v + 1] += adjacencyStart[v];
+	std::vector<uint32_t> adjacency(adjacencyStart.back());
+	{
+		std::vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+		for (size_t t = 0; t < triangleCount; t++)
+			for (size_t k = 0; k < 3; k++)
+				adjacency[fill[_indices[3 * t + k]]++] = static_cast<uint32_t>(t);
+	}
+
+	// Radius a full meshlet would have if it were a flat disc of average triangles
+	const float expectedRadius = std::max(static_cast<float>(std::sqrt(area / triangleCount * _maxTriangles / 3.14159265)), FLT_MIN);
+
+	std::vector<unsigned int> result;
+	result.reserve(_indices.size());
+	std::vector<uint8_t> emitted(triangleCount, 0);
+	std::vector<uint32_t> vertexStamp(_vertices.size(), ~0u);  // meshlet that already holds the vertex
+	std::vector<unsigned int> meshletVertices;
+	meshletVertices.reserve(_maxVertices);
+	size_t scan = 0;
+
+	for (uint32_t stamp = 0; result.size() < _indices.size(); stamp++) {
+		const uint32_t firstIndex = static_cast<uint32_t>(result.size());
+		uint32_t triangles = 0;
+		glm::vec3 centroidSum(0.0f), normalSum(0.0f);
+		meshletVertices.clear();
+
+		auto newVertexCount = [&](size_t _t) {
+			size_t count = 0;
+			for (size_t k = 0; k < 3; k++)
+				count += vertexStamp[_indices[3 * _t + k]] != stamp;
+			return count;
+		};
+		auto add = [&](size_t _t) {
+			emitted[_t] = 1;
+			for (size_t k = 0; k < 3; k++) {
+				unsigned int v = _indices[3 * _t + k];
+				result.push_back(v);
+				if (vertexStamp[v] != stamp) {
+					vertexStamp[v] = stamp;
+					meshletVertices.push_back(v);
+				}
+			}
+			centroidSum += centroids[_t];
+			normalSum += normals[_t];
+			triangles++;
+		};
+
+		while (triangles < _maxTriangles) {
+			size_t best = triangleCount, bestNew = 4;
+			float bestScore = FLT_MAX;
+			if (triangles > 0) {
+				const glm::vec3 center = centroidSum / static_cast<float>(triangles);
+				const float normalLength = glm::length(normalSum);
+				const glm::vec3 axis = normalLength > 0.0f ? normalSum / normalLength : glm::vec3(0.0f);
+				for (unsigned int v : meshletVertices)
+					for (uint32_t a = adjacencyStart[v]; a < adjacencyStart[v + 1]; a++) {
+						size_t t = adjacency[a];
+						if (emitted[t])
+							continue;
+						size_t added = newVertexCount(t);
+						if (meshletVertices.size() + added > _maxVertices || added > bestNew)
+							continue;
+						float distance = glm::length(centroids[t] - center);
+						float score = (1.0f + distance / expectedRadius * (1.0f - _coneWeight)) *
+							std::max(1.0f - glm::dot(normals[t], axis) * _coneWeight, 1e-3f);
+						if (added < bestNew || score < bestScore) {
+							best = t;
+							bestNew = added;
+							bestScore = score;
+						}
+					}
+			}
+			if (best == triangleCount) {
+				// No neighbour fits: seed or top up a small meshlet from the index order, else close it
+				if (triangles * 4 >= _maxTriangles)
+					break;
+				while (scan < triangleCount && emitted[scan])
+					scan++;
+				if (scan == triangleCount || meshletVertices.size() + newVertexCount(scan) > _maxVertices)
+					break;
+				best = scan;
+			}
+			add(best);
+		}
+
+		meshlets.push_back(ComputeMeshletBounds(_vertices, result, firstIndex, triangles));
+	}
+
+	_indices = std::move(result);
+	return meshlets;
+}
+
+// The meshlets cover every triangle exactly once, respect the limits, bound their vertices and only
+// claim a cone when every triangle in it faces away from a camera inside the cone
+inline bool VerifyMeshlets(const std::vector<Vertex>& _vertices, const std::vector<unsigned int>& _indices,
+	const std::vector<Meshlet>& _meshlets, size_t _maxVertices = meshletMaxVertices, size_t _maxTriangles = meshletMaxTriangles)
+{
+	uint32_t next = 0;
+	for (const Meshlet& meshlet : _meshlets) {
+		if (meshlet.firstIndex != next || meshlet.triangleCount == 0 || meshlet.triangleCount > _maxTriangles ||
+			meshlet.vertexCount > _maxVertices)
+			return false;
+		next += 3 * meshlet.triangleCount;
+		if (next > _indices.size())
+			return false;
+
+		const float slack = 1e-4f * std::max(meshlet.radius, 1.0f);
+		for (uint32_t i = meshlet.firstIndex; i < next; i++)
+			if (glm::length(_vertices[_indices[i]].position - meshlet.center) > meshlet.radius + slack)
+				return false;
+		if (!meshlet.HasCone())
+			continue;
+		const float minDot = std::sqrt(1.0f - meshlet.coneCutoff * meshlet.coneCutoff);
+		for (uint32_t i = meshlet.firstIndex; i < next; i += 3) {
+			const glm::vec3& a = _vertices[_indices[i]].position;
+			glm::vec3 normal = glm::cross(_vertices[_indices[i + 1]].position - a, _vertices[_indices[i + 2]].position - a);
+			float length = glm::length(normal);
+			if (length <= 0.0f)
+				continue;
+			normal /= length;
+			if (glm::dot(normal, a - meshlet.coneApex) < -slack || glm::dot(normal, meshlet.coneAxis) < minDot - 1e-4f)
+				return false;
+		}
+	}
+	return next == _indices.size();
+}
+
+// Frustum and cone test of every meshlet of a mesh drawn with _model; appends the visible index ranges,
+// merging neighbours, and accumulates the counts into _stats
+inline void CullMeshlets(const std::vector<Meshlet>& _meshlets, const glm::mat4& _model, const Frustum& _frustum,
+	const glm::vec3& _cameraPosition, std::vector<IndexRange>& _ranges, MeshletCullStats& _stats)
+{
+	// Spheres grow by the largest axis scale; the cone test happens in model space, where it is exact
+	const float scale = std::sqrt(std::max({ glm::dot(glm::vec3(_model[0]), glm::vec3(_model[0])),
+		glm::dot(glm::vec3(_model[1]), glm::vec3(_model[1])), glm::dot(glm::vec3(_model[2]), glm::vec3(_model[2])) }));
+	const glm::vec3 eye = glm::vec3(glm::inverse(_model) * glm::vec4(_cameraPosition, 1.0f));
+	// A mirroring transform flips the winding, and with it which side is the front
+	const bool mirrored = glm::determinant(glm::mat3(_model)) < 0.0f;
+
+	const size_t firstRange = _ranges.size();
+	for (const Meshlet& meshlet : _meshlets) {
+		_stats.meshlets++;
+		_stats.triangles += meshlet.triangleCount;
+		if (!_frustum.IntersectsSphere(glm::vec3(_model * glm::vec4(meshlet.center, 1.0f)), meshlet.radius * scale)) {
+			_stats.frustumCulled++;
+			continue;
+		}
+		if (!mirrored && meshlet.IsBackfacing(eye)) {
+			_stats.backfaceCulled++;
+			continue;
+		}
+
+		_stats.trianglesDrawn += meshlet.triangleCount;
+		if (_ranges.size() > firstRange && _ranges.back().firstIndex + _ranges.back().indexCount == meshlet.firstIndex)
+			_ranges.back().indexCount += 3 * meshlet.triangleCount;
+		else
+			_ranges.push_back(IndexRange{ meshlet.firstIndex, 3 * meshlet.triangleCount });
+	}
+	_stats.ranges += _ranges.size() - firstRange;
+}
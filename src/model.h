@@ -5,36 +5,155 @@
 #include "stb_image.h"
 #endif 
 
+#include <cfloat>
 #include <vector>
+#include <unordered_map>
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include <GL/glew.h>
 
+#include "frustum.h"
+#include "instance_buffer.h"
 #include "mesh.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
 #include "shader.h"
+#include "texture_cache.h"
+#include "texture_loader.h"
 
 unsigned int TextureFromFile(const char* path, const std::string& directory);
 
+// Import settings of a Model
+struct ModelOptions
+{
+	// GPU vertex layout of every mesh; the CPU arrays stay fp32
+	VertexFormat vertexFormat = VertexFormat::Float32;
+
+	// Reorder triangles for the post-transform vertex cache and vertices for fetch locality
+	bool optimizeVertexCache = false;
+
+	// With optimizeVertexCache, also sort triangle clusters to reduce overdraw
+	bool optimizeOverdraw = false;
+
+	// Levels of detail simplified below the full mesh, each with about half the triangles of the one before
+	unsigned int lodLevels = 0;
+
+	// Partition the full detail into meshlets for DrawCulled; replaces the overdraw order of the triangles
+	bool buildMeshlets = false;
+
+	// Options that change the imported data and therefore the mesh cache key
+	uint32_t GetProcessFlags() const
+	{
+		return (optimizeVertexCache ? 1u : 0u) | (optimizeVertexCache && optimizeOverdraw ? 2u : 0u) | (lodLevels << 2) |
+			(buildMeshlets ? 1u << 16 : 0u);
+	}
+};
+
 class Model
 {
 public:
 	Model() = delete;
 
-	Model(const std::string& _filePath) {
+	Model(const std::string& _filePath, const ModelOptions& _options = ModelOptions())
+		: options(_options)
+	{
 		LoadModel(_filePath);
 	}
 
+	Model(const std::string& _filePath, VertexFormat _vertexFormat)
+		: Model(_filePath, ModelOptions{ _vertexFormat })
+	{
+	}
+
+	// Return this model's texture references to the shared cache
+	~Model() {
+		for (const Texture& texture : textures_loaded)
+			TextureCache::Get().Release(texture.id);
+	}
+
+	// Each texture reference is released exactly once
+	Model(const Model&) = delete;
+	Model& operator=(const Model&) = delete;
+
 	void Draw(Shader& _shader) 
 	{
 		for (size_t i = 0; i < meshes.size(); i++)
 			meshes[i].Draw(_shader);
 	}
 
+	// Draw _count instances of every mesh, instance i placed by the i-th _format entry of _instanceBuffer's
+	// last write (shader attribute locations 3 on). The geometry pool keeps one instanced VAO per buffer segment
+	// for all meshes of a format, so this costs one instanced draw per mesh and no VAO switches between them.
+	void DrawInstanced(Shader& _shader, const InstanceBuffer& _instanceBuffer, unsigned int _count,
+		InstanceFormat _format = InstanceFormat::Mat4, unsigned int _level = 0, unsigned int _firstInstance = 0)
+	{
+		DrawInstanced(_shader, _instanceBuffer.GetID(), _instanceBuffer.GetOffset(), _count, _format, _level, _firstInstance);
+	}
+
+	// Same, from instances at _offset in any vertex buffer, e.g. one the GPU wrote. _level picks the level of
+	// detail of every mesh, _firstInstance the first entry drawn. That is the base instance with GL 4.2 /
+	// ARB_base_instance; without, the instance attributes are pointed at it for the draw and back after
+	void DrawInstanced(Shader& _shader, GLuint _instanceBuffer, size_t _offset, unsigned int _count, InstanceFormat _format,
+		unsigned int _level = 0, unsigned int _firstInstance = 0)
+	{
+		if (_count == 0)
+			return;
+		const bool repoint = _firstInstance != 0
+			&& !((GLEW_VERSION_4_2 || GLEW_ARB_base_instance) && glDrawElementsInstancedBaseVertexBaseInstance);
+		for (const Mesh& mesh : meshes) {
+			mesh.BindTextures(_shader);
+			GLState::Get().BindVertexArray(mesh.GetPool().GetInstancedVAO(_instanceBuffer, _offset, _format));
+			if (repoint) {
+				glBindBuffer(GL_ARRAY_BUFFER, _instanceBuffer);
+				EnableInstanceAttributes(_format, _offset + _firstInstance * GetInstanceStride(_format));
+				mesh.DrawBound(_count, _level);
+				EnableInstanceAttributes(_format, _offset);
+			}
+			else {
+				mesh.DrawBound(_count, _level, _firstInstance);
+			}
+		}
+		GLState::Get().EndDraw();
+	}
+
+	// Draw the full detail of every mesh, skipping meshlets outside _frustum or facing away from _cameraPosition
+	// (both world space). Meshes imported without meshlets are drawn whole and count as drawn triangles
+	MeshletCullStats DrawCulled(Shader& _shader, const glm::mat4& _model, const Frustum& _frustum, const glm::vec3& _cameraPosition)
+	{
+		MeshletCullStats stats;
+		for (const Mesh& mesh : meshes) {
+			cullRanges.clear();
+			if (mesh.meshlets.empty()) {
+				cullRanges.push_back(IndexRange{ 0, static_cast<uint32_t>(mesh.indices.size()) });
+				stats.triangles += mesh.GetTriangleCount();
+				stats.trianglesDrawn += mesh.GetTriangleCount();
+				stats.ranges++;
+			}
+			else {
+				CullMeshlets(mesh.meshlets, _model, _frustum, _cameraPosition, cullRanges, stats);
+				if (cullRanges.empty())
+					continue;
+			}
+			mesh.BindTextures(_shader);
+			GLState::Get().BindVertexArray(mesh.GetVAO());
+			mesh.DrawRanges(cullRanges, cullDraws);
+		}
+		GLState::Get().EndDraw();
+		return stats;
+	}
+
+	// Assimp post-processing steps, also part of the mesh cache key
+	static constexpr unsigned int importFlags = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
 private:
 	void LoadModel(const std::string& _filePath);
 
+	void LoadMeshes(const std::string& _filePath);
+
+	bool LoadFromCache(const std::string& _filePath, uint64_t _sourceHash);
+
 	void ProcessNode(aiNode* node, const aiScene* scene);
 
 	Mesh ProcessMesh(aiMesh* mesh, const aiScene* scene);
@@ -42,24 +161,123 @@ private:
 	std::vector<Texture> LoadMaterialTextures(aiMaterial* mat, aiTextureType type,
 		std::string typeName);
 
+	Texture LoadTexture(const std::string& _path, const std::string& _typeName);
+
 public:
 	std::vector<Mesh>& GetMesh() { return meshes; }
 	const std::vector<Mesh>& GetMesh() const { return meshes; }
 
+	VertexFormat GetVertexFormat() const { return options.vertexFormat; }
+	const ModelOptions& GetOptions() const { return options; }
+
+	// GPU vertex memory across all meshes
+	size_t GetVertexBufferSize() const
+	{
+		size_t bytes = 0;
+		for (const Mesh& mesh : meshes)
+			bytes += mesh.GetVertexBufferSize();
+		return bytes;
+	}
+
+	// Packing error of all meshes against their fp32 source (empty for VertexFormat::Float32)
+	VertexQuantizationError GetQuantizationError() const
+	{
+		VertexQuantizationError error;
+		for (const Mesh& mesh : meshes)
+			error.Merge(mesh.GetQuantizationError());
+		return error;
+	}
+
+	// Levels of detail every mesh has; level 0 is full detail
+	unsigned int GetLevelCount() const
+	{
+		unsigned int levels = meshes.empty() ? 1 : ~0u;
+		for (const Mesh& mesh : meshes)
+			levels = std::min(levels, mesh.GetLevelCount());
+		return levels;
+	}
+
+	// Largest error of a mesh at each level, in model units, for picking levels by distance
+	std::vector<float> GetLevelErrors() const
+	{
+		std::vector<float> errors(GetLevelCount(), 0.0f);
+		for (const Mesh& mesh : meshes)
+			for (unsigned int level = 0; level < errors.size(); level++)
+				errors[level] = std::max(errors[level], mesh.GetLevelError(level));
+		return errors;
+	}
+
+	size_t GetTriangleCount(unsigned int _level = 0) const
+	{
+		size_t triangles = 0;
+		for (const Mesh& mesh : meshes)
+			triangles += mesh.GetTriangleCount(std::min(_level, mesh.GetLevelCount() - 1));
+		return triangles;
+	}
+
+	// Sphere around all meshes in model space, centered on their bounding box
+	BoundingSphere GetBoundingSphere() const
+	{
+		glm::vec3 minimum(FLT_MAX), maximum(-FLT_MAX);
+		for (const Mesh& mesh : meshes)
+			for (const Vertex& vertex : mesh.vertices) {
+				minimum = glm::min(minimum, vertex.position);
+				maximum = glm::max(maximum, vertex.position);
+			}
+
+		BoundingSphere sphere;
+		if (minimum.x > maximum.x)
+			return sphere;
+		sphere.center = 0.5f * (minimum + maximum);
+		for (const Mesh& mesh : meshes)
+			for (const Vertex& vertex : mesh.vertices)
+				sphere.radius = std::max(sphere.radius, glm::length(vertex.position - sphere.center));
+		return sphere;
+	}
+
 public:
 	std::vector<Texture>textures_loaded;
 	std::vector<Mesh>meshes;
 	std::string directory;
+	bool loadedFromCache = false;
+
+private:
+	ModelOptions options;
+	// DrawCulled scratch, kept to avoid reallocating every frame
+	std::vector<IndexRange> cullRanges;
+	MultiDrawArgs cullDraws;
+
+	// Only set while LoadModel runs; decodes this model's textures on the thread pool
+	TextureLoader* textureLoader = nullptr;
+
+	// Path (relative to directory) -> index into textures_loaded
+	std::unordered_map<std::string, size_t> textureIndices;
 };
 
 // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+// Textures are decoded on worker threads while the meshes are built, then uploaded as each one finishes.
 void Model::LoadModel(const std::string& _filePath)
 {
+	directory = _filePath.substr(0, _filePath.find_last_of('/'));
+
+	TextureLoader loader;
+	textureLoader = &loader;
+	LoadMeshes(_filePath);
+	loader.Finish();
+	textureLoader = nullptr;
+}
+
+// A binary cache next to the asset is tried first; Assimp only runs on a miss and then refreshes the cache.
+inline void Model::LoadMeshes(const std::string& _filePath)
+{
+	const uint64_t sourceHash = MeshCache::HashFile(_filePath);
+	if (LoadFromCache(_filePath, sourceHash))
+		return;
+
 	Assimp::Importer import;
 
-	// Change the load settings accordingly in need
-	const aiScene* scene = import.ReadFile(_filePath, 
-		aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+	// Change the load settings accordingly in need (importFlags)
+	const aiScene* scene = import.ReadFile(_filePath, importFlags);
 
 #ifdef _DEBUG
 	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
@@ -68,9 +286,40 @@ void Model::LoadModel(const std::string& _filePath)
 	}
 #endif 
 
-	directory = _filePath.substr(0, _filePath.find_last_of('/'));
-
 	ProcessNode(scene->mRootNode, scene);
+
+	if (sourceHash != 0 && !MeshCache::Save(_filePath, sourceHash, importFlags, options.GetProcessFlags(), meshes)) {
+#ifdef _DEBUG
+		std::cout << "Failed to write mesh cache: " << MeshCache::GetCachePath(_filePath, options.GetProcessFlags()) << "\n";
+#endif
+	}
+}
+
+// Build the meshes straight from the mapped cache file; returns false on a cache miss
+inline bool Model::LoadFromCache(const std::string& _filePath, uint64_t _sourceHash)
+{
+	MeshCacheReader reader;
+	if (!reader.Open(_filePath, _sourceHash, importFlags, options.GetProcessFlags()))
+		return false;
+
+	meshes.reserve(reader.GetMeshes().size());
+	for (const MeshCacheView& view : reader.GetMeshes()) {
+		std::vector<Texture> textures;
+		for (const auto& [type, path] : view.textures)
+			textures.push_back(LoadTexture(path, type));
+
+		std::vector<MeshLod> lods;
+		for (const MeshCacheView::Lod& lod : view.lods)
+			lods.push_back(MeshLod{ std::vector<unsigned int>(lod.indices, lod.indices + lod.indexCount), lod.error });
+
+		meshes.emplace_back(std::vector<Vertex>(view.vertices, view.vertices + view.vertexCount),
+			std::vector<unsigned int>(view.indices, view.indices + view.indexCount),
+			std::move(textures), view.hasTangentAndBitangent, options.vertexFormat, std::move(lods),
+			std::vector<Meshlet>(view.meshlets, view.meshlets + view.meshletCount));
+	}
+
+	loadedFromCache = true;
+	return true;
 }
 
 // Iterate through all Node, from scene->mRootNode
@@ -133,6 +382,29 @@ inline Mesh Model::ProcessMesh(aiMesh* mesh, const aiScene* scene)
 		}
 	}
 
+	// Optional import passes; meshes with points or lines left after triangulation keep their order and get no LODs
+	const bool triangles = mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE;
+	if (options.optimizeVertexCache && triangles)
+		OptimizeMesh(vertices, indices, options.optimizeOverdraw);
+
+	// The levels reuse the vertices, so only their triangle order is optimized
+	std::vector<MeshLod> lods;
+	if (options.lodLevels > 0 && triangles)
+		lods = BuildLodChain(vertices, indices, options.lodLevels);
+	if (options.optimizeVertexCache)
+		for (MeshLod& lod : lods)
+			OptimizeVertexCache(lod.indices, vertices.size());
+
+	// Last, as it reorders the full-detail triangles; the levels above already have their own lists
+	std::vector<Meshlet> meshlets;
+	if (options.buildMeshlets && triangles) {
+		meshlets = BuildMeshlets(vertices, indices);
+#ifdef _DEBUG
+		if (!VerifyMeshlets(vertices, indices, meshlets))
+			std::cout << "ERROR::MODEL::Meshlets do not cover the triangles or their bounds are not conservative\n";
+#endif
+	}
+
 	// Process textures based on shader naming conventions
 	if (mesh->mMaterialIndex >= 0) {
 		aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
@@ -152,9 +424,9 @@ inline Mesh Model::ProcessMesh(aiMesh* mesh, const aiScene* scene)
 	}
 
 	if (mesh->HasTangentsAndBitangents()) 
-		return Mesh(vertices, indices, textures, true);
+		return Mesh(std::move(vertices), std::move(indices), std::move(textures), true, options.vertexFormat, std::move(lods), std::move(meshlets));
 	else
-		return Mesh(vertices, indices, textures, false);
+		return Mesh(std::move(vertices), std::move(indices), std::move(textures), false, options.vertexFormat, std::move(lods), std::move(meshlets));
 }
 
 // Return a vector contains Texture, retriving texture information from aiMaterial to our own textures and textures_loaded
@@ -169,31 +441,30 @@ inline std::vector<Texture> Model::LoadMaterialTextures(aiMaterial* mat, aiTextu
 		aiString str;
 		mat->GetTexture(type, i, &str);
 
-		bool skip = false;
-		for (size_t j = 0; j < textures_loaded.size(); j++) {
-			// Iterate through textures_loaded vector, to check if it already exisits.
-			if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0) {
-				// Use the located texture directly since we've already loaded
-				textures.push_back(textures_loaded[j]);
-				skip = true;
-				break;
-			}
-		}
-
-		// If the texture has not been loaded yet, add it
-		if (!skip) {
-			Texture texture;
-			texture.id = TextureFromFile(str.C_Str(), directory);
-			texture.type = typeName;
-			texture.path = str.C_Str();
-
-			textures.push_back(texture);
-			textures_loaded.push_back(texture);
-		}
+		textures.push_back(LoadTexture(str.C_Str(), typeName));
 	}
 	return textures;
 }
 
+// Return the texture for a path relative to the model directory.
+// The model keeps one reference per distinct path in the process-wide TextureCache,
+// so textures shared with other models are only decoded and uploaded once.
+inline Texture Model::LoadTexture(const std::string& _path, const std::string& _typeName)
+{
+	auto it = textureIndices.find(_path);
+	if (it != textureIndices.end())
+		return textures_loaded[it->second];
+
+	Texture texture;
+	texture.id = TextureCache::Get().Acquire(directory + '/' + _path, textureLoader);
+	texture.type = _typeName;
+	texture.path = _path;
+
+	textureIndices.emplace(_path, textures_loaded.size());
+	textures_loaded.push_back(texture);
+	return texture;
+}
+
 // Load a texture and return the actual id.
 unsigned int TextureFromFile(const char* path, const std::string& directory)
 {
@@ -207,20 +478,7 @@ unsigned int TextureFromFile(const char* path, const std::string& directory)
 	int width, height, nrComponents;
 	unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
 	if (data) {
-		GLenum format;
-		if (nrComponents == 1) format = GL_RED;
-		if (nrComponents == 3) format = GL_RGB;
-		if (nrComponents == 4) format = GL_RGBA;
-
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
+		UploadTexture(textureID, data, width, height, nrComponents);
 		stbi_image_free(data);
 	}
 	else {
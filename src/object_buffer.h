@@ -0,0 +1,157 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <GL/glew.h>
+
+#include "shader.h"
+#include "stream_buffer.h"
+
+// One object's entry in the Objects uniform block, std140 layout (80 bytes, no padding).
+// params is free for per-object material values (tint, roughness, texture layer, ...).
+struct ObjectData
+{
+	glm::mat4 model = glm::mat4(1.0f);
+	glm::vec4 params = glm::vec4(0.0f);
+};
+
+static_assert(sizeof(ObjectData) == 80, "ObjectData must match the std140 layout of the Objects block");
+
+// Per-frame buffer holding the data of every object drawn this frame, written once and uploaded in one call.
+// Objects that share a draw (same VAO, textures and vertex range) are pushed as a Batch and drawn with a
+// single glDrawArraysInstanced; the vertex shader reads objects[gl_InstanceID] from this block:
+//
+//   struct ObjectData { mat4 model; vec4 params; };
+//   layout (std140) uniform Objects { ObjectData objects[200]; };
+//
+// GL 3.3 has no storage buffers and only guarantees 16 KiB per uniform block, so a batch is drawn in
+// chunks of maxObjectsPerDraw, each chunk bound with glBindBufferRange at an aligned offset.
+// The frame's data goes into the next segment of a StreamBuffer ring, so no upload waits for the GPU.
+class ObjectBuffer
+{
+public:
+	static constexpr unsigned int maxObjectsPerDraw = 200; // the array size in the shaders
+	static constexpr GLuint defaultBindingPoint = 1;       // 0 is the Matrices block of the UBO demo
+	static constexpr size_t blockSize = maxObjectsPerDraw * sizeof(ObjectData);
+
+	struct Batch
+	{
+		size_t firstChunk = 0, chunkCount = 0;
+		size_t objectCount = 0;
+	};
+
+	struct Stats
+	{
+		size_t objects = 0, batches = 0;
+		size_t draws = 0;          // instanced draw calls, one per chunk
+		size_t uploadedBytes = 0;
+	};
+
+	explicit ObjectBuffer(GLuint _bindingPoint = defaultBindingPoint)
+		: bindingPoint(_bindingPoint), stream(GL_UNIFORM_BUFFER, blockSize)
+	{
+		GLint offsetAlignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+		alignment = std::max<size_t>(offsetAlignment, 16);
+	}
+
+	ObjectBuffer(const ObjectBuffer&) = delete;
+	ObjectBuffer& operator=(const ObjectBuffer&) = delete;
+
+	// Point _shader's Objects block at this buffer's binding point; once per shader
+	void BindShader(Shader& _shader) const { _shader.BindUniformBlock("Objects", bindingPoint); }
+
+	// Start a frame; batches of the previous one become invalid
+	void Begin()
+	{
+		staging.clear();
+		chunks.clear();
+		stats = Stats();
+	}
+
+	Batch Push(const ObjectData* _objects, size_t _count);
+	Batch Push(const std::vector<ObjectData>& _objects) { return Push(_objects.data(), _objects.size()); }
+	Batch Push(std::initializer_list<glm::mat4> _models)
+	{
+		std::vector<ObjectData> objects(_models.size());
+		std::transform(_models.begin(), _models.end(), objects.begin(), [](const glm::mat4& _model) { return ObjectData{ _model }; });
+		return Push(objects);
+	}
+
+	// Everything pushed since Begin, copied into the next stream segment at once. Every chunk is bound
+	// with the full block size, so the segment extends a whole block past the last chunk.
+	void Upload()
+	{
+		if (chunks.empty())
+			return;
+		size_t required = chunks.back().offset + blockSize;
+		if (required > stream.GetCapacity())
+			stream.Reserve(std::max(required, stream.GetCapacity() * 2));
+		std::memcpy(stream.BeginWrite(staging.size()), staging.data(), staging.size());
+		stream.EndWrite();
+		stats.uploadedBytes = staging.size();
+	}
+
+	// Bind each chunk of the batch in turn and call _draw(instanceCount), which issues one instanced draw
+	template<class DrawFunction>
+	void Draw(const Batch& _batch, DrawFunction _draw)
+	{
+		for (size_t i = _batch.firstChunk; i < _batch.firstChunk + _batch.chunkCount; i++) {
+			glBindBufferRange(GL_UNIFORM_BUFFER, bindingPoint, stream.GetID(), stream.GetOffset() + chunks[i].offset, blockSize);
+			_draw(static_cast<GLsizei>(chunks[i].count));
+			stats.draws++;
+		}
+	}
+
+	// glDrawArraysInstanced over the batch; the caller binds program, VAO and textures
+	void DrawArrays(const Batch& _batch, GLenum _mode, GLint _first, GLsizei _count)
+	{
+		Draw(_batch, [&](GLsizei _instances) { glDrawArraysInstanced(_mode, _first, _count, _instances); });
+	}
+
+	const Stats& GetStats() const { return stats; }
+	const StreamBuffer::Stats& GetStreamStats() const { return stream.GetStats(); }
+
+private:
+	struct Chunk
+	{
+		size_t offset;  // bytes, a multiple of the offset alignment
+		size_t count;
+	};
+
+	GLuint bindingPoint;
+	size_t alignment = 256;
+	StreamBuffer stream;
+	std::vector<unsigned char> staging;
+	std::vector<Chunk> chunks;
+	Stats stats;
+};
+
+inline ObjectBuffer::Batch ObjectBuffer::Push(const ObjectData* _objects, size_t _count)
+{
+	Batch batch;
+	batch.firstChunk = chunks.size();
+	batch.objectCount = _count;
+	for (size_t first = 0; first < _count; first += maxObjectsPerDraw) {
+		Chunk chunk;
+		chunk.offset = (staging.size() + alignment - 1) / alignment * alignment;
+		chunk.count = std::min<size_t>(maxObjectsPerDraw, _count - first);
+		staging.resize(chunk.offset + chunk.count * sizeof(ObjectData));
+		std::memcpy(staging.data() + chunk.offset, _objects + first, chunk.count * sizeof(ObjectData));
+		chunks.push_back(chunk);
+	}
+	batch.chunkCount = chunks.size() - batch.firstChunk;
+	stats.objects += _count;
+	stats.batches++;
+	return batch;
+}
+
+inline std::ostream& operator<<(std::ostream& _stream, const ObjectBuffer::Stats& _stats)
+{
+	return _stream << _stats.objects << " objects in " << _stats.batches << " batches, " << _stats.draws << " draws, "
+		<< _stats.uploadedBytes << " bytes uploaded";
+}
@@ -0,0 +1,499 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "simd_lanes.h"
+#include "vertex_format.h"
+
+// Software occlusion culling: a low-resolution depth buffer the CPU rasterizes a few large occluders into
+// each frame (the planet), so bounding boxes hidden behind them can be rejected before any draw is issued.
+// The buffer is split into 8x8 tiles. A triangle skips the tiles its edges exclude and writes the ones it
+// covers without edge tests, several pixels per SSE/AVX register. BuildHierarchy then keeps the nearest and
+// farthest depth of every tile, which answers most box tests without touching the pixels.
+// Depth is NDC z (-1 near, 1 far), sampled at pixel centers; pixels no occluder covers hold FLT_MAX.
+// A pixel whose center is covered may still show what is behind it along a silhouette, so the tests use
+// the farthest depth of each pixel's 3x3 neighbourhood instead of its own.
+class OcclusionBuffer
+{
+public:
+	static constexpr int tileSize = 8;
+
+	struct Stats
+	{
+		size_t occluderTriangles = 0;  // submitted this frame
+		size_t rasterizedTriangles = 0;  // left after backface culling and near clipping, as screen triangles
+		double rasterizeMs = 0.0;  // rasterizing and building the hierarchy
+	};
+
+	// Rounded up to whole tiles
+	explicit OcclusionBuffer(int _width = 256, int _height = 192);
+
+	// Start a frame seen through _viewProjection: every pixel empty
+	void Clear(const glm::mat4& _viewProjection);
+	// Counter-clockwise triangles of an occluder mesh placed by _model; back faces are skipped
+	void RasterizeTriangles(const std::vector<Vertex>& _vertices, const std::vector<unsigned int>& _indices, const glm::mat4& _model);
+	// After the last occluder of the frame, before testing: the widened depth and the tile bounds over it
+	void BuildHierarchy();
+
+	// Whether any part of the box (model space of _model) may be in front of the occluders. Boxes crossing
+	// the near plane or off the screen count as visible; frustum culling is the caller's. Thread-safe
+	bool IsBoxVisible(const glm::vec3& _min, const glm::vec3& _max, const glm::mat4& _model = glm::mat4(1.0f)) const;
+	// IsBoxVisible from the widened pixels alone, without the tile hierarchy
+	bool IsBoxVisibleReference(const glm::vec3& _min, const glm::vec3& _max, const glm::mat4& _model = glm::mat4(1.0f)) const;
+
+	// For tests: an occluder as given to RasterizeTriangles, drawn without any of its code. Each triangle is clipped
+	// against the near plane in clip space and every pixel center in its bounds weighed with barycentric coordinates,
+	// all in double precision. Pixels whose center is within _margin pixels of an edge may go either way, so _strict
+	// only takes the triangles covering the center by more than that and _loose every one within it; a correct
+	// result lies between the two. Both accumulate over calls; start them as GetDepth().size() pixels of FLT_MAX
+	void RasterizeReference(const std::vector<Vertex>& _vertices, const std::vector<unsigned int>& _indices, const glm::mat4& _model,
+		std::vector<float>& _strict, std::vector<float>& _loose, float _margin = 1e-3f) const;
+	// Number of pixels of GetDepth() outside the bounds RasterizeReference produced for the same occluders
+	size_t CountReferenceMismatches(const std::vector<float>& _strict, const std::vector<float>& _loose) const;
+
+	int GetWidth() const { return width; }
+	int GetHeight() const { return height; }
+	const std::vector<float>& GetDepth() const { return depth; }  // As rasterized, row-major from the bottom row
+	const std::vector<float>& GetTestDepth() const { return testDepth; }  // Widened by BuildHierarchy
+	float GetTileMin(int _tileX, int _tileY) const { return tileMin[_tileY * tilesX + _tileX]; }
+	float GetTileMax(int _tileX, int _tileY) const { return tileMax[_tileY * tilesX + _tileX]; }
+	const Stats& GetStats() const { return stats; }
+
+private:
+	// Pixel x, y and NDC depth of the corners, counter-clockwise
+	struct ScreenTriangle
+	{
+		glm::vec3 v[3];
+	};
+
+	// Edge functions A x + B y + C, positive inside, and the depth plane, over pixel coordinates
+	struct TriangleSetup
+	{
+		float edgeA[3], edgeB[3], edgeC[3];
+		float depthA, depthB, depthC;
+		int x0, y0, x1, y1;  // inclusive pixel range of the centers the bounds can cover
+	};
+
+	// Pixels [x0, x1] x [y0, y1] the projected box touches and its nearest depth
+	struct ScreenRect
+	{
+		int x0, y0, x1, y1;
+		float nearestDepth;
+		bool visible;  // decided without looking at pixels: near plane crossing or off screen
+	};
+
+	bool Setup(const ScreenTriangle& _triangle, TriangleSetup& _setup) const;
+	ScreenRect ProjectBox(const glm::vec3& _min, const glm::vec3& _max, const glm::mat4& _model) const;
+	void AddClipTriangle(const glm::vec4& _a, const glm::vec4& _b, const glm::vec4& _c);
+	glm::vec3 ToScreen(const glm::vec4& _clip) const;
+
+	template<class Lanes>
+	void RasterizeTriangle(const TriangleSetup& _setup);
+	template<class Lanes>
+	void WidenRow(const float* _source, float* _destination) const;
+	template<class Lanes>
+	void BuildTileBounds(int _tileX, int _tileY);
+	template<class Lanes>
+	bool AnyPixelVisible(const ScreenRect& _rect, int _x0, int _x1, int _y0, int _y1) const;
+
+	int width = 0, height = 0, tilesX = 0, tilesY = 0;
+	glm::mat4 viewProjection = glm::mat4(1.0f);
+	std::vector<float> depth;
+	std::vector<float> testDepth;  // Farthest of the 3x3 neighbourhood, what the tests read
+	std::vector<float> rowScratch;
+	std::vector<float> tileMin, tileMax;
+	std::vector<ScreenTriangle> triangles;  // RasterizeTriangles scratch: the clipped triangles of its mesh
+	Stats stats;
+};
+
+inline OcclusionBuffer::OcclusionBuffer(int _width, int _height)
+{
+	tilesX = std::max(1, (_width + tileSize - 1) / tileSize);
+	tilesY = std::max(1, (_height + tileSize - 1) / tileSize);
+	width = tilesX * tileSize;
+	height = tilesY * tileSize;
+	depth.assign(size_t(width) * height, FLT_MAX);
+	testDepth.assign(depth.size(), FLT_MAX);
+	rowScratch.assign(depth.size(), FLT_MAX);
+	tileMin.assign(size_t(tilesX) * tilesY, FLT_MAX);
+	tileMax.assign(size_t(tilesX) * tilesY, FLT_MAX);
+}
+
+inline void OcclusionBuffer::Clear(const glm::mat4& _viewProjection)
+{
+	viewProjection = _viewProjection;
+	std::fill(depth.begin(), depth.end(), FLT_MAX);
+	std::fill(testDepth.begin(), testDepth.end(), FLT_MAX);
+	std::fill(tileMin.begin(), tileMin.end(), FLT_MAX);
+	std::fill(tileMax.begin(), tileMax.end(), FLT_MAX);
+	stats = Stats();
+}
+
+inline glm::vec3 OcclusionBuffer::ToScreen(const glm::vec4& _clip) const
+{
+	const float inverseW = 1.0f / _clip.w;
+	return glm::vec3((_clip.x * inverseW * 0.5f + 0.5f) * width, (_clip.y * inverseW * 0.5f + 0.5f) * height, _clip.z * inverseW);
+}
+
+// Clips against the near plane (z >= -w) only; the other sides are handled by the pixel bounds
+inline void OcclusionBuffer::AddClipTriangle(const glm::vec4& _a, const glm::vec4& _b, const glm::vec4& _c)
+{
+	const glm::vec4 input[3] = { _a, _b, _c };
+	glm::vec4 polygon[4];
+	int count = 0;
+	for (int i = 0; i < 3; i++) {
+		const glm::vec4& current = input[i];
+		const glm::vec4& next = input[(i + 1) % 3];
+		float currentDistance = current.z + current.w, nextDistance = next.z + next.w;
+		if (currentDistance >= 0.0f)
+			polygon[count++] = current;
+		if ((currentDistance >= 0.0f) != (nextDistance >= 0.0f))
+			polygon[count++] = glm::mix(current, next, currentDistance / (currentDistance - nextDistance));
+	}
+	for (int i = 2; i < count; i++)
+		triangles.push_back(ScreenTriangle{ { ToScreen(polygon[0]), ToScreen(polygon[i - 1]), ToScreen(polygon[i]) } });
+}
+
+inline void OcclusionBuffer::RasterizeTriangles(const std::vector<Vertex>& _vertices, const std::vector<unsigned int>& _indices,
+	const glm::mat4& _model)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	const glm::mat4 modelViewProjection = viewProjection * _model;
+	std::vector<glm::vec4> clip(_vertices.size());
+	for (size_t i = 0; i < _vertices.size(); i++)
+		clip[i] = modelViewProjection * glm::vec4(_vertices[i].position, 1.0f);
+
+	triangles.clear();
+	for (size_t i = 0; i + 2 < _indices.size(); i += 3) {
+		const glm::vec4& a = clip[_indices[i]];
+		const glm::vec4& b = clip[_indices[i + 1]];
+		const glm::vec4& c = clip[_indices[i + 2]];
+		// Entirely outside one side of the view (the far plane aside): nothing to draw
+		if ((a.z < -a.w && b.z < -b.w && c.z < -c.w) || (a.x < -a.w && b.x < -b.w && c.x < -c.w) ||
+			(a.x > a.w && b.x > b.w && c.x > c.w) || (a.y < -a.w && b.y < -b.w && c.y < -c.w) || (a.y > a.w && b.y > b.w && c.y > c.w))
+			continue;
+		AddClipTriangle(a, b, c);
+	}
+	stats.occluderTriangles += _indices.size() / 3;
+
+	TriangleSetup setup;
+	for (const ScreenTriangle& triangle : triangles)
+		if (Setup(triangle, setup)) {
+			RasterizeTriangle<simd_lanes::Widest>(setup);
+			stats.rasterizedTriangles++;
+		}
+	stats.rasterizeMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// False for back-facing and degenerate triangles and those without a pixel center in their bounds
+inline bool OcclusionBuffer::Setup(const ScreenTriangle& _triangle, TriangleSetup& _setup) const
+{
+	const glm::vec3* v = _triangle.v;
+	const float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+	if (!(area > 0.0f))
+		return false;
+
+	for (int i = 0; i < 3; i++) {
+		const glm::vec3& from = v[i];
+		const glm::vec3& to = v[(i + 1) % 3];
+		_setup.edgeA[i] = from.y - to.y;
+		_setup.edgeB[i] = to.x - from.x;
+		_setup.edgeC[i] = from.x * to.y - to.x * from.y;
+	}
+	// Edge i is opposite corner (i + 2) % 3, so its function over the area is that corner's barycentric weight
+	const float dz1 = (v[1].z - v[0].z) / area, dz2 = (v[2].z - v[0].z) / area;
+	_setup.depthA = dz1 * _setup.edgeA[2] + dz2 * _setup.edgeA[0];
+	_setup.depthB = dz1 * _setup.edgeB[2] + dz2 * _setup.edgeB[0];
+	_setup.depthC = v[0].z + dz1 * _setup.edgeC[2] + dz2 * _setup.edgeC[0];
+
+	// Pixel i has its center at i + 0.5
+	const float minX = std::min({ v[0].x, v[1].x, v[2].x }), maxX = std::max({ v[0].x, v[1].x, v[2].x });
+	const float minY = std::min({ v[0].y, v[1].y, v[2].y }), maxY = std::max({ v[0].y, v[1].y, v[2].y });
+	_setup.x0 = static_cast<int>(std::max(0.0f, std::ceil(minX - 0.5f)));
+	_setup.y0 = static_cast<int>(std::max(0.0f, std::ceil(minY - 0.5f)));
+	_setup.x1 = static_cast<int>(std::min(static_cast<float>(width - 1), std::floor(maxX - 0.5f)));
+	_setup.y1 = static_cast<int>(std::min(static_cast<float>(height - 1), std::floor(maxY - 0.5f)));
+	return _setup.x0 <= _setup.x1 && _setup.y0 <= _setup.y1;
+}
+
+template<class Lanes>
+inline void OcclusionBuffer::RasterizeTriangle(const TriangleSetup& _setup)
+{
+	using L = Lanes;
+	using Float = typename L::Float;
+	static const float laneOffsets[8] = { 0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f };
+	const Float offsets = L::Load(laneOffsets);
+	const Float depthA = L::Splat(_setup.depthA);
+	const Float edgeA[3] = { L::Splat(_setup.edgeA[0]), L::Splat(_setup.edgeA[1]), L::Splat(_setup.edgeA[2]) };
+
+	for (int tileY = _setup.y0 / tileSize; tileY <= _setup.y1 / tileSize; tileY++)
+		for (int tileX = _setup.x0 / tileSize; tileX <= _setup.x1 / tileSize; tileX++) {
+			// The part of the tile inside the bounds; edge functions are linear, so their extremes are at its corners
+			const int x0 = std::max(_setup.x0, tileX * tileSize), x1 = std::min(_setup.x1, tileX * tileSize + tileSize - 1);
+			const int y0 = std::max(_setup.y0, tileY * tileSize), y1 = std::min(_setup.y1, tileY * tileSize + tileSize - 1);
+			bool outside = false, inside = true;
+			for (int e = 0; e < 3; e++) {
+				const float a = _setup.edgeA[e], b = _setup.edgeB[e], c = _setup.edgeC[e];
+				float low = c + a * ((a > 0.0f ? x0 : x1) + 0.5f) + b * ((b > 0.0f ? y0 : y1) + 0.5f);
+				float high = c + a * ((a > 0.0f ? x1 : x0) + 0.5f) + b * ((b > 0.0f ? y1 : y0) + 0.5f);
+				outside = outside || high < 0.0f;
+				inside = inside && low >= 0.0f;
+			}
+			if (outside)
+				continue;
+
+			// Whole registers from the aligned start; lanes past the bounds are outside by the edge tests
+			const int groupX0 = x0 / int(L::width) * int(L::width);
+			for (int y = y0; y <= y1; y++) {
+				const float centerY = y + 0.5f;
+				const Float depthRow = L::Splat(_setup.depthB * centerY + _setup.depthC);
+				Float edgeRow[3];
+				for (int e = 0; e < 3; e++)
+					edgeRow[e] = L::Splat(_setup.edgeB[e] * centerY + _setup.edgeC[e]);
+				float* row = &depth[size_t(y) * width];
+				for (int x = groupX0; x <= x1; x += int(L::width)) {
+					const Float centerX = L::Add(L::Splat(static_cast<float>(x)), offsets);
+					const Float z = L::Add(L::Mul(depthA, centerX), depthRow);
+					const Float current = L::Load(row + x);
+					const Float nearer = L::Min(current, z);
+					if (inside && x >= x0 && x + int(L::width) - 1 <= x1) {
+						L::Store(row + x, nearer);
+						continue;
+					}
+					Float coverage = L::Add(L::Mul(edgeA[0], centerX), edgeRow[0]);
+					coverage = L::Min(coverage, L::Add(L::Mul(edgeA[1], centerX), edgeRow[1]));
+					coverage = L::Min(coverage, L::Add(L::Mul(edgeA[2], centerX), edgeRow[2]));
+					L::Store(row + x, L::SelectSign(coverage, current, nearer));
+				}
+			}
+		}
+}
+
+inline void OcclusionBuffer::BuildHierarchy()
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	// Separable 3x3 maximum: along the rows, then across them
+	for (int y = 0; y < height; y++)
+		WidenRow<simd_lanes::Widest>(&depth[size_t(y) * width], &rowScratch[size_t(y) * width]);
+	for (int y = 0; y < height; y++) {
+		const float* below = &rowScratch[size_t(std::max(y - 1, 0)) * width];
+		const float* center = &rowScratch[size_t(y) * width];
+		const float* above = &rowScratch[size_t(std::min(y + 1, height - 1)) * width];
+		float* out = &testDepth[size_t(y) * width];
+		using L = simd_lanes::Widest;
+		for (int x = 0; x < width; x += int(L::width))
+			L::Store(out + x, L::Max(L::Max(L::Load(below + x), L::Load(center + x)), L::Load(above + x)));
+	}
+	for (int tileY = 0; tileY < tilesY; tileY++)
+		for (int tileX = 0; tileX < tilesX; tileX++)
+			BuildTileBounds<simd_lanes::Widest>(tileX, tileY);
+	stats.rasterizeMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Maximum of each pixel and its left and right neighbours; the ends of the row only have one
+template<class Lanes>
+inline void OcclusionBuffer::WidenRow(const float* _source, float* _destination) const
+{
+	using L = Lanes;
+	const int groups = width / int(L::width);
+	for (int group = 0; group < groups; group++) {
+		const int x = group * int(L::width);
+		if (x == 0 || x + int(L::width) >= width) {
+			for (int lane = x; lane < x + int(L::width); lane++)
+				_destination[lane] = std::max({ _source[std::max(lane - 1, 0)], _source[lane], _source[std::min(lane + 1, width - 1)] });
+			continue;
+		}
+		L::Store(_destination + x, L::Max(L::Max(L::Load(_source + x - 1), L::Load(_source + x)), L::Load(_source + x + 1)));
+	}
+}
+
+template<class Lanes>
+inline void OcclusionBuffer::BuildTileBounds(int _tileX, int _tileY)
+{
+	using L = Lanes;
+	using Float = typename L::Float;
+	Float nearest = L::Splat(FLT_MAX), farthest = L::Splat(-FLT_MAX);
+	for (int y = _tileY * tileSize; y < (_tileY + 1) * tileSize; y++)
+		for (int x = _tileX * tileSize; x < (_tileX + 1) * tileSize; x += int(L::width)) {
+			Float value = L::Load(&testDepth[size_t(y) * width + x]);
+			nearest = L::Min(nearest, value);
+			farthest = L::Max(farthest, value);
+		}
+
+	float lanesNearest[L::width], lanesFarthest[L::width];
+	L::Store(lanesNearest, nearest);
+	L::Store(lanesFarthest, farthest);
+	float& minimum = tileMin[size_t(_tileY) * tilesX + _tileX];
+	float& maximum = tileMax[size_t(_tileY) * tilesX + _tileX];
+	minimum = *std::min_element(lanesNearest, lanesNearest + L::width);
+	maximum = *std::max_element(lanesFarthest, lanesFarthest + L::width);
+}
+
+inline OcclusionBuffer::ScreenRect OcclusionBuffer::ProjectBox(const glm::vec3& _min, const glm::vec3& _max, const glm::mat4& _model) const
+{
+	ScreenRect rect{ 0, 0, -1, -1, FLT_MAX, true };
+	const glm::mat4 modelViewProjection = viewProjection * _model;
+	// The box's corners are the min corner plus any of the three scaled axes
+	const glm::vec4 origin = modelViewProjection * glm::vec4(_min, 1.0f);
+	const glm::vec4 axes[3] = { modelViewProjection[0] * (_max.x - _min.x), modelViewProjection[1] * (_max.y - _min.y),
+		modelViewProjection[2] * (_max.z - _min.z) };
+
+	glm::vec2 low(FLT_MAX), high(-FLT_MAX);
+	for (int corner = 0; corner < 8; corner++) {
+		glm::vec4 clip = origin;
+		for (int axis = 0; axis < 3; axis++)
+			if (corner & (1 << axis))
+				clip += axes[axis];
+		if (clip.z < -clip.w || clip.w <= 0.0f)
+			return rect;
+		glm::vec3 screen = ToScreen(clip);
+		low = glm::min(low, glm::vec2(screen));
+		high = glm::max(high, glm::vec2(screen));
+		rect.nearestDepth = std::min(rect.nearestDepth, screen.z);
+	}
+
+	// Every pixel the rectangle touches, not only those with the center inside
+	rect.x0 = static_cast<int>(std::max(0.0f, std::floor(low.x)));
+	rect.y0 = static_cast<int>(std::max(0.0f, std::floor(low.y)));
+	rect.x1 = static_cast<int>(std::min(static_cast<float>(width - 1), std::ceil(high.x) - 1.0f));
+	rect.y1 = static_cast<int>(std::min(static_cast<float>(height - 1), std::ceil(high.y) - 1.0f));
+	rect.visible = rect.x0 > rect.x1 || rect.y0 > rect.y1;
+	return rect;
+}
+
+// Visible where an occluder pixel is farther than the box's nearest point, or empty
+inline bool OcclusionBuffer::IsBoxVisible(const glm::vec3& _min, const glm::vec3& _max, const glm::mat4& _model) const
+{
+	const ScreenRect rect = ProjectBox(_min, _max, _model);
+	if (rect.visible)
+		return true;
+
+	for (int tileY = rect.y0 / tileSize; tileY <= rect.y1 / tileSize; tileY++)
+		for (int tileX = rect.x0 / tileSize; tileX <= rect.x1 / tileSize; tileX++) {
+			const size_t tile = size_t(tileY) * tilesX + tileX;
+			if (tileMax[tile] <= rect.nearestDepth)
+				continue;
+			if (tileMin[tile] > rect.nearestDepth)
+				return true;
+			if (AnyPixelVisible<simd_lanes::Widest>(rect, std::max(rect.x0, tileX * tileSize), std::min(rect.x1, tileX * tileSize + tileSize - 1),
+				std::max(rect.y0, tileY * tileSize), std::min(rect.y1, tileY * tileSize + tileSize - 1)))
+				return true;
+		}
+	return false;
+}
+
+template<class Lanes>
+inline bool OcclusionBuffer::AnyPixelVisible(const ScreenRect& _rect, int _x0, int _x1, int _y0, int _y1) const
+{
+	using L = Lanes;
+	const typename L::Float nearest = L::Splat(_rect.nearestDepth);
+	const int groupX0 = _x0 / int(L::width) * int(L::width);
+	for (int y = _y0; y <= _y1; y++)
+		for (int x = groupX0; x <= _x1; x += int(L::width)) {
+			// Lanes of pixels farther than the box's nearest point, restricted to [_x0, _x1]
+			int farther = L::SignMask(L::Sub(nearest, L::Load(&testDepth[size_t(y) * width + x])));
+			int first = std::max(_x0 - x, 0), last = std::min(_x1 - x, int(L::width) - 1);
+			if (farther & (((2 << last) - 1) & ~((1 << first) - 1)))
+				return true;
+		}
+	return false;
+}
+
+inline bool OcclusionBuffer::IsBoxVisibleReference(const glm::vec3& _min, const glm::vec3& _max, const glm::mat4& _model) const
+{
+	const ScreenRect rect = ProjectBox(_min, _max, _model);
+	if (rect.visible)
+		return true;
+	for (int y = rect.y0; y <= rect.y1; y++)
+		for (int x = rect.x0; x <= rect.x1; x++)
+			if (testDepth[size_t(y) * width + x] > rect.nearestDepth)
+				return true;
+	return false;
+}
+
+inline void OcclusionBuffer::RasterizeReference(const std::vector<Vertex>& _vertices, const std::vector<unsigned int>& _indices,
+	const glm::mat4& _model, std::vector<float>& _strict, std::vector<float>& _loose, float _margin) const
+{
+	// Counter-clockwise screen triangles only; depth is interpolated with the barycentric weights of the pixel center
+	auto fill = [&](const glm::dvec3 (&_corners)[3]) {
+		const double area = (_corners[1].x - _corners[0].x) * (_corners[2].y - _corners[0].y)
+			- (_corners[2].x - _corners[0].x) * (_corners[1].y - _corners[0].y);
+		if (!(area > 0.0))
+			return;
+		double edgeLength[3];
+		for (int k = 0; k < 3; k++)
+			edgeLength[k] = glm::length(glm::dvec2(_corners[(k + 2) % 3]) - glm::dvec2(_corners[(k + 1) % 3]));
+
+		const double minX = std::min({ _corners[0].x, _corners[1].x, _corners[2].x }), maxX = std::max({ _corners[0].x, _corners[1].x, _corners[2].x });
+		const double minY = std::min({ _corners[0].y, _corners[1].y, _corners[2].y }), maxY = std::max({ _corners[0].y, _corners[1].y, _corners[2].y });
+		const int x0 = static_cast<int>(std::max(0.0, std::floor(minX) - 1.0)), x1 = static_cast<int>(std::min(width - 1.0, std::ceil(maxX)));
+		const int y0 = static_cast<int>(std::max(0.0, std::floor(minY) - 1.0)), y1 = static_cast<int>(std::min(height - 1.0, std::ceil(maxY)));
+		for (int y = y0; y <= y1; y++)
+			for (int x = x0; x <= x1; x++) {
+				const glm::dvec2 center(x + 0.5, y + 0.5);
+				// Twice the area of the center and the edge opposite each corner: that corner's weight times the
+				// whole area, and the center's distance to the edge times the edge's length
+				double distance = DBL_MAX, z = 0.0;
+				for (int k = 0; k < 3; k++) {
+					const glm::dvec3& from = _corners[(k + 1) % 3];
+					const glm::dvec3& to = _corners[(k + 2) % 3];
+					const double opposite = (to.x - from.x) * (center.y - from.y) - (to.y - from.y) * (center.x - from.x);
+					distance = std::min(distance, opposite / edgeLength[k]);
+					z += opposite / area * _corners[k].z;
+				}
+				const size_t pixel = size_t(y) * width + x;
+				if (distance >= _margin)
+					_strict[pixel] = std::min(_strict[pixel], static_cast<float>(z));
+				if (distance >= -_margin)
+					_loose[pixel] = std::min(_loose[pixel], static_cast<float>(z));
+			}
+	};
+
+	const glm::dmat4 modelViewProjection = glm::dmat4(viewProjection) * glm::dmat4(_model);
+	for (size_t i = 0; i + 2 < _indices.size(); i += 3) {
+		glm::dvec4 clip[3];
+		for (int k = 0; k < 3; k++)
+			clip[k] = modelViewProjection * glm::dvec4(glm::dvec3(_vertices[_indices[i + k]].position), 1.0);
+
+		// Sutherland-Hodgman against the near plane (z >= -w), which leaves at most four corners; the far plane
+		// isn't clipped and the sides are the pixel bounds, as in RasterizeTriangles
+		glm::dvec4 polygon[4];
+		int count = 0;
+		for (int k = 0; k < 3; k++) {
+			const glm::dvec4& current = clip[k];
+			const glm::dvec4& next = clip[(k + 1) % 3];
+			const double currentDistance = current.z + current.w, nextDistance = next.z + next.w;
+			if (currentDistance >= 0.0)
+				polygon[count++] = current;
+			if ((currentDistance >= 0.0) != (nextDistance >= 0.0))
+				polygon[count++] = current + (next - current) * (currentDistance / (currentDistance - nextDistance));
+		}
+
+		glm::dvec3 screen[4];
+		for (int k = 0; k < count; k++)
+			screen[k] = glm::dvec3((polygon[k].x / polygon[k].w * 0.5 + 0.5) * width, (polygon[k].y / polygon[k].w * 0.5 + 0.5) * height,
+				polygon[k].z / polygon[k].w);
+		for (int k = 2; k < count; k++) {
+			const glm::dvec3 corners[3] = { screen[0], screen[k - 1], screen[k] };
+			fill(corners);
+		}
+	}
+}
+
+inline size_t OcclusionBuffer::CountReferenceMismatches(const std::vector<float>& _strict, const std::vector<float>& _loose) const
+{
+	size_t mismatches = 0;
+	for (size_t pixel = 0; pixel < depth.size(); pixel++) {
+		const float tolerance = 1e-5f * (1.0f + std::abs(depth[pixel] == FLT_MAX ? 0.0f : depth[pixel]));
+		if (depth[pixel] < _loose[pixel] - tolerance || (depth[pixel] > _strict[pixel] + tolerance))
+			mismatches++;
+	}
+	return mismatches;
+}
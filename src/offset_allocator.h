@@ -0,0 +1,207 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <vector>
+
+// Hands out [offset, offset + size) ranges of a linear space of _capacity units (vertices, indices, bytes).
+// Free ranges are kept by offset, so a freed range merges with its neighbours immediately, and by size,
+// so Allocate is a best-fit lookup. Nothing is ever moved; Compact packs the live ranges and reports
+// where each one went so the owner can copy its data.
+class OffsetAllocator
+{
+public:
+	static constexpr uint32_t invalid = ~0u;
+
+	struct Stats
+	{
+		uint32_t capacity = 0, used = 0;
+		size_t allocations = 0, freeRanges = 0;
+		uint32_t largestFreeRange = 0;
+
+		// 0 when all free space is one range, approaching 1 as it splinters into small pieces
+		float GetFragmentation() const
+		{
+			uint32_t free = capacity - used;
+			return free > 0 ? 1.0f - static_cast<float>(largestFreeRange) / free : 0.0f;
+		}
+	};
+
+	// Where Compact moved a live range
+	struct Relocation
+	{
+		uint32_t from, to, size;
+	};
+
+	explicit OffsetAllocator(uint32_t _capacity = 0) { Reset(_capacity); }
+
+	// Forget every allocation
+	void Reset(uint32_t _capacity)
+	{
+		capacity = _capacity;
+		used = 0;
+		allocated.clear();
+		freeByOffset.clear();
+		freeBySize.clear();
+		if (capacity > 0)
+			InsertFree(0, capacity);
+	}
+
+	// Offset of a new range, or invalid when no free range is large enough. Zero-sized requests take one unit
+	// so every allocation has its own offset.
+	uint32_t Allocate(uint32_t _size)
+	{
+		_size = std::max(_size, 1u);
+		auto best = freeBySize.lower_bound(_size);
+		if (best == freeBySize.end())
+			return invalid;
+
+		uint32_t offset = best->second, rangeSize = best->first;
+		freeBySize.erase(best);
+		freeByOffset.erase(offset);
+		if (rangeSize > _size)
+			InsertFree(offset + _size, rangeSize - _size);
+
+		allocated.emplace(offset, _size);
+		used += _size;
+		return offset;
+	}
+
+	// Return a range from Allocate; it merges with free neighbours on both sides
+	void Free(uint32_t _offset)
+	{
+		auto it = allocated.find(_offset);
+		if (it == allocated.end()) {
+#ifdef _DEBUG
+			std::cout << "ERROR::OFFSET_ALLOCATOR::Free of unknown offset " << _offset << "\n";
+#endif
+			return;
+		}
+		uint32_t offset = _offset, size = it->second;
+		allocated.erase(it);
+		used -= size;
+
+		auto next = freeByOffset.lower_bound(offset);
+		if (next != freeByOffset.end() && next->first == offset + size) {
+			size += next->second;
+			next = EraseFree(next);
+		}
+		if (next != freeByOffset.begin()) {
+			auto previous = std::prev(next);
+			if (previous->first + previous->second == offset) {
+				offset = previous->first;
+				size += previous->second;
+				EraseFree(previous);
+			}
+		}
+		InsertFree(offset, size);
+	}
+
+	// Pack every live range towards offset 0, in offset order, within a space of _capacity units
+	// (at least GetUsed()). Afterwards all free space is a single range at the end.
+	std::vector<Relocation> Compact(uint32_t _capacity)
+	{
+		std::vector<Relocation> relocations;
+		relocations.reserve(allocated.size());
+		std::map<uint32_t, uint32_t> packed;
+		uint32_t cursor = 0;
+		for (const auto& [offset, size] : allocated) {
+			relocations.push_back({ offset, cursor, size });
+			packed.emplace_hint(packed.end(), cursor, size);
+			cursor += size;
+		}
+
+		capacity = std::max(_capacity, cursor);
+		allocated.swap(packed);
+		freeByOffset.clear();
+		freeBySize.clear();
+		if (capacity > cursor)
+			InsertFree(cursor, capacity - cursor);
+		return relocations;
+	}
+
+	uint32_t GetCapacity() const { return capacity; }
+	uint32_t GetUsed() const { return used; }
+	uint32_t GetFree() const { return capacity - used; }
+	uint32_t GetSize(uint32_t _offset) const
+	{
+		auto it = allocated.find(_offset);
+		return it != allocated.end() ? it->second : 0;
+	}
+
+	Stats GetStats() const
+	{
+		Stats stats;
+		stats.capacity = capacity;
+		stats.used = used;
+		stats.allocations = allocated.size();
+		stats.freeRanges = freeByOffset.size();
+		stats.largestFreeRange = freeBySize.empty() ? 0 : std::prev(freeBySize.end())->first;
+		return stats;
+	}
+
+	// Live and free ranges tile [0, capacity) exactly, no two free ranges touch, and both free indices agree
+	bool Validate() const
+	{
+		if (freeByOffset.size() != freeBySize.size())
+			return false;
+
+		uint32_t cursor = 0, usedSum = 0;
+		auto live = allocated.begin();
+		auto free = freeByOffset.begin();
+		bool previousFree = false;
+		while (live != allocated.end() || free != freeByOffset.end()) {
+			bool takeFree = live == allocated.end() || (free != freeByOffset.end() && free->first < live->first);
+			uint32_t offset = takeFree ? free->first : live->first;
+			uint32_t size = takeFree ? free->second : live->second;
+			if (offset != cursor || size == 0 || (takeFree && previousFree))
+				return false;
+			if (takeFree) {
+				auto [first, last] = freeBySize.equal_range(size);
+				if (std::none_of(first, last, [&](const auto& _entry) { return _entry.second == offset; }))
+					return false;
+				++free;
+			}
+			else {
+				usedSum += size;
+				++live;
+			}
+			previousFree = takeFree;
+			cursor = offset + size;
+		}
+		return cursor == capacity && usedSum == used;
+	}
+
+private:
+	void InsertFree(uint32_t _offset, uint32_t _size)
+	{
+		freeByOffset.emplace(_offset, _size);
+		freeBySize.emplace(_size, _offset);
+	}
+
+	std::map<uint32_t, uint32_t>::iterator EraseFree(std::map<uint32_t, uint32_t>::iterator _it)
+	{
+		auto [first, last] = freeBySize.equal_range(_it->second);
+		for (auto entry = first; entry != last; ++entry)
+			if (entry->second == _it->first) {
+				freeBySize.erase(entry);
+				break;
+			}
+		return freeByOffset.erase(_it);
+	}
+
+	uint32_t capacity = 0, used = 0;
+	std::map<uint32_t, uint32_t> allocated;         // offset -> size
+	std::map<uint32_t, uint32_t> freeByOffset;      // offset -> size
+	std::multimap<uint32_t, uint32_t> freeBySize;   // size -> offset
+};
+
+inline std::ostream& operator<<(std::ostream& _stream, const OffsetAllocator::Stats& _stats)
+{
+	return _stream << _stats.used << "/" << _stats.capacity << " used in " << _stats.allocations << " ranges, "
+		<< _stats.freeRanges << " free ranges (largest " << _stats.largestFreeRange << ", fragmentation "
+		<< _stats.GetFragmentation() << ")";
+}
@@ -0,0 +1,344 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <GL/glew.h>
+
+#include "mesh.h"
+#include "model.h"
+#include "object_buffer.h"
+#include "shader.h"
+
+// Sort 64-bit keys ascending together with a payload, LSD radix with 8-bit digits.
+// Digits every key shares are skipped, so keys that only use a few bits cost a few passes.
+inline void RadixSort(std::vector<uint64_t>& _keys, std::vector<uint32_t>& _values)
+{
+	const size_t count = _keys.size();
+	std::vector<uint64_t> keyScratch(count);
+	std::vector<uint32_t> valueScratch(count);
+
+	for (int shift = 0; shift < 64; shift += 8) {
+		size_t histogram[256] = {};
+		for (uint64_t key : _keys)
+			histogram[(key >> shift) & 0xFF]++;
+		if (count == 0 || histogram[(_keys[0] >> shift) & 0xFF] == count)
+			continue;
+
+		size_t offset = 0;
+		for (size_t& bucket : histogram) {
+			size_t size = bucket;
+			bucket = offset;
+			offset += size;
+		}
+		for (size_t i = 0; i < count; i++) {
+			size_t slot = histogram[(_keys[i] >> shift) & 0xFF]++;
+			keyScratch[slot] = _keys[i];
+			valueScratch[slot] = _values[i];
+		}
+		_keys.swap(keyScratch);
+		_values.swap(valueScratch);
+	}
+}
+
+// Per-frame draw submission. Draws are recorded with a 64-bit sort key, radix-sorted and executed
+// so that consecutive draws share as much program/texture/VAO state as possible; Execute only
+// issues the binds that actually change something and counts the ones it avoided.
+// With an ObjectBuffer, the model matrices go into it instead of the model uniform, and each run of
+// sorted draws that differ only in their matrix becomes one instanced draw.
+//
+// Key layout, most significant first:
+//   opaque passes:        pass:4 | program:12 | material:16 | vao:12 | depth:20 (front to back)
+//   back-to-front passes: pass:4 | depth:20 (far first) | program:12 | material:16 | vao:12
+class RenderQueue
+{
+public:
+	struct Stats
+	{
+		size_t draws = 0;
+		size_t drawCalls = 0; // after merging runs into instanced draws
+		size_t programBinds = 0, programBindsAvoided = 0;
+		size_t textureBinds = 0, textureBindsAvoided = 0;
+		size_t vaoBinds = 0, vaoBindsAvoided = 0;
+	};
+
+	static constexpr unsigned int maxPasses = 16;
+	static constexpr unsigned int maxTextures = 8; // tracked per draw
+
+	// _setup runs when execution enters the pass (stencil/depth/blend state and the like).
+	// Back-to-front passes sort by distance before state, for blending.
+	void SetPass(unsigned int _pass, std::function<void()> _setup, bool _backToFront = false)
+	{
+		passes[_pass].setup = std::move(_setup);
+		passes[_pass].backToFront = _backToFront;
+	}
+
+	// Depth for the sort keys is the view-space distance of each draw's origin
+	void SetViewMatrix(const glm::mat4& _view) { view = _view; }
+
+	// Every submitted shader must then read its model matrix from the Objects block (see ObjectBuffer)
+	void SetObjectBuffer(ObjectBuffer* _objects) { objects = _objects; }
+
+	// glDrawArrays with _textures bound to units 0, 1, ...
+	void SubmitArrays(unsigned int _pass, const Shader& _shader, Shader::Uniform _modelUniform, const glm::mat4& _model,
+		unsigned int _vao, std::initializer_list<unsigned int> _textures, GLenum _mode, GLint _first, GLsizei _count)
+	{
+		Command command = MakeCommand(_pass, _shader, _modelUniform, _model, _vao);
+		for (unsigned int texture : _textures)
+			if (command.textureCount < maxTextures)
+				command.textures[command.textureCount++] = texture;
+		command.mode = _mode;
+		command.first = _first;
+		command.count = _count;
+		Push(command);
+	}
+
+	// The mesh's own textures and samplers, then its index clusters
+	void SubmitMesh(unsigned int _pass, const Shader& _shader, Shader::Uniform _modelUniform, const glm::mat4& _model, const Mesh& _mesh)
+	{
+		Command command = MakeCommand(_pass, _shader, _modelUniform, _model, _mesh.GetVAO());
+		command.mesh = &_mesh;
+		for (const Texture& texture : _mesh.textures)
+			if (command.textureCount < maxTextures)
+				command.textures[command.textureCount++] = texture.id;
+		Push(command);
+	}
+
+	void SubmitModel(unsigned int _pass, const Shader& _shader, Shader::Uniform _modelUniform, const glm::mat4& _model, const Model& _modelToDraw)
+	{
+		for (const Mesh& mesh : _modelToDraw.meshes)
+			SubmitMesh(_pass, _shader, _modelUniform, _model, mesh);
+	}
+
+	// Sort and issue every submitted draw, then start a new frame
+	void Execute();
+
+	const Stats& GetStats() const { return stats; } // Of the last Execute
+	size_t GetSubmittedCount() const { return commands.size(); }
+
+private:
+	struct Command
+	{
+		const Shader* shader = nullptr;
+		const Mesh* mesh = nullptr; // null for SubmitArrays
+		Shader::Uniform modelUniform;
+		glm::mat4 model;
+		unsigned int pass = 0;
+		unsigned int vao = 0;
+		unsigned int textures[maxTextures] = {};
+		unsigned int textureCount = 0;
+		GLenum mode = GL_TRIANGLES;
+		GLint first = 0;
+		GLsizei count = 0;
+	};
+
+	struct Pass
+	{
+		std::function<void()> setup;
+		bool backToFront = false;
+	};
+
+	Command MakeCommand(unsigned int _pass, const Shader& _shader, Shader::Uniform _modelUniform, const glm::mat4& _model, unsigned int _vao) const
+	{
+		Command command;
+		command.shader = &_shader;
+		command.modelUniform = _modelUniform;
+		command.model = _model;
+		command.pass = _pass % maxPasses;
+		command.vao = _vao;
+		return command;
+	}
+
+	void Push(const Command& _command);
+	uint64_t MakeKey(const Command& _command);
+
+	// Same pass, state and geometry: only the model matrix differs
+	static bool CanMerge(const Command& _a, const Command& _b)
+	{
+		return _a.pass == _b.pass && _a.shader == _b.shader && _a.mesh == _b.mesh && _a.vao == _b.vao
+			&& _a.textureCount == _b.textureCount && std::equal(_a.textures, _a.textures + _a.textureCount, _b.textures)
+			&& _a.mode == _b.mode && _a.first == _b.first && _a.count == _b.count;
+	}
+
+	// Dense ids for the key fields, stable across frames
+	template<class Map, class Key>
+	static uint64_t DenseId(Map& _ids, const Key& _key)
+	{
+		auto it = _ids.find(_key);
+		if (it == _ids.end())
+			it = _ids.emplace(_key, static_cast<uint64_t>(_ids.size())).first;
+		return it->second;
+	}
+
+	Pass passes[maxPasses];
+	glm::mat4 view = glm::mat4(1.0f);
+	std::vector<Command> commands;
+	std::vector<uint64_t> keys;
+	std::vector<uint32_t> order;
+	std::vector<std::pair<size_t, size_t>> runs; // first position in order, length
+	std::vector<ObjectBuffer::Batch> batches;    // per run
+	std::vector<ObjectData> runObjects;
+	ObjectBuffer* objects = nullptr;
+	std::unordered_map<unsigned int, uint64_t> programIds, vaoIds;
+	std::map<std::vector<unsigned int>, uint64_t> materialIds;
+	Stats stats;
+};
+
+inline void RenderQueue::Push(const Command& _command)
+{
+	keys.push_back(MakeKey(_command));
+	order.push_back(static_cast<uint32_t>(commands.size()));
+	commands.push_back(_command);
+}
+
+inline uint64_t RenderQueue::MakeKey(const Command& _command)
+{
+	uint64_t program = DenseId(programIds, _command.shader->GetID()) & 0xFFF;
+	uint64_t material = DenseId(materialIds, std::vector<unsigned int>(_command.textures, _command.textures + _command.textureCount)) & 0xFFFF;
+	uint64_t vao = DenseId(vaoIds, _command.vao) & 0xFFF;
+
+	// The bits of a non-negative float sort like the float; keep the top 20
+	float distance = glm::max(-(view * _command.model[3]).z, 0.0f);
+	uint32_t distanceBits;
+	std::memcpy(&distanceBits, &distance, sizeof(distanceBits));
+	uint64_t depth = distanceBits >> 12;
+
+	uint64_t pass = _command.pass;
+	if (passes[_command.pass].backToFront)
+		return pass << 60 | (0xFFFFF - depth) << 40 | program << 28 | material << 12 | vao;
+	return pass << 60 | program << 48 | material << 32 | vao << 20 | depth;
+}
+
+inline void RenderQueue::Execute()
+{
+	RadixSort(keys, order);
+
+	stats = Stats();
+	stats.draws = commands.size();
+
+	// Without an object buffer every draw is its own run
+	runs.clear();
+	for (size_t i = 0; i < order.size(); i++) {
+		if (objects && !runs.empty() && CanMerge(commands[order[runs.back().first]], commands[order[i]]))
+			runs.back().second++;
+		else
+			runs.emplace_back(i, 1);
+	}
+	if (objects) {
+		objects->Begin();
+		batches.clear();
+		for (const auto& [first, length] : runs) {
+			runObjects.clear();
+			for (size_t i = first; i < first + length; i++)
+				runObjects.push_back({ commands[order[i]].model });
+			batches.push_back(objects->Push(runObjects));
+		}
+		objects->Upload();
+	}
+
+	const Shader* boundShader = nullptr;
+	unsigned int boundVao = ~0u;
+	unsigned int boundTextures[maxTextures];
+	std::fill(std::begin(boundTextures), std::end(boundTextures), ~0u);
+	unsigned int activeUnit = ~0u;
+	unsigned int currentPass = ~0u;
+
+	for (size_t run = 0; run < runs.size(); run++) {
+		const Command& command = commands[order[runs[run].first]];
+		if (command.pass != currentPass) {
+			currentPass = command.pass;
+			if (passes[currentPass].setup)
+				passes[currentPass].setup();
+		}
+
+		bool programChanged = command.shader != boundShader;
+		if (programChanged) {
+			command.shader->Bind();
+			boundShader = command.shader;
+			stats.programBinds++;
+		}
+		else
+			stats.programBindsAvoided++;
+
+		if (command.vao != boundVao) {
+			GLState::Get().BindVertexArray(command.vao);
+			boundVao = command.vao;
+			stats.vaoBinds++;
+		}
+		else
+			stats.vaoBindsAvoided++;
+
+		bool texturesChanged = false;
+		for (unsigned int unit = 0; unit < command.textureCount; unit++)
+			texturesChanged |= boundTextures[unit] != command.textures[unit];
+
+		if (command.mesh && (texturesChanged || programChanged)) {
+			// Samplers are program state, so a new program needs them set even for the same textures
+			command.mesh->BindTextures(*command.shader);
+			activeUnit = static_cast<unsigned int>(command.mesh->textures.size()) - 1;
+			stats.textureBinds += command.mesh->textures.size();
+			for (unsigned int unit = 0; unit < command.textureCount; unit++)
+				boundTextures[unit] = command.textures[unit];
+		}
+		else if (command.mesh)
+			stats.textureBindsAvoided += command.mesh->textures.size();
+		else {
+			for (unsigned int unit = 0; unit < command.textureCount; unit++) {
+				if (boundTextures[unit] == command.textures[unit]) {
+					stats.textureBindsAvoided++;
+					continue;
+				}
+				if (activeUnit != unit) {
+					GLState::Get().ActiveTexture(GL_TEXTURE0 + unit);
+					activeUnit = unit;
+				}
+				GLState::Get().BindTexture(GL_TEXTURE_2D, command.textures[unit]);
+				boundTextures[unit] = command.textures[unit];
+				stats.textureBinds++;
+			}
+		}
+
+		if (objects) {
+			objects->Draw(batches[run], [&](GLsizei _instances) {
+				if (command.mesh)
+					command.mesh->DrawBound(_instances);
+				else
+					glDrawArraysInstanced(command.mode, command.first, command.count, _instances);
+				stats.drawCalls++;
+			});
+			continue;
+		}
+
+		if (command.modelUniform.IsValid())
+			command.shader->SetMat4(command.modelUniform, command.model);
+
+		if (command.mesh)
+			command.mesh->DrawBound(1);
+		else
+			glDrawArrays(command.mode, command.first, command.count);
+		stats.drawCalls++;
+	}
+
+	if (!commands.empty())
+		GLState::Get().EndDraw();
+	if (activeUnit != 0 && activeUnit != ~0u)
+		GLState::Get().ActiveTexture(GL_TEXTURE0);
+
+	commands.clear();
+	keys.clear();
+	order.clear();
+}
+
+inline std::ostream& operator<<(std::ostream& _stream, const RenderQueue::Stats& _stats)
+{
+	return _stream << _stats.draws << " draws in " << _stats.drawCalls << " calls, program binds " << _stats.programBinds << " (avoided " << _stats.programBindsAvoided
+		<< "), texture binds " << _stats.textureBinds << " (avoided " << _stats.textureBindsAvoided << "), VAO binds "
+		<< _stats.vaoBinds << " (avoided " << _stats.vaoBindsAvoided << ")";
+}
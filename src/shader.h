@@ -1,6 +1,9 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -8,6 +11,8 @@
 #include <glm/glm.hpp>
 #include <GL/glew.h>
 
+#include "gl_state.h"
+
 class Shader
 {
 public:
@@ -17,6 +22,7 @@ public:
 	{
 		const auto& [vertexSource, fragmentSource, geometrySource] = ParseShader(vertexShaderPath, fragmentShaderPath, geometryShaderPath);
 		m_rendererID = CreateShader(vertexSource, fragmentSource, geometrySource);
+		ReflectUniforms();
 
 #ifdef _DEBUG
 		std::cout << "successfully create: " << "\n" << vertexShaderPath << "\n" <<
@@ -25,19 +31,49 @@ public:
 
 	}
 
+	// Vertex-only program whose outputs _feedbackVaryings are captured, interleaved, by transform feedback;
+	// draw with GL_RASTERIZER_DISCARD enabled
+	Shader(const std::string& vertexShaderPath, const std::vector<std::string>& _feedbackVaryings)
+	{
+		std::ifstream vShaderFile(vertexShaderPath);
+#ifdef _DEBUG
+		if (!vShaderFile.is_open())
+			std::cout << "failed to read vertex shader file: " << vertexShaderPath;
+#endif
+		std::stringstream vShaderStream;
+		vShaderStream << vShaderFile.rdbuf();
+
+		m_rendererID = glCreateProgram();
+		unsigned int vs = CompileShader(GL_VERTEX_SHADER, vShaderStream.str());
+		glAttachShader(m_rendererID, vs);
+		std::vector<const char*> varyings;
+		for (const std::string& varying : _feedbackVaryings)
+			varyings.push_back(varying.c_str());
+		glTransformFeedbackVaryings(m_rendererID, static_cast<GLsizei>(varyings.size()), varyings.data(), GL_INTERLEAVED_ATTRIBS);
+		glLinkProgram(m_rendererID);
+		glDeleteShader(vs);
+		ReflectUniforms();
+
+#ifdef _DEBUG
+		int linked;
+		glGetProgramiv(m_rendererID, GL_LINK_STATUS, &linked);
+		std::cout << (linked ? "successfully create: " : "failed to link: ") << "\n" << vertexShaderPath << " (transform feedback)\n";
+#endif
+	}
+
 	~Shader()
 	{
-		glDeleteProgram(m_rendererID);
+		GLState::Get().DeleteProgram(m_rendererID);
 	}
 
 	void Bind() const
 	{
-		glUseProgram(m_rendererID);
+		GLState::Get().UseProgram(m_rendererID);
 	}
 
 	void Unbind() const
 	{
-		glUseProgram(0);
+		GLState::Get().UseProgram(0);
 	}
 
 	unsigned int GetID() const
@@ -45,71 +81,123 @@ public:
 		return m_rendererID;
 	}
 
-	void SetVec3(const std::string& _name, const glm::vec3& value)
+	// Location of an active uniform, resolved once so hot loops set it without a name lookup
+	struct Uniform
+	{
+		GLint location = -1;
+		bool IsValid() const { return location != -1; }
+	};
+
+	// Driver calls issued through Shader, for per-frame reports. namedSets counts setters called by
+	// name, each of which used to cost a glGetUniformLocation before the location table.
+	struct CallCounters
+	{
+		size_t locationQueries = 0;
+		size_t uniformUploads = 0;
+		size_t namedSets = 0;
+	};
+
+	static CallCounters& GetCallCounters()
 	{
-		GLint location = glGetUniformLocation(m_rendererID, _name.c_str());
+		static CallCounters counters;
+		return counters;
+	}
+
+	static void ResetCallCounters()
+	{
+		GetCallCounters() = CallCounters();
+	}
+
+	// Resolved from the table built at link time, no driver query
+	Uniform GetUniform(const std::string& _name) const
+	{
+		auto it = uniformLocations.find(_name);
+		if (it == uniformLocations.end()) {
 #ifdef _DEBUG
-		if (location == -1) {
 			std::cerr << "Warning: Uniform '" << _name << "' not found or shader program not linked.\n";
-		}
 #endif
-		glUniform3fv(location, 1, &value[0]);
+			return Uniform();
+		}
+		return Uniform{ it->second };
+	}
+
+	void SetVec3(Uniform _uniform, const glm::vec3& _value) const
+	{
+		GetCallCounters().uniformUploads++;
+		glUniform3fv(_uniform.location, 1, &_value[0]);
+	}
+
+	void SetVec4(Uniform _uniform, const glm::vec4& _value) const
+	{
+		GetCallCounters().uniformUploads++;
+		glUniform4fv(_uniform.location, 1, &_value[0]);
+	}
+
+	void SetVec2(Uniform _uniform, const glm::vec2& _value) const
+	{
+		GetCallCounters().uniformUploads++;
+		glUniform2fv(_uniform.location, 1, &_value[0]);
+	}
+
+	void SetMat4(Uniform _uniform, const glm::mat4& _mat) const
+	{
+		GetCallCounters().uniformUploads++;
+		glUniformMatrix4fv(_uniform.location, 1, GL_FALSE, &_mat[0][0]);
+	}
+
+	void SetFloat(Uniform _uniform, float _value) const
+	{
+		GetCallCounters().uniformUploads++;
+		glUniform1f(_uniform.location, _value);
+	}
+
+	void SetInt(Uniform _uniform, int _value) const
+	{
+		GetCallCounters().uniformUploads++;
+		glUniform1i(_uniform.location, _value);
+	}
+
+	// By-name setters: a hash lookup in the location table, then the same upload
+	void SetVec3(const std::string& _name, const glm::vec3& value)
+	{
+		GetCallCounters().namedSets++;
+		SetVec3(GetUniform(_name), value);
 	}
 
 	void SetVec3(const std::string& _name, float _x, float _y, float _z)
 	{
-		glm::vec3 value(_x, _y, _z);
-		GLint location = glGetUniformLocation(m_rendererID, _name.c_str());
-#ifdef _DEBUG
-		if (location == -1) {
-			std::cerr << "Warning: Uniform '" << _name << "' not found or shader program not linked.\n";
-		}
-#endif
-		glUniform3fv(location, 1, &value[0]);
+		GetCallCounters().namedSets++;
+		SetVec3(GetUniform(_name), glm::vec3(_x, _y, _z));
+	}
+
+	void SetVec4(const std::string& _name, const glm::vec4& value)
+	{
+		GetCallCounters().namedSets++;
+		SetVec4(GetUniform(_name), value);
 	}
 
 	void SetVec2(const std::string& _name, const glm::vec2& value)
 	{
-		GLint location = glGetUniformLocation(m_rendererID, _name.c_str());
-#ifdef _DEBUG
-		if (location == -1) {
-			std::cerr << "Warning: Uniform '" << _name << "' not found or shader program not linked.\n";
-		}
-#endif
-		glUniform2fv(location, 1, &value[0]);
+		GetCallCounters().namedSets++;
+		SetVec2(GetUniform(_name), value);
 	}
 
 	void SetMat4(const std::string& _name, const glm::mat4& _mat)
 	{
-		GLint location = glGetUniformLocation(m_rendererID, _name.c_str());
-#ifdef _DEBUG
-		if (location == -1) {
-			std::cerr << "Warning: Uniform '" << _name << "' not found or shader program not linked.\n";
-		}
-#endif
-		glUniformMatrix4fv(location, 1, GL_FALSE, &_mat[0][0]);
+		GetCallCounters().namedSets++;
+		SetMat4(GetUniform(_name), _mat);
 	}
 
 	void SetFloat(const std::string& _name, float _value)
 	{
-		GLint location = glGetUniformLocation(m_rendererID, _name.c_str());
-#ifdef _DEBUG
-		if (location == -1) {
-			std::cerr << "Warning: Uniform '" << _name << "' not found or shader program not linked.\n";
-		}
-#endif
-		glUniform1f(location, _value);
+		GetCallCounters().namedSets++;
+		SetFloat(GetUniform(_name), _value);
 	}
 
 	void SetInt(const std::string& _name, int _value) const
 	{
-		GLint location = glGetUniformLocation(m_rendererID, _name.c_str());
-#ifdef _DEBUG
-		if (location == -1) {
-			std::cerr << "Warning: Uniform '" << _name << "' not found or shader program not linked.\n";
-		}
-#endif
-		glUniform1i(location, _value);
+		GetCallCounters().namedSets++;
+		SetInt(GetUniform(_name), _value);
 	}
 
 	void BindUniformBlock(const std::string& uniformBlockName, unsigned int bindingPoint)
@@ -211,6 +299,45 @@ private:
 		return program;
 	}
 
+	// Every active uniform outside a block goes into the location table. Arrays are reachable as
+	// "name", "name[0]" and each "name[i]"
+	void ReflectUniforms()
+	{
+		GLint count = 0, maxLength = 0;
+		glGetProgramiv(m_rendererID, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(m_rendererID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+		std::vector<char> buffer(std::max(maxLength, 1));
+
+		for (GLint i = 0; i < count; i++) {
+			GLsizei length = 0;
+			GLint size = 0;
+			GLenum type = 0;
+			glGetActiveUniform(m_rendererID, static_cast<GLuint>(i), static_cast<GLsizei>(buffer.size()), &length, &size, &type, buffer.data());
+			std::string name(buffer.data(), length);
+
+			GLint location = QueryLocation(name);
+			if (location == -1)
+				continue; // Lives in a uniform block
+			uniformLocations[name] = location;
+
+			if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+				std::string base = name.substr(0, name.size() - 3);
+				uniformLocations[base] = location;
+				for (GLint element = 1; element < size; element++) {
+					std::string elementName = base + "[" + std::to_string(element) + "]";
+					uniformLocations[elementName] = QueryLocation(elementName);
+				}
+			}
+		}
+	}
+
+	GLint QueryLocation(const std::string& _name) const
+	{
+		GetCallCounters().locationQueries++;
+		return glGetUniformLocation(m_rendererID, _name.c_str());
+	}
+
 private:
 	unsigned int m_rendererID;
+	std::unordered_map<std::string, GLint> uniformLocations;
 };
\ No newline at end of file
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include <glm/glm.hpp>
+
+// Register abstractions for the per-instance kernels. Every struct exposes the same static functions
+// over a register of `width` floats, so a kernel is written once as a template and instantiated for
+// the widest set glm's GLM_ARCH reports (GLM_FORCE_INTRINSICS enables the detection) plus Scalar
+// for the remainder.
+namespace simd_lanes
+{
+	struct Scalar
+	{
+		using Float = float;
+		using Int = int32_t;
+		static constexpr size_t width = 1;
+
+		static Float Load(const float* _p) { return *_p; }
+		static void Store(float* _p, Float _v) { *_p = _v; }
+		static Float Splat(float _v) { return _v; }
+		static Float Add(Float _a, Float _b) { return _a + _b; }
+		static Float Sub(Float _a, Float _b) { return _a - _b; }
+		static Float Mul(Float _a, Float _b) { return _a * _b; }
+		static Float Div(Float _a, Float _b) { return _a / _b; }
+		static Float Sqrt(Float _v) { return std::sqrt(_v); }
+		static Float Min(Float _a, Float _b) { return _a < _b ? _a : _b; }
+		static Float Max(Float _a, Float _b) { return _a > _b ? _a : _b; }
+		// Bit i set when lane i is negative
+		static int SignMask(Float _v) { return std::signbit(_v) ? 1 : 0; }
+		static Int RoundToInt(Float _v) { return static_cast<Int>(std::lrint(_v)); }
+		static Float ToFloat(Int _v) { return static_cast<Float>(_v); }
+		static Int AddInt(Int _a, int32_t _b) { return _a + _b; }
+		// (_bits & _bit) != 0 ? _ifSet : _ifClear
+		static Float Select(Int _bits, int32_t _bit, Float _ifSet, Float _ifClear) { return (_bits & _bit) ? _ifSet : _ifClear; }
+		// _sign < 0 ? _ifNegative : _ifPositive, by the sign bit
+		static Float SelectSign(Float _sign, Float _ifNegative, Float _ifPositive) { return std::signbit(_sign) ? _ifNegative : _ifPositive; }
+		// Both rounded to int; the low 16 bits of _low and of _high as one 32-bit lane, _low first in memory
+		static Float PackInt16x2(Float _low, Float _high)
+		{
+			uint32_t bits = (static_cast<uint32_t>(RoundToInt(_low)) & 0xffffu) | static_cast<uint32_t>(RoundToInt(_high)) << 16;
+			Float packed;
+			std::memcpy(&packed, &bits, sizeof(packed));
+			return packed;
+		}
+		// Lane i of a, b, c, d goes to _destination + i * _stride as one vec4
+		static void StoreTransposed(float* _destination, size_t, Float _a, Float _b, Float _c, Float _d)
+		{
+			_destination[0] = _a;
+			_destination[1] = _b;
+			_destination[2] = _c;
+			_destination[3] = _d;
+		}
+	};
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+	struct Sse
+	{
+		using Float = __m128;
+		using Int = __m128i;
+		static constexpr size_t width = 4;
+
+		static Float Load(const float* _p) { return _mm_loadu_ps(_p); }
+		static void Store(float* _p, Float _v) { _mm_storeu_ps(_p, _v); }
+		static Float Splat(float _v) { return _mm_set1_ps(_v); }
+		static Float Add(Float _a, Float _b) { return _mm_add_ps(_a, _b); }
+		static Float Sub(Float _a, Float _b) { return _mm_sub_ps(_a, _b); }
+		static Float Mul(Float _a, Float _b) { return _mm_mul_ps(_a, _b); }
+		static Float Div(Float _a, Float _b) { return _mm_div_ps(_a, _b); }
+		static Float Sqrt(Float _v) { return _mm_sqrt_ps(_v); }
+		static Float Min(Float _a, Float _b) { return _mm_min_ps(_a, _b); }
+		static Float Max(Float _a, Float _b) { return _mm_max_ps(_a, _b); }
+		static int SignMask(Float _v) { return _mm_movemask_ps(_v); }
+		static Int RoundToInt(Float _v) { return _mm_cvtps_epi32(_v); }
+		static Float ToFloat(Int _v) { return _mm_cvtepi32_ps(_v); }
+		static Int AddInt(Int _a, int32_t _b) { return _mm_add_epi32(_a, _mm_set1_epi32(_b)); }
+		static Float Select(Int _bits, int32_t _bit, Float _ifSet, Float _ifClear)
+		{
+			Float mask = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_bits, _mm_set1_epi32(_bit)), _mm_set1_epi32(_bit)));
+			return _mm_or_ps(_mm_and_ps(mask, _ifSet), _mm_andnot_ps(mask, _ifClear));
+		}
+		static Float SelectSign(Float _sign, Float _ifNegative, Float _ifPositive)
+		{
+			Float mask = _mm_castsi128_ps(_mm_srai_epi32(_mm_castps_si128(_sign), 31));
+			return _mm_or_ps(_mm_and_ps(mask, _ifNegative), _mm_andnot_ps(mask, _ifPositive));
+		}
+		static Float PackInt16x2(Float _low, Float _high)
+		{
+			Int low = _mm_and_si128(RoundToInt(_low), _mm_set1_epi32(0xffff));
+			return _mm_castsi128_ps(_mm_or_si128(low, _mm_slli_epi32(RoundToInt(_high), 16)));
+		}
+		static void StoreTransposed(float* _destination, size_t _stride, Float _a, Float _b, Float _c, Float _d)
+		{
+			_MM_TRANSPOSE4_PS(_a, _b, _c, _d);
+			_mm_storeu_ps(_destination, _a);
+			_mm_storeu_ps(_destination + _stride, _b);
+			_mm_storeu_ps(_destination + 2 * _stride, _c);
+			_mm_storeu_ps(_destination + 3 * _stride, _d);
+		}
+	};
+#endif
+
+#if GLM_ARCH & GLM_ARCH_AVX2_BIT
+	struct Avx
+	{
+		using Float = __m256;
+		using Int = __m256i;
+		static constexpr size_t width = 8;
+
+		static Float Load(const float* _p) { return _mm256_loadu_ps(_p); }
+		static void Store(float* _p, Float _v) { _mm256_storeu_ps(_p, _v); }
+		static Float Splat(float _v) { return _mm256_set1_ps(_v); }
+		static Float Add(Float _a, Float _b) { return _mm256_add_ps(_a, _b); }
+		static Float Sub(Float _a, Float _b) { return _mm256_sub_ps(_a, _b); }
+		static Float Mul(Float _a, Float _b) { return _mm256_mul_ps(_a, _b); }
+		static Float Div(Float _a, Float _b) { return _mm256_div_ps(_a, _b); }
+		static Float Sqrt(Float _v) { return _mm256_sqrt_ps(_v); }
+		static Float Min(Float _a, Float _b) { return _mm256_min_ps(_a, _b); }
+		static Float Max(Float _a, Float _b) { return _mm256_max_ps(_a, _b); }
+		static int SignMask(Float _v) { return _mm256_movemask_ps(_v); }
+		static Int RoundToInt(Float _v) { return _mm256_cvtps_epi32(_v); }
+		static Float ToFloat(Int _v) { return _mm256_cvtepi32_ps(_v); }
+		static Int AddInt(Int _a, int32_t _b) { return _mm256_add_epi32(_a, _mm256_set1_epi32(_b)); }
+		static Float Select(Int _bits, int32_t _bit, Float _ifSet, Float _ifClear)
+		{
+			Float mask = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_bits, _mm256_set1_epi32(_bit)), _mm256_set1_epi32(_bit)));
+			return _mm256_blendv_ps(_ifClear, _ifSet, mask);
+		}
+		static Float SelectSign(Float _sign, Float _ifNegative, Float _ifPositive) { return _mm256_blendv_ps(_ifPositive, _ifNegative, _sign); }
+		static Float PackInt16x2(Float _low, Float _high)
+		{
+			Int low = _mm256_and_si256(RoundToInt(_low), _mm256_set1_epi32(0xffff));
+			return _mm256_castsi256_ps(_mm256_or_si256(low, _mm256_slli_epi32(RoundToInt(_high), 16)));
+		}
+		static void StoreTransposed(float* _destination, size_t _stride, Float _a, Float _b, Float _c, Float _d)
+		{
+			// 4x4 transposes within each 128-bit half: lanes 0-3 in the low halves, 4-7 in the high ones
+			Float ab0 = _mm256_unpacklo_ps(_a, _b), ab1 = _mm256_unpackhi_ps(_a, _b);
+			Float cd0 = _mm256_unpacklo_ps(_c, _d), cd1 = _mm256_unpackhi_ps(_c, _d);
+			Float rows[4] = {
+				_mm256_shuffle_ps(ab0, cd0, _MM_SHUFFLE(1, 0, 1, 0)),
+				_mm256_shuffle_ps(ab0, cd0, _MM_SHUFFLE(3, 2, 3, 2)),
+				_mm256_shuffle_ps(ab1, cd1, _MM_SHUFFLE(1, 0, 1, 0)),
+				_mm256_shuffle_ps(ab1, cd1, _MM_SHUFFLE(3, 2, 3, 2))
+			};
+			for (size_t i = 0; i < 4; i++) {
+				_mm_storeu_ps(_destination + i * _stride, _mm256_castps256_ps128(rows[i]));
+				_mm_storeu_ps(_destination + (i + 4) * _stride, _mm256_extractf128_ps(rows[i], 1));
+			}
+		}
+	};
+	using Widest = Avx;
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+	using Widest = Sse;
+#else
+	using Widest = Scalar;
+#endif
+
+	// sin and cos of every lane: reduction to [-pi/4, pi/4] by multiples of pi/2, then the
+	// single-precision minimax polynomials from Cephes (error around 1 ulp for moderate angles)
+	template<class Lanes>
+	inline void SinCos(typename Lanes::Float _x, typename Lanes::Float& _sin, typename Lanes::Float& _cos)
+	{
+		using L = Lanes;
+		typename L::Int quadrant = L::RoundToInt(L::Mul(_x, L::Splat(0.636619772f)));
+		typename L::Float j = L::ToFloat(quadrant);
+		// pi/2 split in three parts so the reduction stays exact for angles of a few thousand radians
+		typename L::Float r = L::Sub(_x, L::Mul(j, L::Splat(1.5703125f)));
+		r = L::Sub(r, L::Mul(j, L::Splat(4.837512969970703125e-4f)));
+		r = L::Sub(r, L::Mul(j, L::Splat(7.54978995489188216e-8f)));
+		typename L::Float r2 = L::Mul(r, r);
+
+		typename L::Float s = L::Add(L::Mul(r2, L::Splat(-1.9515295891e-4f)), L::Splat(8.3321608736e-3f));
+		s = L::Add(L::Mul(s, r2), L::Splat(-1.6666654611e-1f));
+		s = L::Add(L::Mul(L::Mul(s, r2), r), r);
+
+		typename L::Float c = L::Add(L::Mul(r2, L::Splat(2.443315711809948e-5f)), L::Splat(-1.388731625493765e-3f));
+		c = L::Add(L::Mul(c, r2), L::Splat(4.166664568298827e-2f));
+		c = L::Add(L::Mul(L::Mul(c, r2), r2), L::Sub(L::Splat(1.0f), L::Mul(r2, L::Splat(0.5f))));
+
+		// Odd quadrants swap sin and cos; the sign follows the quadrant
+		typename L::Float zero = L::Splat(0.0f);
+		typename L::Float sinBase = L::Select(quadrant, 1, c, s);
+		typename L::Float cosBase = L::Select(quadrant, 1, s, c);
+		_sin = L::Select(quadrant, 2, L::Sub(zero, sinBase), sinBase);
+		_cos = L::Select(L::AddInt(quadrant, 1), 2, L::Sub(zero, cosBase), cosBase);
+	}
+}
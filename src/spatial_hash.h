@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Spheres in a uniform grid whose cells are hashed into a fixed power-of-two number of buckets, each
+// chaining the spheres of every cell that maps to it. With the cell size at least the largest distance a
+// query cares about, a query only visits the 27 cells around its center, so inserting and testing are O(1)
+// however many spheres there are. Unbounded space, no allocation per cell.
+class SpatialHash
+{
+public:
+	// _expectedCount only sizes the bucket table; more spheres just make longer chains
+	SpatialHash(float _cellSize, size_t _expectedCount)
+		: inverseCellSize(1.0f / _cellSize)
+	{
+		size_t bucketCount = 64;
+		while (bucketCount < _expectedCount * 2)
+			bucketCount *= 2;
+		heads.assign(bucketCount, -1);
+		bucketMask = bucketCount - 1;
+		spheres.reserve(_expectedCount);
+		next.reserve(_expectedCount);
+	}
+
+	void Insert(const glm::vec3& _center, float _radius)
+	{
+		int32_t& head = heads[GetBucket(GetCell(_center))];
+		next.push_back(head);
+		head = static_cast<int32_t>(spheres.size());
+		spheres.emplace_back(_center, _radius);
+	}
+
+	// Whether a stored sphere is closer to _center than _separation * (its radius + _radius); both radii
+	// times _separation must stay within the cell size
+	bool Overlaps(const glm::vec3& _center, float _radius, float _separation) const
+	{
+		const glm::ivec3 cell = GetCell(_center);
+		for (int z = -1; z <= 1; z++)
+			for (int y = -1; y <= 1; y++)
+				for (int x = -1; x <= 1; x++)
+					// Chains may hold other cells' spheres too; the distance test sorts them out
+					for (int32_t i = heads[GetBucket(cell + glm::ivec3(x, y, z))]; i >= 0; i = next[i]) {
+						glm::vec3 d = glm::vec3(spheres[i]) - _center;
+						float minimum = _separation * (spheres[i].w + _radius);
+						if (glm::dot(d, d) < minimum * minimum)
+							return true;
+					}
+		return false;
+	}
+
+	size_t GetCount() const { return spheres.size(); }
+
+private:
+	glm::ivec3 GetCell(const glm::vec3& _position) const
+	{
+		return glm::ivec3(glm::floor(_position * inverseCellSize));
+	}
+
+	// Teschner et al., "Optimized Spatial Hashing for Collision Detection of Deformable Objects"
+	size_t GetBucket(const glm::ivec3& _cell) const
+	{
+		uint32_t hash = static_cast<uint32_t>(_cell.x) * 73856093u ^ static_cast<uint32_t>(_cell.y) * 19349663u
+			^ static_cast<uint32_t>(_cell.z) * 83492791u;
+		return hash & bucketMask;
+	}
+
+	float inverseCellSize;
+	size_t bucketMask = 0;
+	std::vector<int32_t> heads;       // per bucket, the last sphere inserted, -1 if none
+	std::vector<int32_t> next;        // per sphere, the one inserted into its bucket before it
+	std::vector<glm::vec4> spheres;   // xyz center, w radius
+};
@@ -7,6 +7,8 @@
 
 #include "camera.h"
 #include "model.h"
+#include "object_buffer.h"
+#include "render_queue.h"
 #include "shader.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -113,7 +115,7 @@ int main()
     glGenVertexArrays(1, &cubeVAO);
     glGenBuffers(1, &cubeVBO);
 
-    glBindVertexArray(cubeVAO);
+    GLState::Get().BindVertexArray(cubeVAO);
     glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), &cubeVertices, GL_STATIC_DRAW);
 
@@ -127,7 +129,7 @@ int main()
     glGenVertexArrays(1, &planeVAO);
     glGenBuffers(1, &planeVBO);
 
-    glBindVertexArray(planeVAO);
+    GLState::Get().BindVertexArray(planeVAO);
     glBindBuffer(GL_ARRAY_BUFFER, planeVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(planeVertices), &planeVertices, GL_STATIC_DRAW);
 
@@ -145,6 +147,32 @@ int main()
     shader.Bind();
     shader.SetInt("texture1", 0);
 
+    // Passes in execution order: the floor leaves the stencil alone, the cubes write 1 into it,
+    // and the scaled outlines are drawn where it isn't 1, on top of everything
+    RenderQueue renderQueue;
+    renderQueue.SetPass(0, [] {
+        glStencilMask(0x00); // Disable writing when rendering floor
+    });
+    renderQueue.SetPass(1, [] {
+        glStencilFunc(GL_ALWAYS, 1, 0xFF); // All frags update stencil buffer
+        glStencilMask(0xFF); // Enable writing when rendering cubes
+    });
+    renderQueue.SetPass(2, [] {
+        glStencilFunc(GL_NOTEQUAL, 1, 0xFF); // Render where ref value not equals 1
+        glStencilMask(0x00); // Disable writing when rendering scaled cubes
+        glDisable(GL_DEPTH_TEST);
+    });
+
+    // Both shaders read their model matrix from the object buffer, so the two cubes and the two
+    // outlines each collapse into one instanced draw
+    ObjectBuffer objects;
+    objects.BindShader(shader);
+    objects.BindShader(shaderSingleColor);
+    renderQueue.SetObjectBuffer(&objects);
+
+    int counter = 0;
+    const int maxPrints = 50;
+
     while (!glfwWindowShouldClose(window)) {
         float currentFrame = (float)glfwGetTime();
         deltaTime = currentFrame - lastFrame;
@@ -167,51 +195,39 @@ int main()
         shader.SetMat4("view", view);
         shader.SetMat4("projection", projection);
 
-        // floor
-        glStencilMask(0x00); // Disable writing when rendering floor
+        // Record the draws; the queue sorts them by pass, then program/texture/VAO, and skips redundant binds
+        renderQueue.SetViewMatrix(view);
 
-        glBindVertexArray(planeVAO);
-        glBindTexture(GL_TEXTURE_2D, floorTexture);
-        model = glm::translate(model, glm::vec3(0.0f, -0.5f, 0.0f));
-        shader.SetMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        // floor
+        renderQueue.SubmitArrays(0, shader, {}, glm::translate(model, glm::vec3(0.0f, -0.5f, 0.0f)),
+            planeVAO, { floorTexture }, GL_TRIANGLES, 0, 6);
 
         // cubes
-        glStencilFunc(GL_ALWAYS, 1, 0xFF); // All frags update stencil buffer
-        glStencilMask(0xFF); // Enable writing when rendering cubes
-        glBindVertexArray(cubeVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, cubeTexture);
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(-1.0f, 0.0f, -1.0f));
-        shader.SetMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        renderQueue.SubmitArrays(1, shader, {}, model, cubeVAO, { cubeTexture }, GL_TRIANGLES, 0, 36);
 
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(2.0f, 0.0f, 0.0f));
-        shader.SetMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        renderQueue.SubmitArrays(1, shader, {}, model, cubeVAO, { cubeTexture }, GL_TRIANGLES, 0, 36);
 
         // scaled cubes
-        glStencilFunc(GL_NOTEQUAL, 1, 0xFF); // Render where ref value not equals 1
-        glStencilMask(0x00); // Disable writing when rendering scaled cubes
-        glDisable(GL_DEPTH_TEST);
-
-        shaderSingleColor.Bind();
         float scale = 1.1f;
-        glBindVertexArray(cubeVAO);
-        glBindTexture(GL_TEXTURE_2D, cubeTexture);
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(-1.0f, 0.0f, -1.0f));
         model = glm::scale(model, glm::vec3(scale, scale, scale));
-        shaderSingleColor.SetMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        renderQueue.SubmitArrays(2, shaderSingleColor, {}, model, cubeVAO, {}, GL_TRIANGLES, 0, 36);
 
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(2.0f, 0.0f, 0.0f));
         model = glm::scale(model, glm::vec3(scale, scale, scale));
-        shaderSingleColor.SetMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        renderQueue.SubmitArrays(2, shaderSingleColor, {}, model, cubeVAO, {}, GL_TRIANGLES, 0, 36);
+
+        renderQueue.Execute();
+        if (counter < maxPrints) {
+            std::cout << "render queue: " << renderQueue.GetStats() << ", " << objects.GetStats() << "\n";
+            counter++;
+        }
 
         // Reset all stencil test configs
         glStencilMask(0xFF);
@@ -291,7 +307,7 @@ unsigned int LoadTexture(const std::string& path)
         else if (nrComponents == 3) format = GL_RGB;
         else if (nrComponents == 4) format = GL_RGBA;
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
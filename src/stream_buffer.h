@@ -0,0 +1,177 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include <GL/glew.h>
+
+#include "geometry_pool.h"
+
+// Buffer for data rewritten every frame (instance matrices, per-object uniforms), split into
+// frameCount segments used round-robin. With glBufferStorage (GL 4.4 / ARB_buffer_storage) the
+// whole buffer is mapped once, persistently and coherently, and each BeginWrite hands out the next
+// segment after waiting on the fence placed when that segment was last handed out frameCount
+// writes ago; normally the GPU is long done with it and the wait is free. The Stats count the
+// writes that did have to wait, i.e. the CPU running more than frameCount - 1 frames ahead.
+// Without buffer storage it falls back to orphaning: one segment, reallocated on every write.
+class StreamBuffer
+{
+public:
+	static constexpr unsigned int defaultFrameCount = 3;
+
+	struct Stats
+	{
+		size_t writes = 0;
+		size_t stalls = 0;      // writes that waited on the GPU
+		double waitMs = 0.0, maxWaitMs = 0.0;
+	};
+
+	StreamBuffer() = delete;
+	StreamBuffer(GLenum _target, size_t _bytesPerFrame, unsigned int _frameCount = defaultFrameCount)
+		: target(_target), frameCount(std::min(std::max(_frameCount, 1u), maxFrameCount))
+	{
+		persistent = (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) && glBufferStorage;
+		Allocate(_bytesPerFrame);
+	}
+
+	~StreamBuffer()
+	{
+		Release();
+	}
+
+	StreamBuffer(const StreamBuffer&) = delete;
+	StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+	// Pointer to _bytes (<= GetCapacity) of the next segment, write-only, valid until the next
+	// BeginWrite; must be called on the GL thread, the writing may happen on any
+	void* BeginWrite(size_t _bytes);
+
+	// Every writer must have finished. Returns false if the contents were lost and must be rewritten
+	bool EndWrite()
+	{
+		if (persistent)
+			return true;
+		glBindBuffer(target, bufferID);
+		bool intact = glUnmapBuffer(target) == GL_TRUE;
+		glBindBuffer(target, 0);
+		return intact;
+	}
+
+	// Grow the per-frame capacity; the old storage is released, so call between frames
+	void Reserve(size_t _bytesPerFrame)
+	{
+		if (_bytesPerFrame <= capacity)
+			return;
+		Release();
+		Allocate(_bytesPerFrame);
+	}
+
+	unsigned int GetID() const { return bufferID; }
+	size_t GetCapacity() const { return capacity; }              // bytes per frame
+	size_t GetOffset() const { return segment * segmentSize; }   // of the last BeginWrite's data in the buffer
+	bool IsPersistent() const { return persistent; }
+	unsigned int GetFrameCount() const { return persistent ? frameCount : 1; }
+
+	const Stats& GetStats() const { return stats; }
+	void ResetStats() { stats = Stats(); }
+
+private:
+	// Segments start on a 256-byte boundary, which satisfies every uniform buffer offset alignment
+	static constexpr size_t segmentAlignment = 256;
+
+	void Allocate(size_t _bytesPerFrame)
+	{
+		capacity = _bytesPerFrame;
+		segmentSize = (_bytesPerFrame + segmentAlignment - 1) / segmentAlignment * segmentAlignment;
+		// The first BeginWrite advances to segment 0; orphaning always writes segment 0
+		segment = persistent ? frameCount - 1 : 0;
+		written = false;
+		std::fill(std::begin(fences), std::end(fences), nullptr);
+
+		glGenBuffers(1, &bufferID);
+		glBindBuffer(target, bufferID);
+		if (persistent) {
+			const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(target, segmentSize * frameCount, nullptr, flags);
+			mapped = static_cast<unsigned char*>(glMapBufferRange(target, 0, segmentSize * frameCount, flags));
+		}
+		else {
+			glBufferData(target, capacity, nullptr, GL_STREAM_DRAW);
+		}
+		glBindBuffer(target, 0);
+	}
+
+	void Release()
+	{
+		for (GLsync& fence : fences)
+			if (fence) {
+				glDeleteSync(fence);
+				fence = nullptr;
+			}
+		if (persistent && mapped) {
+			glBindBuffer(target, bufferID);
+			glUnmapBuffer(target);
+			glBindBuffer(target, 0);
+			mapped = nullptr;
+		}
+		GeometryPool::ReleaseInstanceBuffer(bufferID);
+		glDeleteBuffers(1, &bufferID);
+		bufferID = 0;
+	}
+
+	static constexpr unsigned int maxFrameCount = 8;  // Fences per buffer; larger frame counts are clamped to it
+
+	GLenum target;
+	unsigned int frameCount;
+	bool persistent = false;
+	unsigned int bufferID = 0;
+	size_t capacity = 0, segmentSize = 0;
+	unsigned int segment = 0;
+	bool written = false;             // segment has been handed out and needs a fence
+	unsigned char* mapped = nullptr;
+	GLsync fences[maxFrameCount] = {};
+	Stats stats;
+};
+
+inline void* StreamBuffer::BeginWrite(size_t _bytes)
+{
+	stats.writes++;
+	if (!persistent) {
+		// Orphan: the driver hands out fresh memory instead of waiting for draws still reading the old
+		glBindBuffer(target, bufferID);
+		glBufferData(target, capacity, nullptr, GL_STREAM_DRAW);
+		void* data = glMapBufferRange(target, 0, _bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		glBindBuffer(target, 0);
+		return data;
+	}
+
+	// Everything issued so far, including the draws reading the previous segment, precedes this fence
+	if (written)
+		fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	segment = (segment + 1) % frameCount;
+	written = true;
+
+	if (GLsync fence = fences[segment]) {
+		GLenum status = glClientWaitSync(fence, 0, 0);
+		if (status == GL_TIMEOUT_EXPIRED) {
+			auto start = std::chrono::high_resolution_clock::now();
+			do
+				status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1 ms
+			while (status == GL_TIMEOUT_EXPIRED);
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			stats.stalls++;
+			stats.waitMs += ms;
+			stats.maxWaitMs = std::max(stats.maxWaitMs, ms);
+		}
+		glDeleteSync(fence);
+		fences[segment] = nullptr;
+	}
+	return mapped + GetOffset();
+}
+
+inline std::ostream& operator<<(std::ostream& _stream, const StreamBuffer::Stats& _stats)
+{
+	return _stream << _stats.writes << " writes, " << _stats.stalls << " stalled (" << _stats.waitMs << " ms waited, max "
+		<< _stats.maxWaitMs << " ms)";
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <string>
+#include <cctype>
+#include <filesystem>
+#include <unordered_map>
+
+#include <GL/glew.h>
+
+#include "gl_state.h"
+#include "texture_loader.h"
+
+// Process-wide texture cache shared by every Model.
+// Entries are keyed by the canonicalized file path plus the load parameters and hold a
+// reference count on the GL texture, so an image referenced by several models is decoded
+// and uploaded once and deleted when the last model releases it.
+// Like the rest of the GL objects it must only be used from the GL thread.
+class TextureCache
+{
+public:
+	static TextureCache& Get()
+	{
+		static TextureCache cache;
+		return cache;
+	}
+
+	TextureCache(const TextureCache&) = delete;
+	TextureCache& operator=(const TextureCache&) = delete;
+
+	// Returns a texture name holding one reference. On a miss the image is queued on _loader
+	// (or loaded synchronously when no loader is given).
+	unsigned int Acquire(const std::string& _filename, TextureLoader* _loader,
+		const TextureLoadParams& _params = TextureLoadParams());
+
+	// Drop one reference; the texture is deleted when no references remain
+	void Release(unsigned int _textureID);
+
+	size_t GetHitCount() const { return hits; }
+	size_t GetMissCount() const { return misses; }
+	size_t GetResidentCount() const { return entries.size(); }
+
+private:
+	TextureCache() = default;
+
+	static std::string MakeKey(const std::string& _filename, const TextureLoadParams& _params);
+
+	struct Entry
+	{
+		unsigned int textureID;
+		unsigned int refCount;
+	};
+
+	std::unordered_map<std::string, Entry> entries;
+	std::unordered_map<unsigned int, std::string> keysByTexture;
+	size_t hits = 0;
+	size_t misses = 0;
+};
+
+inline std::string TextureCache::MakeKey(const std::string& _filename, const TextureLoadParams& _params)
+{
+	// "res/models/../models/a.png" and "res\\models\\a.png" must map to the same entry
+	std::error_code ec;
+	std::filesystem::path canonical = std::filesystem::weakly_canonical(_filename, ec);
+	std::string key = ec ? std::filesystem::path(_filename).lexically_normal().generic_string() : canonical.generic_string();
+#ifdef _WIN32
+	// NTFS paths are case-insensitive
+	for (char& c : key)
+		c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+#endif
+	key += '|';
+	key += std::to_string(_params.wrap);
+	key += _params.generateMipmaps ? "|mip" : "|nomip";
+	return key;
+}
+
+inline unsigned int TextureCache::Acquire(const std::string& _filename, TextureLoader* _loader,
+	const TextureLoadParams& _params)
+{
+	const std::string key = MakeKey(_filename, _params);
+
+	auto it = entries.find(key);
+	if (it != entries.end()) {
+		hits++;
+		it->second.refCount++;
+		return it->second.textureID;
+	}
+
+	misses++;
+	unsigned int textureID;
+	if (_loader) {
+		textureID = _loader->Request(_filename, _params);
+	}
+	else {
+		// Synchronous path, same decode + upload on the calling thread
+		TextureLoader loader;
+		textureID = loader.Request(_filename, _params);
+		loader.Finish();
+	}
+
+	entries.emplace(key, Entry{ textureID, 1 });
+	keysByTexture.emplace(textureID, key);
+	return textureID;
+}
+
+inline void TextureCache::Release(unsigned int _textureID)
+{
+	auto keyIt = keysByTexture.find(_textureID);
+	if (keyIt == keysByTexture.end())
+		return;
+
+	auto it = entries.find(keyIt->second);
+	if (--it->second.refCount == 0) {
+		GLState::Get().DeleteTextures(1, &_textureID);
+		entries.erase(it);
+		keysByTexture.erase(keyIt);
+	}
+}
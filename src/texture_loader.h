@@ -0,0 +1,124 @@
+#pragma once
+
+#include <string>
+#include <deque>
+#include <mutex>
+#include <iostream>
+#include <condition_variable>
+
+#include <GL/glew.h>
+
+// stb_image.h re-emits its implementation if included twice after STB_IMAGE_IMPLEMENTATION
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include "stb_image.h"
+#endif
+
+#include "gl_state.h"
+#include "thread_pool.h"
+
+// Sampler settings applied at upload; textures that differ in these are distinct cache entries
+struct TextureLoadParams
+{
+	GLint wrap = GL_REPEAT;
+	bool generateMipmaps = true;
+};
+
+// Upload decoded pixels into an existing texture object
+inline void UploadTexture(unsigned int textureID, const unsigned char* data, int width, int height, int nrComponents,
+	const TextureLoadParams& params = TextureLoadParams())
+{
+	GLenum format = GL_RGB;
+	if (nrComponents == 1) format = GL_RED;
+	if (nrComponents == 3) format = GL_RGB;
+	if (nrComponents == 4) format = GL_RGBA;
+
+	GLState::Get().BindTexture(GL_TEXTURE_2D, textureID);
+	glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+	if (params.generateMipmaps)
+		glGenerateMipmap(GL_TEXTURE_2D);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, params.wrap);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, params.wrap);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, params.generateMipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+// Two-stage texture loading: stbi_load runs on the thread pool, while the GL thread
+// only uploads images as they finish decoding. Texture names are generated up front,
+// so meshes can reference a texture before its pixels arrive.
+class TextureLoader
+{
+public:
+	explicit TextureLoader(ThreadPool& _pool = ThreadPool::Global()) : pool(_pool) {}
+	~TextureLoader() { Finish(); }
+
+	TextureLoader(const TextureLoader&) = delete;
+	TextureLoader& operator=(const TextureLoader&) = delete;
+
+	// Must be called on the GL thread; returns the texture name immediately and queues the decode
+	unsigned int Request(const std::string& _filename, const TextureLoadParams& _params = TextureLoadParams());
+
+	// Block until every requested texture is decoded and uploaded, uploading in completion order
+	void Finish();
+
+private:
+	struct DecodedImage
+	{
+		unsigned int textureID;
+		std::string filename;
+		TextureLoadParams params;
+		unsigned char* data;
+		int width, height, nrComponents;
+	};
+
+	ThreadPool& pool;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::deque<DecodedImage> decoded;
+	size_t inFlight = 0;
+};
+
+inline unsigned int TextureLoader::Request(const std::string& _filename, const TextureLoadParams& _params)
+{
+	unsigned int textureID;
+	glGenTextures(1, &textureID);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		inFlight++;
+	}
+
+	pool.Submit([this, textureID, _filename, _params] {
+		DecodedImage image{ textureID, _filename, _params, nullptr, 0, 0, 0 };
+		image.data = stbi_load(_filename.c_str(), &image.width, &image.height, &image.nrComponents, 0);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			decoded.push_back(std::move(image));
+		}
+		condition.notify_one();
+	});
+
+	return textureID;
+}
+
+inline void TextureLoader::Finish()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (inFlight > 0) {
+		condition.wait(lock, [this] { return !decoded.empty(); });
+		DecodedImage image = std::move(decoded.front());
+		decoded.pop_front();
+		inFlight--;
+
+		// Keep decoding going on the workers while this thread talks to the driver
+		lock.unlock();
+		if (image.data) {
+			UploadTexture(image.textureID, image.data, image.width, image.height, image.nrComponents, image.params);
+		}
+		else {
+			std::cout << "Texture failed to load at path: " << image.filename << std::endl;
+		}
+		stbi_image_free(image.data);
+		lock.lock();
+	}
+}
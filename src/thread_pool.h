@@ -0,0 +1,150 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+
+// Fixed-size pool of worker threads consuming a FIFO of tasks.
+// Shared by the loaders and the per-frame systems through ThreadPool::Global().
+class ThreadPool
+{
+public:
+	ThreadPool() = delete;
+	explicit ThreadPool(unsigned int _threadCount);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Queue a task; it runs on one of the workers at some later point
+	void Submit(std::function<void()> _task);
+
+	// Run _function(begin, end) over [0, _count) in chunks of at least _minChunk elements.
+	// Workers and the calling thread pull chunks from a shared counter, so faster threads take
+	// more of the range; returns once every chunk has finished.
+	template<class Function>
+	void ParallelFor(size_t _count, size_t _minChunk, Function&& _function);
+
+	unsigned int GetThreadCount() const { return static_cast<unsigned int>(workers.size()); }
+
+	// Process-wide pool, one worker per hardware thread except the one driving GL
+	static ThreadPool& Global()
+	{
+		static ThreadPool pool(GetDefaultWorkerCount());
+		return pool;
+	}
+
+	// hardware_concurrency() may report 0 when the count is unknown
+	static unsigned int GetDefaultWorkerCount()
+	{
+		unsigned int n = std::thread::hardware_concurrency();
+		return n > 1 ? n - 1 : 1;
+	}
+
+private:
+	void WorkerLoop();
+
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool stopping = false;
+};
+
+inline ThreadPool::ThreadPool(unsigned int _threadCount)
+{
+	_threadCount = std::max(1u, _threadCount);
+	workers.reserve(_threadCount);
+	for (unsigned int i = 0; i < _threadCount; i++)
+		workers.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+inline ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	condition.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+inline void ThreadPool::Submit(std::function<void()> _task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tasks.push_back(std::move(_task));
+	}
+	condition.notify_one();
+}
+
+inline void ThreadPool::WorkerLoop()
+{
+	for (;;) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [this] { return stopping || !tasks.empty(); });
+			// Drain the queue before exiting so no submitted task is silently dropped
+			if (tasks.empty())
+				return;
+			task = std::move(tasks.front());
+			tasks.pop_front();
+		}
+		task();
+	}
+}
+
+template<class Function>
+inline void ThreadPool::ParallelFor(size_t _count, size_t _minChunk, Function&& _function)
+{
+	if (_count == 0)
+		return;
+
+	// A few chunks per thread keeps everyone busy when chunks take uneven time
+	const size_t threads = workers.size() + 1;
+	const size_t chunkSize = std::max(std::max<size_t>(_minChunk, 1), (_count + threads * 4 - 1) / (threads * 4));
+	const size_t chunkCount = (_count + chunkSize - 1) / chunkSize;
+	if (chunkCount == 1) {
+		_function(size_t(0), _count);
+		return;
+	}
+
+	struct SharedState
+	{
+		std::atomic<size_t> nextChunk{ 0 };
+		std::atomic<size_t> helpersRunning{ 0 };
+		std::mutex mutex;
+		std::condition_variable done;
+	} state;
+
+	auto runChunks = [&]() {
+		for (size_t chunk = state.nextChunk++; chunk < chunkCount; chunk = state.nextChunk++) {
+			size_t begin = chunk * chunkSize;
+			_function(begin, std::min(begin + chunkSize, _count));
+		}
+	};
+
+	const size_t helpers = std::min(workers.size(), chunkCount - 1);
+	state.helpersRunning = helpers;
+	for (size_t i = 0; i < helpers; i++) {
+		Submit([&state, &runChunks] {
+			runChunks();
+			// Notify under the lock so the caller can't return and destroy the state in between
+			std::lock_guard<std::mutex> lock(state.mutex);
+			if (--state.helpersRunning == 0)
+				state.done.notify_one();
+		});
+	}
+
+	runChunks();
+
+	std::unique_lock<std::mutex> lock(state.mutex);
+	state.done.wait(lock, [&state] { return state.helpersRunning == 0; });
+}
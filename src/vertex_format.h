@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+// GPU vertex layouts a Mesh can be uploaded with. The CPU side always keeps the fp32 Vertex.
+enum class VertexFormat
+{
+	Float32, // Vertex as-is, 56 bytes
+	Packed   // PackedVertex, 20 bytes
+};
+
+struct Vertex
+{
+	glm::vec3 position;
+	glm::vec3 normal;
+	glm::vec2 texCoords;
+	glm::vec3 Tangent;
+	glm::vec3 Bitangent;
+};
+
+// Compact layout read through normalized / half-float attribute pointers, so the existing
+// vertex shaders see the same vec3/vec2 inputs at locations 0-3 without any decode code.
+//   position  : 3 x half float (+ 2 bytes padding)
+//   normal    : snorm 10:10:10:2 (GL_INT_2_10_10_10_REV)
+//   tangent   : snorm 10:10:10:2, w = bitangent handedness (+1/-1)
+//   texCoords : 2 x half float, so repeating UVs outside [0,1] stay representable
+// There is no bitangent attribute; shaders that need it use cross(normal, tangent.xyz) * tangent.w.
+struct PackedVertex
+{
+	uint16_t position[3];
+	uint16_t padding;
+	uint32_t normal;
+	uint32_t tangent;
+	uint16_t texCoords[2];
+};
+
+static_assert(sizeof(PackedVertex) == 20, "PackedVertex must stay tightly packed");
+
+// Worst-case and mean deviation of the packed attributes from the fp32 source
+struct VertexQuantizationError
+{
+	size_t vertexCount = 0;
+	float maxPositionError = 0.0f;  // object-space units
+	float meanPositionError = 0.0f;
+	float maxNormalError = 0.0f;    // degrees
+	float maxTangentError = 0.0f;   // degrees
+	float maxTexCoordError = 0.0f;  // UV units
+	size_t handednessFlips = 0;     // bitangent sign reconstructed wrongly
+
+	// Combine per-mesh reports into a per-model one
+	void Merge(const VertexQuantizationError& _other)
+	{
+		size_t total = vertexCount + _other.vertexCount;
+		if (total > 0)
+			meanPositionError = (meanPositionError * vertexCount + _other.meanPositionError * _other.vertexCount) / total;
+		vertexCount = total;
+		maxPositionError = std::max(maxPositionError, _other.maxPositionError);
+		maxNormalError = std::max(maxNormalError, _other.maxNormalError);
+		maxTangentError = std::max(maxTangentError, _other.maxTangentError);
+		maxTexCoordError = std::max(maxTexCoordError, _other.maxTexCoordError);
+		handednessFlips += _other.handednessFlips;
+	}
+};
+
+inline PackedVertex PackVertex(const Vertex& _vertex)
+{
+	PackedVertex packed;
+	packed.position[0] = glm::packHalf1x16(_vertex.position.x);
+	packed.position[1] = glm::packHalf1x16(_vertex.position.y);
+	packed.position[2] = glm::packHalf1x16(_vertex.position.z);
+	packed.padding = 0;
+
+	packed.normal = glm::packSnorm3x10_1x2(glm::vec4(_vertex.normal, 0.0f));
+
+	// Right-handed when bitangent agrees with cross(N, T)
+	float handedness = glm::dot(glm::cross(_vertex.normal, _vertex.Tangent), _vertex.Bitangent) < 0.0f ? -1.0f : 1.0f;
+	packed.tangent = glm::packSnorm3x10_1x2(glm::vec4(_vertex.Tangent, handedness));
+
+	packed.texCoords[0] = glm::packHalf1x16(_vertex.texCoords.x);
+	packed.texCoords[1] = glm::packHalf1x16(_vertex.texCoords.y);
+	return packed;
+}
+
+// CPU mirror of what the vertex shader sees for a packed vertex
+inline Vertex UnpackVertex(const PackedVertex& _packed)
+{
+	Vertex vertex;
+	vertex.position = glm::vec3(glm::unpackHalf1x16(_packed.position[0]),
+		glm::unpackHalf1x16(_packed.position[1]), glm::unpackHalf1x16(_packed.position[2]));
+	vertex.normal = glm::vec3(glm::unpackSnorm3x10_1x2(_packed.normal));
+	glm::vec4 tangent = glm::unpackSnorm3x10_1x2(_packed.tangent);
+	vertex.Tangent = glm::vec3(tangent);
+	vertex.Bitangent = glm::cross(vertex.normal, vertex.Tangent) * (tangent.w < 0.0f ? -1.0f : 1.0f);
+	vertex.texCoords = glm::vec2(glm::unpackHalf1x16(_packed.texCoords[0]), glm::unpackHalf1x16(_packed.texCoords[1]));
+	return vertex;
+}
+
+// Pack a whole vertex array and measure the round-trip error against the source
+inline std::vector<PackedVertex> PackVertices(const std::vector<Vertex>& _vertices, bool _hasTangentAndBitangent,
+	VertexQuantizationError* _error = nullptr)
+{
+	auto angleBetween = [](const glm::vec3& _a, const glm::vec3& _b) {
+		float lengths = glm::length(_a) * glm::length(_b);
+		if (lengths <= 0.0f)
+			return 0.0f;
+		return glm::degrees(std::acos(glm::clamp(glm::dot(_a, _b) / lengths, -1.0f, 1.0f)));
+	};
+
+	std::vector<PackedVertex> packed(_vertices.size());
+	VertexQuantizationError error;
+	error.vertexCount = _vertices.size();
+	double positionErrorSum = 0.0;
+
+	for (size_t i = 0; i < _vertices.size(); i++) {
+		const Vertex& source = _vertices[i];
+		packed[i] = PackVertex(source);
+		if (!_error)
+			continue;
+
+		Vertex decoded = UnpackVertex(packed[i]);
+		float positionError = glm::length(decoded.position - source.position);
+		positionErrorSum += positionError;
+		error.maxPositionError = std::max(error.maxPositionError, positionError);
+		error.maxNormalError = std::max(error.maxNormalError, angleBetween(decoded.normal, source.normal));
+		error.maxTexCoordError = std::max(error.maxTexCoordError,
+			glm::max(std::abs(decoded.texCoords.x - source.texCoords.x), std::abs(decoded.texCoords.y - source.texCoords.y)));
+		if (_hasTangentAndBitangent) {
+			error.maxTangentError = std::max(error.maxTangentError, angleBetween(decoded.Tangent, source.Tangent));
+			if (glm::dot(decoded.Bitangent, source.Bitangent) < 0.0f)
+				error.handednessFlips++;
+		}
+	}
+
+	if (_error) {
+		error.meanPositionError = _vertices.empty() ? 0.0f : static_cast<float>(positionErrorSum / _vertices.size());
+		*_error = error;
+	}
+	return packed;
+}